@@ -3,6 +3,7 @@
 #include <array>
 #include <vector>
 #include <string>
+#include <variant>
 #include <cinttypes>
 
 namespace io {
@@ -153,21 +154,318 @@ struct Element {
   std::vector< int > tags;
 };
 
-int nodes_per_elem(io::Element::Type type);
+constexpr int nodes_per_elem(Element::Type type){
+  switch (type) {
+    case Element::Type::Line2:       return 2;
+    case Element::Type::Line3:       return 3;
+    case Element::Type::Tri3:        return 3;
+    case Element::Type::Tri6:        return 6;
+    case Element::Type::Quad4:       return 4;
+    case Element::Type::Quad8:       return 8;
+    case Element::Type::Quad9:       return 9;
+    case Element::Type::Tet4:        return 4;
+    case Element::Type::Tet10:       return 10;
+    case Element::Type::Pyr5:        return 5;
+    case Element::Type::Pyr13:       return 13;
+    case Element::Type::Pyr14:       return 14;
+    case Element::Type::Prism6:      return 6;
+    case Element::Type::Prism15:     return 15;
+    case Element::Type::Prism18:     return 18;
+    case Element::Type::Hex8:        return 8;
+    case Element::Type::Hex20:       return 20;
+    case Element::Type::Hex27:       return 27;
+    case Element::Type::Unsupported: return -1;
+  }
+  return -1;
+}
 
+// 1 for lines, 2 for triangles and quadrilaterals, 3 for everything else
+constexpr int element_dimension(Element::Type type){
+  switch (type) {
+    case Element::Type::Line2:
+    case Element::Type::Line3:       return 1;
+    case Element::Type::Tri3:
+    case Element::Type::Tri6:
+    case Element::Type::Quad4:
+    case Element::Type::Quad8:
+    case Element::Type::Quad9:       return 2;
+    case Element::Type::Unsupported: return -1;
+    default:                         return 3;
+  }
+}
+
+// importers number the nodes and elements 0, 1, ..., n-1. When the ids in 
+// the file aren't 1, 2, ..., n (e.g. they have gaps), they're renumbered in
+// increasing order, and original_node_ids[i] (or original_element_ids[i]) 
+// is the id that node (or element) i had in the file. Otherwise, these are empty.
 struct Mesh {
   std::vector< std::array< double, 3 > > nodes;
   std::vector< Element > elements;
+  std::vector< int64_t > original_node_ids;
+  std::vector< int64_t > original_element_ids;
+};
+
+// struct-of-arrays alternative to Mesh, where the element data lives in a 
+// few contiguous arrays (compressed sparse row) instead of one pair of 
+// heap-allocated std::vectors per element:
+//
+//   element i has type          types[i]
+//                 node ids      connectivity[offsets[i] ... offsets[i+1])
+//                 tags          tags[tag_offsets[i] ... tag_offsets[i+1])
+//
+// so offsets and tag_offsets have (number of elements + 1) entries.
+//
+// blocks partition the elements into runs of a single type, so the 
+// connectivity of block b is the fixed-stride array
+//
+//   connectivity[offsets[b.first] ... offsets[b.first + b.count])
+//
+// with nodes_per_elem(b.type) entries per element. push_back() keeps the 
+// blocks up to date, code that fills in the arrays directly should call
+// rebuild_blocks() afterwards, and group_by_type() reorders the elements 
+// so that there is exactly one block per element type.
+//
+// original_node_ids and original_element_ids are the same as for Mesh.
+//
+// index_t is the type used for node ids, element counts and offsets 
+// (int32_t or int64_t), so meshes with more than 2^31 nodes or
+// connectivity entries can use FlatMesh< int64_t >.
+template < typename index_t >
+struct ElementBlock {
+  Element::Type type;
+  index_t first;
+  index_t count;
+};
+
+template < typename index_t = int32_t >
+struct FlatMesh {
+  std::vector< std::array< double, 3 > > nodes;
+  std::vector< Element::Type > types;
+  std::vector< index_t > offsets{0};
+  std::vector< index_t > connectivity;
+  std::vector< index_t > tag_offsets{0};
+  std::vector< int > tags;
+  std::vector< ElementBlock< index_t > > blocks;
+  std::vector< int64_t > original_node_ids;
+  std::vector< int64_t > original_element_ids;
+
+  std::size_t num_elements() const { return types.size(); }
+  void push_back(Element::Type type, const std::vector< index_t > & node_ids, const std::vector< int > & elem_tags = {});
+  void rebuild_blocks();
 };
 
+template < typename index_t = int32_t >
+FlatMesh< index_t > flatten(const Mesh & mesh);
+
+template < typename index_t >
+Mesh unflatten(const FlatMesh< index_t > & mesh);
+
+template < typename index_t >
+FlatMesh< index_t > group_by_type(const FlatMesh< index_t > & mesh);
+
+// the exterior surface of the volume elements of a mesh: every face of a Tet,
+// Pyr, Prism or Hex element that no other volume element shares (matched by 
+// their corner nodes), as a surface element of the matching type (e.g. the 
+// faces of a Hex27 are Quad9s), oriented so that its normal points out of the 
+// element it came from. The faces are in order of the elements they came from,
+// they get the tags of those elements, and they refer to the same nodes as the 
+// input mesh. Line and surface elements of the input aren't included.
+//
+// mesh_t can be Mesh, FlatMesh< int32_t > or FlatMesh< int64_t >
+template < typename mesh_t >
+mesh_t extract_boundary(const mesh_t & mesh);
+
 enum class FileEncoding { ASCII, Binary };
 
-Mesh import_stl(std::string filename);
-Mesh import_gmsh_v22(std::string filename);
+// the number of threads used by the parts of the importers and exporters 
+// that run in parallel, where n <= 0 (the default) means one per hardware thread
+void set_num_threads(int n);
+int get_num_threads();
+
+// STL files store every triangle with its own copy of its 3 vertices, so by
+// default import_stl creates 3 nodes per triangle. With weld = true, vertices
+// within `tolerance` of each other (or identical ones, for a tolerance of 0) 
+// are merged into shared nodes, in order of their first appearance in the file.
+// Triangles are kept even if welding collapses some of their vertices together.
+struct StlOptions {
+  bool weld = false;
+  double tolerance = 0.0;
+};
+
+// mesh_t can be Mesh, FlatMesh< int32_t > or FlatMesh< int64_t >
+template < typename mesh_t = Mesh >
+mesh_t import_stl(std::string filename);
+template < typename mesh_t = Mesh >
+mesh_t import_stl(std::string filename, const StlOptions & options);
+template < typename mesh_t = Mesh >
+mesh_t import_gmsh_v22(std::string filename);
+template < typename mesh_t = Mesh >
+mesh_t import_gmsh_v41(std::string filename);
+
+// import_vtk reads the UNSTRUCTURED_GRID of a legacy .vtk file (ASCII or 
+// BINARY, in either the classic or the version 5.1 layout of CELLS), and 
+// import_vtu reads the first Piece of an UnstructuredGrid .vtu file (with 
+// ascii, inline base64 binary or raw appended DataArrays, zlib-compressed 
+// or not). The nodes of each element are put back in gmsh's order, the 
+// elements have no tags, and any point or cell data in the file is ignored.
+template < typename mesh_t = Mesh >
+mesh_t import_vtk(std::string filename);
+template < typename mesh_t = Mesh >
+mesh_t import_vtu(std::string filename);
+
+// selects which parts of a gmsh file to load: sections that aren't needed
+// are skipped over without being parsed, and an element is only kept if its
+// type is one of `types` and its first (physical) tag is one of `physical_tags`,
+// where an empty list matches anything. The kept elements are stored in order
+// of their ids, and their node ids still refer to the full list of nodes.
+struct GmshFilter {
+  bool nodes = true;
+  bool elements = true;
+  std::vector< Element::Type > types;
+  std::vector< int > physical_tags;
+};
+
+template < typename mesh_t = Mesh >
+mesh_t import_gmsh_v22(std::string filename, const GmshFilter & filter);
+
+// the byte offsets of the contents of every $Name ... $EndName section
+// in a gmsh file, i.e. [begin, end) starts after the $Name line and 
+// stops at the beginning of the $EndName line
+struct GmshSection {
+  std::string name; // without the '$'
+  std::size_t begin;
+  std::size_t end;
+};
+
+std::vector< GmshSection > index_gmsh(std::string filename);
+
+// streaming alternative to import_gmsh_v22, for tools that only need to 
+// make one pass over the mesh (e.g. counting elements per tag, or computing
+// a bounding box). The file is decoded front to back, and its contents are 
+// passed to the visitor in batches of (at most) 65536 nodes or elements, 
+// so memory use stays bounded regardless of the size of the mesh.
+//
+// All ids are zero-based, batch data is only valid during the call, 
+// and every element in a batch has the same type and number of tags:
+//
+//   element i has id         ids[i]
+//                 tags       tags[i * num_tags ... (i+1) * num_tags)
+//                 node ids   node_ids[i * nodes_per_elem(type) ... (i+1) * nodes_per_elem(type))
+//
+struct NodeBatch {
+  std::size_t count;
+  const int64_t * ids;
+  const std::array< double, 3 > * coordinates;
+};
+
+struct ElementBatch {
+  Element::Type type;
+  std::size_t count;
+  int num_tags;
+  const int64_t * ids;
+  const int * tags;
+  const int64_t * node_ids;
+};
+
+struct GmshVisitor {
+  virtual ~GmshVisitor() = default;
+  virtual void begin_nodes(std::size_t /* num_nodes */) {}
+  virtual void nodes(const NodeBatch & /* batch */) {}
+  virtual void begin_elements(std::size_t /* num_elements */) {}
+  virtual void elements(const ElementBatch & /* batch */) {}
+};
+
+void visit_gmsh_v22(std::string filename, GmshVisitor & visitor);
+
+// export_stl writes every surface element as triangles, where linear elements
+// always use the same pattern (Tri3 -> 1, Quad4 -> 4 triangles), and quadratic 
+// ones are subdivided n = `subdivisions` times along each edge (Tri6 -> n^2, 
+// Quad8 and Quad9 -> 2 n^2 triangles). With a chord_tolerance > 0, each quadratic
+// element instead gets the fewest subdivisions (up to max_subdivisions) that keep 
+// its triangles within about chord_tolerance of the curved surface, so flat 
+// elements are written as 1 (Tri6) or 2 (Quad8, Quad9) triangles. 
+// Both subdivision counts must be between 1 and 8.
+struct StlExportOptions {
+  int subdivisions = 4;
+  double chord_tolerance = 0.0;
+  int max_subdivisions = 8;
+};
+
+// per-node or per-element values (e.g. displacements, or stresses) to write 
+// along with a mesh, where a field with n components has n values per node 
+// (or element), so the value of component c for node i is values[i * n + c]. 
+// Names can't be empty or contain whitespace, quotes or any of <>&.
+//
+// vtu and vtk files keep the type of the values, and gmsh files store every
+// value as a double. gmsh readers expect 1, 3 or 9 components per value.
+struct Field {
+  std::string name;
+  int num_components = 1;
+  std::variant< std::vector< double >, std::vector< float >, std::vector< int32_t >, std::vector< int64_t > > values;
+};
+
+struct Fields {
+  std::vector< Field > nodes;
+  std::vector< Field > elements;
+};
+
+// export_vtu zlib-compresses each array in independent blocks of `block_size`
+// bytes, which are compressed and base64-encoded in parallel (see set_num_threads).
+// Smaller blocks let smaller arrays use more threads, but compress slightly worse.
+//
+// With appended = true, the arrays are written as raw bytes in an <AppendedData> 
+// section instead of as base64 text, which makes the file 25% smaller and skips 
+// the encoding. With compress = false, the arrays aren't compressed at all.
+struct VtuExportOptions {
+  std::size_t block_size = std::size_t(4) << 20;
+  bool compress = true;
+  bool appended = false;
+};
 
 bool export_stl(const Mesh & mesh, std::string filename);
+bool export_stl(const Mesh & mesh, std::string filename, const StlExportOptions & options);
 bool export_vtk(const Mesh & mesh, std::string filename, FileEncoding enc);
+bool export_vtk(const Mesh & mesh, std::string filename, FileEncoding enc, const Fields & fields);
 bool export_vtu(const Mesh & mesh, std::string filename);
+bool export_vtu(const Mesh & mesh, std::string filename, const Fields & fields);
+bool export_vtu(const Mesh & mesh, std::string filename, const VtuExportOptions & options);
+bool export_vtu(const Mesh & mesh, std::string filename, const Fields & fields, const VtuExportOptions & options);
 bool export_gmsh_v22(const Mesh & mesh, std::string filename, FileEncoding enc);
+bool export_gmsh_v22(const Mesh & mesh, std::string filename, FileEncoding enc, const Fields & fields);
+bool export_gmsh_v41(const Mesh & mesh, std::string filename, FileEncoding enc);
+
+// the FlatMesh overloads are available for index_t = int32_t and int64_t
+template < typename index_t >
+bool export_stl(const FlatMesh< index_t > & mesh, std::string filename);
+
+template < typename index_t >
+bool export_stl(const FlatMesh< index_t > & mesh, std::string filename, const StlExportOptions & options);
+
+template < typename index_t >
+bool export_vtk(const FlatMesh< index_t > & mesh, std::string filename, FileEncoding enc);
+
+template < typename index_t >
+bool export_vtk(const FlatMesh< index_t > & mesh, std::string filename, FileEncoding enc, const Fields & fields);
+
+template < typename index_t >
+bool export_vtu(const FlatMesh< index_t > & mesh, std::string filename);
+
+template < typename index_t >
+bool export_vtu(const FlatMesh< index_t > & mesh, std::string filename, const Fields & fields);
+
+template < typename index_t >
+bool export_vtu(const FlatMesh< index_t > & mesh, std::string filename, const VtuExportOptions & options);
+
+template < typename index_t >
+bool export_vtu(const FlatMesh< index_t > & mesh, std::string filename, const Fields & fields, const VtuExportOptions & options);
+
+template < typename index_t >
+bool export_gmsh_v22(const FlatMesh< index_t > & mesh, std::string filename, FileEncoding enc);
+
+template < typename index_t >
+bool export_gmsh_v22(const FlatMesh< index_t > & mesh, std::string filename, FileEncoding enc, const Fields & fields);
+
+template < typename index_t >
+bool export_gmsh_v41(const FlatMesh< index_t > & mesh, std::string filename, FileEncoding enc);
 
 }
\ No newline at end of file
@@ -5,31 +5,55 @@
 
 namespace Base64 {
 
+  static constexpr unsigned char kDecodingTable[] = {
+    64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+    64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+    64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 62, 64, 64, 64, 63,
+    52, 53, 54, 55, 56, 57, 58, 59, 60, 61, 64, 64, 64, 64, 64, 64,
+    64,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14,
+    15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 64, 64, 64, 64, 64,
+    64, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+    41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, 64, 64, 64, 64, 64,
+    64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+    64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+    64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+    64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+    64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+    64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+    64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+    64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64
+  };
+
   std::string Encode(const uint32_t & value) {
     std::vector<uint8_t> data(4);
     std::memcpy(&data[0], &value, 4);
     return Encode(data);
   }
 
+  static constexpr char sEncodingTable[] = {
+    'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H',
+    'I', 'J', 'K', 'L', 'M', 'N', 'O', 'P',
+    'Q', 'R', 'S', 'T', 'U', 'V', 'W', 'X',
+    'Y', 'Z', 'a', 'b', 'c', 'd', 'e', 'f',
+    'g', 'h', 'i', 'j', 'k', 'l', 'm', 'n',
+    'o', 'p', 'q', 'r', 's', 't', 'u', 'v',
+    'w', 'x', 'y', 'z', '0', '1', '2', '3',
+    '4', '5', '6', '7', '8', '9', '+', '/'
+  };
+
   std::string Encode(const std::vector<uint8_t> & data) {
-    static constexpr char sEncodingTable[] = {
-      'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H',
-      'I', 'J', 'K', 'L', 'M', 'N', 'O', 'P',
-      'Q', 'R', 'S', 'T', 'U', 'V', 'W', 'X',
-      'Y', 'Z', 'a', 'b', 'c', 'd', 'e', 'f',
-      'g', 'h', 'i', 'j', 'k', 'l', 'm', 'n',
-      'o', 'p', 'q', 'r', 's', 't', 'u', 'v',
-      'w', 'x', 'y', 'z', '0', '1', '2', '3',
-      '4', '5', '6', '7', '8', '9', '+', '/'
-    };
-
-    size_t in_len = data.size();
-    size_t out_len = 4 * ((in_len + 2) / 3);
-    std::string ret(out_len, '\0');
-    size_t i;
-    char *p = const_cast<char*>(ret.c_str());
-
-    for (i = 0; i < in_len - 2; i += 3) {
+    std::string ret(EncodedSize(data.size()), '\0');
+    Encode(data.data(), data.size(), &ret[0]);
+    return ret;
+  }
+
+  std::size_t EncodedSize(std::size_t size) {
+    return 4 * ((size + 2) / 3);
+  }
+
+  void Encode(const uint8_t * data, std::size_t in_len, char * p) {
+    size_t i = 0;
+    for (; i + 2 < in_len; i += 3) {
       *p++ = sEncodingTable[(data[i] >> 2) & 0x3F];
       *p++ = sEncodingTable[((data[i] & 0x3) << 4) | ((int) (data[i + 1] & 0xF0) >> 4)];
       *p++ = sEncodingTable[((data[i + 1] & 0xF) << 2) | ((int) (data[i + 2] & 0xC0) >> 6)];
@@ -47,29 +71,9 @@ namespace Base64 {
       }
       *p++ = '=';
     }
-
-    return ret;
   }
 
   std::vector<uint8_t> Decode(const std::string & input) {
-    constexpr unsigned char kDecodingTable[] = {
-      64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
-      64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
-      64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 62, 64, 64, 64, 63,
-      52, 53, 54, 55, 56, 57, 58, 59, 60, 61, 64, 64, 64, 64, 64, 64,
-      64,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14,
-      15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 64, 64, 64, 64, 64,
-      64, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
-      41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, 64, 64, 64, 64, 64,
-      64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
-      64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
-      64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
-      64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
-      64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
-      64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
-      64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
-      64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64
-    };
 
     size_t in_len = input.size();
     if (in_len % 4 != 0) {
@@ -119,4 +123,45 @@ namespace Base64 {
 
   }
 
-};
\ No newline at end of file
+  std::size_t DecodedSize(const char * begin, const char * end) {
+    std::size_t in_len = std::size_t(end - begin);
+    std::size_t out_len = in_len / 4 * 3;
+    if (in_len >= 1 && end[-1] == '=') out_len--;
+    if (in_len >= 2 && end[-2] == '=') out_len--;
+    return out_len;
+  }
+
+  bool Decode(const char * begin, const char * end, uint8_t * output) {
+    std::size_t in_len = std::size_t(end - begin);
+    if (in_len % 4 != 0) return false;
+    if (in_len == 0) return true;
+
+    // every group of 4 characters but the last one is 3 whole bytes
+    const unsigned char * in = reinterpret_cast< const unsigned char * >(begin);
+    std::size_t groups = in_len / 4 - 1;
+    uint32_t invalid = 0;
+    for (std::size_t g = 0; g < groups; g++, in += 4, output += 3) {
+      uint32_t a = kDecodingTable[in[0]], b = kDecodingTable[in[1]];
+      uint32_t c = kDecodingTable[in[2]], d = kDecodingTable[in[3]];
+      invalid |= a | b | c | d;
+      uint32_t triple = (a << 18) | (b << 12) | (c << 6) | d;
+      output[0] = uint8_t(triple >> 16);
+      output[1] = uint8_t(triple >> 8);
+      output[2] = uint8_t(triple);
+    }
+    if (invalid & 64) return false;
+
+    // and the last one may be padded
+    int padding = (in[3] == '=') + (in[2] == '=' && in[3] == '=');
+    uint32_t a = kDecodingTable[in[0]], b = kDecodingTable[in[1]];
+    uint32_t c = padding < 2 ? kDecodingTable[in[2]] : 0;
+    uint32_t d = padding < 1 ? kDecodingTable[in[3]] : 0;
+    if ((a | b | c | d) & 64) return false;
+    uint32_t triple = (a << 18) | (b << 12) | (c << 6) | d;
+    output[0] = uint8_t(triple >> 16);
+    if (padding < 2) output[1] = uint8_t(triple >> 8);
+    if (padding < 1) output[2] = uint8_t(triple);
+    return true;
+  }
+
+};
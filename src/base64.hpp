@@ -2,10 +2,26 @@
 
 #include <vector>
 #include <string>
+#include <cstdint>
+#include <cstddef>
 
 namespace Base64 {
   std::string Encode(const uint32_t & data);
   std::string Encode(const std::vector<uint8_t> & data);
+
+  // the (padded) encoding of `size` bytes, which is 4 * ((size + 2) / 3) characters
+  std::size_t EncodedSize(std::size_t size);
+
+  // encode `size` bytes of `data` into `output`, which must have room for EncodedSize(size) characters
+  void Encode(const uint8_t * data, std::size_t size, char * output);
+
   std::vector<uint8_t> Decode(const std::string & input);
   std::vector<uint8_t> Decode(const std::vector < std::string > & inputs);
+
+  // the number of bytes encoded by the (padded) text [begin, end)
+  std::size_t DecodedSize(const char * begin, const char * end);
+
+  // decode the (padded) text [begin, end) into `output`, which must have room for
+  // DecodedSize(begin, end) bytes. Returns false if the text isn't valid base64.
+  bool Decode(const char * begin, const char * end, uint8_t * output);
 };
\ No newline at end of file
@@ -0,0 +1,301 @@
+#include "boundary.hpp"
+
+#include "util.hpp"
+#include "parallel.hpp"
+
+#include <atomic>
+#include <limits>
+#include <algorithm>
+
+using io::Element;
+
+// the faces of each kind of volume element, with their corners in counterclockwise 
+// order (seen from outside the element), followed by their edge and center nodes
+struct Face {
+  int num_corners;
+  int nodes[9];
+};
+
+static constexpr Face tet_faces[] = {
+  {3, {0, 2, 1, 6, 5, 4}},
+  {3, {0, 1, 3, 4, 9, 7}},
+  {3, {0, 3, 2, 7, 8, 6}},
+  {3, {1, 2, 3, 5, 8, 9}}
+};
+
+static constexpr Face pyr_faces[] = {
+  {4, {0, 3, 2, 1, 6, 10, 8, 5, 13}},
+  {3, {0, 1, 4, 5, 9, 7}},
+  {3, {1, 2, 4, 8, 11, 9}},
+  {3, {2, 3, 4, 10, 12, 11}},
+  {3, {3, 0, 4, 6, 7, 12}}
+};
+
+static constexpr Face prism_faces[] = {
+  {3, {0, 2, 1, 7, 9, 6}},
+  {3, {3, 4, 5, 12, 14, 13}},
+  {4, {0, 1, 4, 3, 6, 10, 12, 8, 15}},
+  {4, {0, 3, 5, 2, 8, 13, 11, 7, 16}},
+  {4, {1, 2, 5, 4, 9, 11, 14, 10, 17}}
+};
+
+static constexpr Face hex_faces[] = {
+  {4, {0, 3, 2, 1, 9, 13, 11, 8, 20}},
+  {4, {0, 1, 5, 4, 8, 12, 16, 10, 21}},
+  {4, {0, 4, 7, 3, 10, 17, 15, 9, 22}},
+  {4, {1, 2, 6, 5, 11, 14, 18, 12, 23}},
+  {4, {2, 3, 7, 6, 13, 15, 19, 14, 24}},
+  {4, {4, 5, 6, 7, 16, 18, 19, 17, 25}}
+};
+
+struct FaceList {
+  int count;
+  const Face * faces;
+};
+
+static FaceList faces_of(Element::Type type) {
+  switch (type) {
+    case Element::Type::Tet4:
+    case Element::Type::Tet10:   return {4, tet_faces};
+    case Element::Type::Pyr5:
+    case Element::Type::Pyr13:
+    case Element::Type::Pyr14:   return {5, pyr_faces};
+    case Element::Type::Prism6:
+    case Element::Type::Prism15:
+    case Element::Type::Prism18: return {5, prism_faces};
+    case Element::Type::Hex8:
+    case Element::Type::Hex20:
+    case Element::Type::Hex27:   return {6, hex_faces};
+    default:                     return {0, nullptr};
+  }
+}
+
+// the type of surface element for a face of a volume element, whose 
+// nodes are the first nodes_per_elem(face type) entries of Face::nodes
+static Element::Type face_type(Element::Type type, int num_corners) {
+  bool tri = (num_corners == 3);
+  switch (type) {
+    case Element::Type::Tet4:
+    case Element::Type::Pyr5:
+    case Element::Type::Prism6:
+    case Element::Type::Hex8:    return tri ? Element::Type::Tri3 : Element::Type::Quad4;
+    case Element::Type::Tet10:   return Element::Type::Tri6;
+    case Element::Type::Pyr13:
+    case Element::Type::Prism15: return tri ? Element::Type::Tri6 : Element::Type::Quad8;
+    case Element::Type::Pyr14:
+    case Element::Type::Prism18: return tri ? Element::Type::Tri6 : Element::Type::Quad9;
+    case Element::Type::Hex20:   return Element::Type::Quad8;
+    case Element::Type::Hex27:   return Element::Type::Quad9;
+    default:                     return Element::Type::Unsupported;
+  }
+}
+
+// faces are identified by their sorted corners, where 
+// triangles have a 4th "corner" of -1 (so, first)
+template < typename index_t >
+struct FaceKey {
+  index_t corners[4];
+
+  bool operator==(const FaceKey & other) const { return std::equal(corners, corners + 4, other.corners); }
+  bool operator<(const FaceKey & other) const { return std::lexicographical_compare(corners, corners + 4, other.corners, other.corners + 4); }
+};
+
+// the faces of an element are numbered 0, 1, ..., and a surface 
+// element (when skip_surfaces = true) is treated as its own face number 7
+static constexpr int surface_face = 7;
+
+static Face corners_of(Element::Type type, int face) {
+  if (face != surface_face) return faces_of(type).faces[face];
+  bool tri = (type == Element::Type::Tri3 || type == Element::Type::Tri6);
+  return Face{tri ? 3 : 4, {0, 1, 2, 3}};
+}
+
+template < typename index_t, typename element_t >
+static FaceKey< index_t > face_key(const element_t & e, int face) {
+  Face f = corners_of(e.type, face);
+  const int * corners = f.nodes;
+  int num_corners = f.num_corners;
+
+  FaceKey< index_t > key{{-1, -1, -1, -1}};
+  for (int i = 0; i < num_corners; i++) key.corners[4 - num_corners + i] = index_t(e.node_ids[corners[i]]);
+  std::sort(key.corners, key.corners + 4);
+  return key;
+}
+
+template < typename element_t >
+static int64_t smallest_node(const element_t & e, int face) {
+  Face f = corners_of(e.type, face);
+  int64_t node = int64_t(e.node_ids[f.nodes[0]]);
+  for (int i = 1; i < f.num_corners; i++) node = std::min(node, int64_t(e.node_ids[f.nodes[i]]));
+  return node;
+}
+
+// Two faces can only match if they have the same smallest node, so the
+// faces are bucketed by their smallest nodes (with a counting sort) and only
+// compared to the others in their bucket. Since neighboring elements usually
+// have nearby node ids, the buckets are filled and read with good locality,
+// and the only per-face memory is one 8-byte entry: element * 8 + face.
+template < typename mesh_t >
+io::FlatMesh< index_type_t< mesh_t > > boundary_faces(const mesh_t & mesh, bool skip_surfaces) {
+  using index_t = index_type_t< mesh_t >;
+
+  io::FlatMesh< index_t > output;
+
+  int64_t n = int64_t(num_elements(mesh));
+  int64_t num_nodes = int64_t(mesh.nodes.size());
+
+  // calls f(face) for every face of e that takes part in the matching
+  auto for_each_face = [&](const auto & e, auto && f) {
+    FaceList list = faces_of(e.type);
+    for (int j = 0; j < list.count; j++) f(j);
+    if (skip_surfaces && element_dimension(e.type) == 2) f(surface_face);
+  };
+
+  bool has_volumes = false;
+  for_each_element(mesh, [&](auto e) { has_volumes = has_volumes || element_dimension(e.type) == 3; });
+  if (!has_volumes) return output;
+
+  std::vector< std::atomic< int64_t > > cursor(num_nodes + 1);
+  parallel_for(n, [&](int64_t i) {
+    auto e = element(mesh, std::size_t(i));
+    for_each_face(e, [&](int j) {
+      cursor[smallest_node(e, j)].fetch_add(1, std::memory_order_relaxed);
+    });
+  });
+
+  std::vector< int64_t > start(num_nodes + 1);
+  start[0] = 0;
+  for (int64_t v = 0; v < num_nodes; v++) {
+    start[v + 1] = start[v] + cursor[v].load(std::memory_order_relaxed);
+    cursor[v].store(start[v], std::memory_order_relaxed);
+  }
+
+  // the order within a bucket depends on the thread timing, but 
+  // whether or not a face has a match doesn't
+  std::vector< uint64_t > entries(std::size_t(start[num_nodes]));
+  parallel_for(n, [&](int64_t i) {
+    auto e = element(mesh, std::size_t(i));
+    for_each_face(e, [&](int j) {
+      int64_t slot = cursor[smallest_node(e, j)].fetch_add(1, std::memory_order_relaxed);
+      entries[std::size_t(slot)] = uint64_t(i) * 8 + uint64_t(j);
+    });
+  });
+  std::vector< std::atomic< int64_t > >().swap(cursor);
+
+  // a volume face is on the boundary if no other face in its bucket 
+  // has the same corners, and bit j of on_boundary[i] is set if face j 
+  // of element i is. Different faces of an element can be in 
+  // different buckets, so the bits are set atomically.
+  std::vector< std::atomic< uint8_t > > on_boundary(n);
+  int64_t num_blocks = std::max< int64_t >(1, std::min< int64_t >(io::get_num_threads(), num_nodes >> 14));
+  parallel_for(num_blocks, [&](int64_t b) {
+    std::vector< std::pair< FaceKey< index_t >, uint64_t > > bucket;
+    for (int64_t v = (num_nodes * b) / num_blocks; v < (num_nodes * (b + 1)) / num_blocks; v++) {
+      bucket.clear();
+      for (int64_t k = start[v]; k < start[v + 1]; k++) {
+        uint64_t entry = entries[std::size_t(k)];
+        bucket.push_back({face_key< index_t >(element(mesh, std::size_t(entry / 8)), int(entry % 8)), entry});
+      }
+      std::sort(bucket.begin(), bucket.end());
+
+      for (std::size_t k = 0; k < bucket.size(); ) {
+        std::size_t next = k + 1;
+        while (next < bucket.size() && bucket[next].first == bucket[k].first) next++;
+        uint64_t entry = bucket[k].second;
+        if (next == k + 1 && entry % 8 != surface_face) {
+          on_boundary[entry / 8].fetch_or(uint8_t(1u << (entry % 8)), std::memory_order_relaxed);
+        }
+        k = next;
+      }
+    }
+  });
+  std::vector< uint64_t >().swap(entries);
+
+  // the boundary faces, node ids and tags that each block of elements contributes
+  num_blocks = std::max< int64_t >(1, std::min< int64_t >(io::get_num_threads(), n >> 14));
+  auto block_begin = [&](int64_t b) { return (n * b) / num_blocks; };
+
+  struct Counts { int64_t faces, ids, tags; };
+  std::vector< Counts > counts(num_blocks + 1, Counts{0, 0, 0});
+  parallel_for(num_blocks, [&](int64_t b) {
+    for (int64_t i = block_begin(b); i < block_begin(b + 1); i++) {
+      uint8_t mask = on_boundary[i].load(std::memory_order_relaxed);
+      if (mask == 0) continue;
+      auto e = element(mesh, std::size_t(i));
+      FaceList list = faces_of(e.type);
+      for (int j = 0; j < list.count; j++) {
+        if (!(mask & (1u << j))) continue;
+        counts[b + 1].faces++;
+        counts[b + 1].ids += io::nodes_per_elem(face_type(e.type, list.faces[j].num_corners));
+        counts[b + 1].tags += e.num_tags;
+      }
+    }
+  });
+  for (int64_t b = 0; b < num_blocks; b++) {
+    counts[b + 1].faces += counts[b].faces;
+    counts[b + 1].ids += counts[b].ids;
+    counts[b + 1].tags += counts[b].tags;
+  }
+
+  if (uint64_t(counts[num_blocks].ids) > uint64_t(std::numeric_limits< index_t >::max())) {
+    exit_with_error("boundary_faces: too many node ids for 32-bit offsets, use FlatMesh< int64_t >");
+  }
+
+  output.types.resize(counts[num_blocks].faces);
+  output.offsets.resize(counts[num_blocks].faces + 1);
+  output.tag_offsets.resize(counts[num_blocks].faces + 1);
+  output.connectivity.resize(counts[num_blocks].ids);
+  output.tags.resize(counts[num_blocks].tags);
+  parallel_for(num_blocks, [&](int64_t b) {
+    Counts next = counts[b];
+    for (int64_t i = block_begin(b); i < block_begin(b + 1); i++) {
+      uint8_t mask = on_boundary[i].load(std::memory_order_relaxed);
+      if (mask == 0) continue;
+      auto e = element(mesh, std::size_t(i));
+      FaceList list = faces_of(e.type);
+      for (int j = 0; j < list.count; j++) {
+        if (!(mask & (1u << j))) continue;
+        Element::Type type = face_type(e.type, list.faces[j].num_corners);
+        output.types[next.faces] = type;
+        output.offsets[next.faces] = index_t(next.ids);
+        output.tag_offsets[next.faces] = index_t(next.tags);
+        for (int k = 0; k < io::nodes_per_elem(type); k++) {
+          output.connectivity[next.ids++] = index_t(e.node_ids[list.faces[j].nodes[k]]);
+        }
+        for (int k = 0; k < e.num_tags; k++) {
+          output.tags[next.tags++] = e.tags[k];
+        }
+        next.faces++;
+      }
+    }
+  });
+  output.offsets.back() = index_t(counts[num_blocks].ids);
+  output.tag_offsets.back() = index_t(counts[num_blocks].tags);
+  output.rebuild_blocks();
+
+  return output;
+}
+
+template io::FlatMesh< int > boundary_faces(const io::Mesh &, bool);
+template io::FlatMesh< int32_t > boundary_faces(const io::FlatMesh< int32_t > &, bool);
+template io::FlatMesh< int64_t > boundary_faces(const io::FlatMesh< int64_t > &, bool);
+
+namespace io {
+
+template < typename mesh_t >
+mesh_t extract_boundary(const mesh_t & mesh) {
+  auto faces = boundary_faces(mesh, false);
+  faces.nodes = mesh.nodes;
+  faces.original_node_ids = mesh.original_node_ids;
+  if constexpr (std::is_same_v< mesh_t, Mesh >) {
+    return unflatten(faces);
+  } else {
+    return faces;
+  }
+}
+
+template Mesh extract_boundary(const Mesh &);
+template FlatMesh< int32_t > extract_boundary(const FlatMesh< int32_t > &);
+template FlatMesh< int64_t > extract_boundary(const FlatMesh< int64_t > &);
+
+}
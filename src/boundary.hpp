@@ -0,0 +1,16 @@
+#pragma once
+
+#include "mesh/io.hpp"
+#include "mesh_view.hpp"
+
+// the faces of the volume elements of `mesh` that no other volume element 
+// shares (matched by their corner nodes), as surface elements oriented so that 
+// their normals point out of the elements they came from, in order of those 
+// elements. Each face gets the tags of its element, and its node ids refer to 
+// the same nodes as the mesh's, so the returned mesh has no nodes of its own.
+//
+// With skip_surfaces = true, faces that match one of the surface elements
+// of the mesh are left out too, e.g. so that a mesh with both volume elements 
+// and the surface elements on their boundary can be exported without duplicates.
+template < typename mesh_t >
+io::FlatMesh< index_type_t< mesh_t > > boundary_faces(const mesh_t & mesh, bool skip_surfaces);
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <string>
+#include <cstdlib>
+#include <cstring>
+#include <charconv>
+#include <string_view>
+
+// cursor over an in-memory file (e.g. a MappedFile), for reading the
+// whitespace-delimited text parts of a file without going through std::ifstream
+//
+// numbers are parsed with std::from_chars (no locale, no stream state), 
+// and any token that fails to parse clears `ok` rather than exiting, 
+// so callers can check it once after a whole section
+struct BufferReader {
+  const char * ptr;
+  const char * end;
+  bool ok = true;
+
+  static bool is_space(char c) { return c == ' ' || c == '\n' || c == '\r' || c == '\t'; }
+
+  bool done() const { return ptr >= end; }
+  std::size_t remaining() const { return std::size_t(end - ptr); }
+
+  void skip_whitespace() {
+    while (ptr < end && is_space(*ptr)) ptr++;
+  }
+
+  // the next whitespace-delimited token
+  std::string_view word() {
+    skip_whitespace();
+    const char * start = ptr;
+    while (ptr < end && !is_space(*ptr)) ptr++;
+    return std::string_view(start, std::size_t(ptr - start));
+  }
+
+  // the rest of the current line (without the line ending),
+  // leaving ptr at the start of the next line
+  std::string_view line() {
+    const char * start = ptr;
+    const char * newline = static_cast< const char * >(std::memchr(ptr, '\n', remaining()));
+    ptr = newline ? newline + 1 : end;
+    const char * stop = newline ? newline : end;
+    if (stop > start && stop[-1] == '\r') stop--;
+    return std::string_view(start, std::size_t(stop - start));
+  }
+
+  template < typename T >
+  T integer() {
+    skip_whitespace();
+    if (ptr < end && *ptr == '+') ptr++;
+    T value{};
+    auto [next, error] = std::from_chars(ptr, end, value);
+    if (error != std::errc()) { value = T{}; ok = false; }
+    ptr = next;
+    return value;
+  }
+
+  template < typename T >
+  T real() {
+    skip_whitespace();
+    if (ptr < end && *ptr == '+') ptr++;
+    T value{};
+#if defined(__cpp_lib_to_chars)
+    auto [next, error] = std::from_chars(ptr, end, value);
+    if (error != std::errc()) { value = T{}; ok = false; }
+    ptr = next;
+#else
+    // some standard libraries don't implement from_chars for floating point
+    // yet, so copy the token out (the buffer isn't null-terminated) for strtod
+    char token[128];
+    std::string_view w = word();
+    if (w.empty() || w.size() >= sizeof(token)) { ok = false; return value; }
+    std::memcpy(token, w.data(), w.size());
+    token[w.size()] = '\0';
+    char * stop;
+    value = T(std::strtod(token, &stop));
+    if (stop != token + w.size()) { value = T{}; ok = false; }
+#endif
+    return value;
+  }
+
+  // skip the rest of the current line
+  void next_line() {
+    const char * newline = static_cast< const char * >(std::memchr(ptr, '\n', remaining()));
+    ptr = newline ? newline + 1 : end;
+  }
+};
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "parallel.hpp"
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <fstream>
+#include <cstring>
+#include <charconv>
+#include <string_view>
+
+// growable in-memory output buffer, so that pieces of a file can be 
+// encoded independently (e.g. on different threads) and then written 
+// out in order, without going through std::ofstream's formatting
+//
+// numbers are formatted with std::to_chars, and reals are written with
+// the shortest representation that reads back to exactly the same value
+struct BufferWriter {
+  std::string data;
+
+  void clear() { data.clear(); }
+  std::size_t size() const { return data.size(); }
+
+  void text(std::string_view str) { data.append(str); }
+  void character(char c) { data.push_back(c); }
+
+  template < typename T >
+  void integer(T value) {
+    char buffer[24];
+    auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    data.append(buffer, result.ptr);
+  }
+
+  void real(double value) {
+    char buffer[32];
+#if defined(__cpp_lib_to_chars)
+    auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    data.append(buffer, result.ptr);
+#else
+    int n = std::snprintf(buffer, sizeof(buffer), "%.17g", value);
+    data.append(buffer, std::size_t(n));
+#endif
+  }
+
+  void real(float value) {
+    char buffer[32];
+#if defined(__cpp_lib_to_chars)
+    auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    data.append(buffer, result.ptr);
+#else
+    int n = std::snprintf(buffer, sizeof(buffer), "%.9g", double(value));
+    data.append(buffer, std::size_t(n));
+#endif
+  }
+
+  // the bytes of `n` values, as they are laid out in memory
+  template < typename T >
+  void raw(const T * values, std::size_t n) {
+    data.append(reinterpret_cast< const char * >(values), sizeof(T) * n);
+  }
+
+  template < typename T >
+  void raw(const T & value) { raw(&value, 1); }
+};
+
+// encode items [0, n) into separate buffers in parallel, and write them to the
+// file in order. Only a few items per thread are held in memory at a time.
+template < typename callable >
+void write_in_parallel(std::ofstream & outfile, int64_t n, callable && encode) {
+  int64_t batch_size = 2 * io::get_num_threads();
+  std::vector< BufferWriter > buffers(std::min(batch_size, n));
+  for (int64_t first = 0; first < n; first += batch_size) {
+    int64_t count = std::min(batch_size, n - first);
+    parallel_for(count, [&](int64_t i) {
+      buffers[i].clear();
+      encode(first + i, buffers[i]);
+    });
+    for (int64_t i = 0; i < count; i++) {
+      outfile.write(buffers[i].data.data(), std::streamsize(buffers[i].size()));
+    }
+  }
+}
@@ -0,0 +1,84 @@
+#include "byte_order.hpp"
+
+#include "util.hpp"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define MESH_X86_SIMD
+#include <immintrin.h>
+#endif
+
+template < typename T >
+static void swap_scalar(char * dst, const char * src, std::size_t count) {
+  for (std::size_t i = 0; i < count; i++) {
+    T value;
+    std::memcpy(&value, src + sizeof(T) * i, sizeof(T));
+    value = byte_swap(value);
+    std::memcpy(dst + sizeof(T) * i, &value, sizeof(T));
+  }
+}
+
+#ifdef MESH_X86_SIMD
+
+// the pshufb control that reverses every `width`-byte lane of a 16-byte register
+template < int width >
+static __m128i reverse_lanes_mask() {
+  alignas(16) char mask[16];
+  for (int i = 0; i < 16; i++) {
+    mask[i] = char((i / width) * width + (width - 1 - i % width));
+  }
+  return _mm_load_si128(reinterpret_cast< const __m128i * >(mask));
+}
+
+template < typename T >
+__attribute__((target("ssse3")))
+static void swap_ssse3(char * dst, const char * src, std::size_t count) {
+  const __m128i mask = reverse_lanes_mask< sizeof(T) >();
+  std::size_t bytes = sizeof(T) * count;
+  std::size_t i = 0;
+  for (; i + 16 <= bytes; i += 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast< const __m128i * >(src + i));
+    _mm_storeu_si128(reinterpret_cast< __m128i * >(dst + i), _mm_shuffle_epi8(v, mask));
+  }
+  swap_scalar< T >(dst + i, src + i, (bytes - i) / sizeof(T));
+}
+
+template < typename T >
+__attribute__((target("avx2")))
+static void swap_avx2(char * dst, const char * src, std::size_t count) {
+  // vpshufb shuffles within each 128-bit half, so both halves use the same mask
+  const __m256i mask = _mm256_broadcastsi128_si256(reverse_lanes_mask< sizeof(T) >());
+  std::size_t bytes = sizeof(T) * count;
+  std::size_t i = 0;
+  for (; i + 64 <= bytes; i += 64) {
+    __m256i v0 = _mm256_loadu_si256(reinterpret_cast< const __m256i * >(src + i));
+    __m256i v1 = _mm256_loadu_si256(reinterpret_cast< const __m256i * >(src + i + 32));
+    _mm256_storeu_si256(reinterpret_cast< __m256i * >(dst + i), _mm256_shuffle_epi8(v0, mask));
+    _mm256_storeu_si256(reinterpret_cast< __m256i * >(dst + i + 32), _mm256_shuffle_epi8(v1, mask));
+  }
+  swap_ssse3< T >(dst + i, src + i, (bytes - i) / sizeof(T));
+}
+
+#endif
+
+template < typename T >
+static void swap_array(char * dst, const char * src, std::size_t count) {
+#ifdef MESH_X86_SIMD
+  static const bool has_avx2 = __builtin_cpu_supports("avx2");
+  static const bool has_ssse3 = __builtin_cpu_supports("ssse3");
+  if (has_avx2) return swap_avx2< T >(dst, src, count);
+  if (has_ssse3) return swap_ssse3< T >(dst, src, count);
+#endif
+  swap_scalar< T >(dst, src, count);
+}
+
+void byte_swap(void * dst, const void * src, std::size_t count, std::size_t value_bytes) {
+  char * d = static_cast< char * >(dst);
+  const char * s = static_cast< const char * >(src);
+  switch (value_bytes) {
+    case 1: if (d != s) std::memcpy(d, s, count); break;
+    case 2: swap_array< uint16_t >(d, s, count); break;
+    case 4: swap_array< uint32_t >(d, s, count); break;
+    case 8: swap_array< uint64_t >(d, s, count); break;
+    default: exit_with_error("byte_swap: unsupported value size " + std::to_string(value_bytes));
+  }
+}
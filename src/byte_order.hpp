@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#include <algorithm>
+
+static const bool is_big_endian = [](){
+  uint32_t one = 1;
+  uint8_t first_byte;
+  std::memcpy(&first_byte, &one, 1);
+  return first_byte == 0;
+}();
+
+// reverse the bytes of a single value
+template <typename T>
+T byte_swap(T value) {
+#if defined(__GNUC__)
+  if constexpr (sizeof(T) == 2 || sizeof(T) == 4 || sizeof(T) == 8) {
+    if constexpr (sizeof(T) == 2) {
+      uint16_t bits;
+      std::memcpy(&bits, &value, 2);
+      bits = __builtin_bswap16(bits);
+      std::memcpy(&value, &bits, 2);
+    } else if constexpr (sizeof(T) == 4) {
+      uint32_t bits;
+      std::memcpy(&bits, &value, 4);
+      bits = __builtin_bswap32(bits);
+      std::memcpy(&value, &bits, 4);
+    } else {
+      uint64_t bits;
+      std::memcpy(&bits, &value, 8);
+      bits = __builtin_bswap64(bits);
+      std::memcpy(&value, &bits, 8);
+    }
+    return value;
+  }
+#endif
+  auto it = reinterpret_cast<uint8_t*>(&value);
+  std::reverse(it, it + sizeof(T));
+  return value;
+}
+
+template <typename T>
+T to_big_endian(T value) {
+  return is_big_endian ? value : byte_swap(value);
+}
+
+template <typename T>
+T from_big_endian(T value) { return to_big_endian(value); }
+
+// reverse the bytes of each of the `count` values of `value_bytes` bytes
+// (2, 4 or 8) in `src`, writing the results to `dst`.
+//
+// This is for whole arrays (e.g. every point of a mesh), so it uses
+// SSSE3 or AVX2 byte shuffles when the CPU supports them, and otherwise
+// bswap instructions. dst may be the same as src, but they can't
+// overlap otherwise, and neither one has to be aligned.
+void byte_swap(void * dst, const void * src, std::size_t count, std::size_t value_bytes);
+
+template < typename T >
+void byte_swap(T * values, std::size_t count) {
+  byte_swap(values, values, count, sizeof(T));
+}
+
+// copy `count` values to `dst`, in big-endian byte order
+template < typename T >
+void copy_to_big_endian(const T * values, std::size_t count, void * dst) {
+  if (is_big_endian) {
+    std::memcpy(dst, values, sizeof(T) * count);
+  } else {
+    byte_swap(dst, values, count, sizeof(T));
+  }
+}
+
+// copy `count` values to `dst`, in little-endian byte order
+template < typename T >
+void copy_to_little_endian(const T * values, std::size_t count, void * dst) {
+  if (is_big_endian) {
+    byte_swap(dst, values, count, sizeof(T));
+  } else {
+    std::memcpy(dst, values, sizeof(T) * count);
+  }
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "mesh/io.hpp"
+#include "util.hpp"
+
+#include <string>
+#include <variant>
+
+// the number of values in a field
+inline std::size_t num_values(const io::Field & field) {
+  return std::visit([](const auto & values) { return values.size(); }, field.values);
+}
+
+// the exporters check the fields before writing anything, so that
+// an invalid field doesn't leave a partially written file behind
+inline void check_fields(const io::Fields & fields, std::size_t num_nodes, std::size_t num_elements) {
+  auto check = [](const std::vector< io::Field > & list, std::size_t count, std::string what) {
+    for (auto & field : list) {
+      if (field.name.empty() || field.name.find_first_of(" \t\r\n\"<>&") != std::string::npos) {
+        exit_with_error("invalid field name: \"" + field.name + "\"");
+      }
+      if (field.num_components < 1) {
+        exit_with_error("field " + field.name + " must have at least 1 component");
+      }
+      if (num_values(field) != count * std::size_t(field.num_components)) {
+        exit_with_error("field " + field.name + " must have " + std::to_string(field.num_components) +
+                        " values per " + what + " (" + std::to_string(count) + " " + what + "s)");
+      }
+    }
+  };
+  check(fields.nodes, num_nodes, "node");
+  check(fields.elements, num_elements, "element");
+}
@@ -0,0 +1,138 @@
+#include "mesh/io.hpp"
+
+namespace io {
+
+// append a single element to the end of `to`, extending its last block if possible
+template < typename index_t, typename element_t >
+static void append_element(FlatMesh< index_t > & to, Element::Type type, const element_t * node_ids, std::size_t num_nodes, const int * tags, std::size_t num_tags) {
+  to.types.push_back(type);
+  to.connectivity.insert(to.connectivity.end(), node_ids, node_ids + num_nodes);
+  to.offsets.push_back(index_t(to.connectivity.size()));
+  to.tags.insert(to.tags.end(), tags, tags + num_tags);
+  to.tag_offsets.push_back(index_t(to.tags.size()));
+
+  if (to.blocks.empty() || to.blocks.back().type != type) {
+    to.blocks.push_back({type, index_t(to.types.size()) - 1, 0});
+  }
+  to.blocks.back().count++;
+}
+
+template < typename index_t >
+void FlatMesh< index_t >::push_back(Element::Type type, const std::vector< index_t > & node_ids, const std::vector< int > & elem_tags) {
+  append_element(*this, type, node_ids.data(), node_ids.size(), elem_tags.data(), elem_tags.size());
+}
+
+template < typename index_t >
+void FlatMesh< index_t >::rebuild_blocks() {
+  blocks.clear();
+  for (std::size_t i = 0; i < types.size(); i++) {
+    if (blocks.empty() || blocks.back().type != types[i]) {
+      blocks.push_back({types[i], index_t(i), 0});
+    }
+    blocks.back().count++;
+  }
+}
+
+template < typename index_t >
+FlatMesh< index_t > flatten(const Mesh & mesh) {
+
+  FlatMesh< index_t > flat;
+  flat.nodes = mesh.nodes;
+  flat.original_node_ids = mesh.original_node_ids;
+  flat.original_element_ids = mesh.original_element_ids;
+
+  std::size_t num_elements = mesh.elements.size();
+  std::size_t num_ids = 0;
+  std::size_t num_tags = 0;
+  for (auto & elem : mesh.elements) {
+    num_ids += elem.node_ids.size();
+    num_tags += elem.tags.size();
+  }
+
+  flat.types.reserve(num_elements);
+  flat.offsets.reserve(num_elements + 1);
+  flat.connectivity.reserve(num_ids);
+  flat.tag_offsets.reserve(num_elements + 1);
+  flat.tags.reserve(num_tags);
+
+  for (auto & elem : mesh.elements) {
+    append_element(flat, elem.type, elem.node_ids.data(), elem.node_ids.size(), elem.tags.data(), elem.tags.size());
+  }
+
+  return flat;
+
+}
+
+template < typename index_t >
+FlatMesh< index_t > group_by_type(const FlatMesh< index_t > & mesh) {
+
+  constexpr int num_types = int(Element::Type::Hex27) + 1;
+
+  // counting sort on the element type, which preserves
+  // the relative order of elements of the same type
+  std::vector< std::size_t > count(num_types + 1, 0);
+  for (auto type : mesh.types) { count[int(type) + 1]++; }
+  for (int i = 0; i < num_types; i++) { count[i+1] += count[i]; }
+
+  std::vector< std::size_t > order(mesh.num_elements());
+  for (std::size_t i = 0; i < mesh.num_elements(); i++) {
+    order[count[int(mesh.types[i])]++] = i;
+  }
+
+  FlatMesh< index_t > grouped;
+  grouped.nodes = mesh.nodes;
+  grouped.original_node_ids = mesh.original_node_ids;
+  grouped.types.reserve(mesh.num_elements());
+  grouped.offsets.reserve(mesh.num_elements() + 1);
+  grouped.connectivity.reserve(mesh.connectivity.size());
+  grouped.tag_offsets.reserve(mesh.num_elements() + 1);
+  grouped.tags.reserve(mesh.tags.size());
+
+  for (std::size_t i : order) {
+    if (!mesh.original_element_ids.empty()) {
+      grouped.original_element_ids.push_back(mesh.original_element_ids[i]);
+    }
+    append_element(grouped, mesh.types[i],
+                   mesh.connectivity.data() + mesh.offsets[i], mesh.offsets[i+1] - mesh.offsets[i],
+                   mesh.tags.data() + mesh.tag_offsets[i], mesh.tag_offsets[i+1] - mesh.tag_offsets[i]);
+  }
+
+  return grouped;
+
+}
+
+template < typename index_t >
+Mesh unflatten(const FlatMesh< index_t > & flat) {
+
+  Mesh mesh;
+  mesh.nodes = flat.nodes;
+  mesh.original_node_ids = flat.original_node_ids;
+  mesh.original_element_ids = flat.original_element_ids;
+  mesh.elements.resize(flat.num_elements());
+
+  for (std::size_t i = 0; i < flat.num_elements(); i++) {
+    auto & elem = mesh.elements[i];
+    elem.type = flat.types[i];
+    elem.node_ids.assign(flat.connectivity.begin() + flat.offsets[i],
+                         flat.connectivity.begin() + flat.offsets[i+1]);
+    elem.tags.assign(flat.tags.begin() + flat.tag_offsets[i],
+                     flat.tags.begin() + flat.tag_offsets[i+1]);
+  }
+
+  return mesh;
+
+}
+
+template struct FlatMesh< int32_t >;
+template struct FlatMesh< int64_t >;
+
+template FlatMesh< int32_t > flatten(const Mesh &);
+template FlatMesh< int64_t > flatten(const Mesh &);
+
+template FlatMesh< int32_t > group_by_type(const FlatMesh< int32_t > &);
+template FlatMesh< int64_t > group_by_type(const FlatMesh< int64_t > &);
+
+template Mesh unflatten(const FlatMesh< int32_t > &);
+template Mesh unflatten(const FlatMesh< int64_t > &);
+
+}
@@ -1,18 +1,92 @@
 #include "mesh/io.hpp"
 
 #include "util.hpp"
+#include "mesh_view.hpp"
+#include "mapped_file.hpp"
+#include "buffer_reader.hpp"
+#include "buffer_writer.hpp"
+#include "parallel.hpp"
+#include "id_map.hpp"
 #include "node_ordering.hpp"
+#include "fields.hpp"
 
 #include <map>
+#include <numeric>
+#include <algorithm>
+#include <set>
 #include <tuple>
+#include <limits>
+#include <cstring>
 #include <fstream>
 #include <iostream>
-#include <map>
 #include <string>
 
-static bool export_gmsh_v22_binary(const io::Mesh & mesh, std::string filename) {
+// the exporters encode the nodes and elements in ranges of (at most) this many
+// records, each into its own buffer, so that the ranges can be encoded in parallel
+// and written to the file in large pieces. The importers also split large 
+// sections into ranges of this size to decode them in parallel.
+static constexpr int64_t records_per_range = int64_t(1) << 16;
+
+// each field is written as its own $NodeData (or $ElementData) section, for a
+// single time step, where every record is the (1-based) node or element id
+// followed by the field's values for it, as doubles
+static void export_gmsh_v22_fields(std::ofstream & outfile, const std::vector< io::Field > & fields, std::string section, bool binary) {
+  for (auto & field : fields) {
+    int n = field.num_components;
+    int64_t count = int64_t(num_values(field)) / n;
+    outfile << "$" << section << "\n";
+    outfile << "1\n\"" << field.name << "\"\n"; // string tags: the name
+    outfile << "1\n0\n";                           // real tags: the time
+    outfile << "3\n0\n" << n << "\n" << count << "\n"; // integer tags: time step, components, records
+
+    int64_t num_ranges = (count + records_per_range - 1) / records_per_range;
+    std::visit([&](const auto & values) {
+      write_in_parallel(outfile, num_ranges, [&](int64_t r, BufferWriter & buffer) {
+        int64_t first = r * records_per_range;
+        int64_t last = std::min(first + records_per_range, count);
+        if (binary) {
+          std::size_t record_bytes = sizeof(int) + sizeof(double) * std::size_t(n);
+          buffer.data.resize(record_bytes * std::size_t(last - first));
+          char * ptr = buffer.data.data();
+          for (int64_t i = first; i < last; i++) {
+            int id = int(i) + 1;
+            std::memcpy(ptr, &id, sizeof(int));
+            for (int j = 0; j < n; j++) {
+              double value = double(values[i * n + j]);
+              std::memcpy(ptr + sizeof(int) + sizeof(double) * j, &value, sizeof(double));
+            }
+            ptr += record_bytes;
+          }
+        } else {
+          for (int64_t i = first; i < last; i++) {
+            buffer.integer(i + 1);
+            for (int j = 0; j < n; j++) {
+              buffer.character(' ');
+              if constexpr (std::is_floating_point_v< std::decay_t< decltype(values[0]) > >) {
+                buffer.real(values[i * n + j]);
+              } else {
+                buffer.integer(values[i * n + j]);
+              }
+            }
+            buffer.character('\n');
+          }
+        }
+      });
+    }, field.values);
+    if (binary) outfile << "\n";
+    outfile << "$End" << section << "\n";
+  }
+}
 
-  std::ofstream outfile(filename);
+template < typename mesh_t >
+static bool export_gmsh_v22_binary(const mesh_t & mesh, const io::Fields & fields, std::string filename) {
+
+  // the binary v2.2 format stores ids and block sizes as 32-bit ints
+  if (mesh.nodes.size() > std::size_t(INT32_MAX) || num_elements(mesh) > std::size_t(INT32_MAX)) {
+    exit_with_error("too many nodes or elements for a binary gmsh v2.2 file, use ASCII instead");
+  }
+
+  std::ofstream outfile(filename, std::ios::binary);
 
   //////////////////
   // write header //
@@ -29,68 +103,107 @@ static bool export_gmsh_v22_binary(const io::Mesh & mesh, std::string filename)
   /////////////////
   // write nodes //
   /////////////////
+  int64_t num_nodes = int64_t(mesh.nodes.size());
   outfile << "$Nodes\n";
-  outfile << mesh.nodes.size() << std::endl;
-  for (int i = 0; i < mesh.nodes.size(); i++) {
-    int id = i + 1; // gmsh uses 1-based indexing
-    outfile.write((char*)&id, sizeof(int));
-    outfile.write((char*)&mesh.nodes[i], sizeof(double) * 3); 
-  }
+  outfile << num_nodes << std::endl;
+  int64_t num_node_ranges = (num_nodes + records_per_range - 1) / records_per_range;
+  write_in_parallel(outfile, num_node_ranges, [&](int64_t r, BufferWriter & buffer) {
+    int64_t first = r * records_per_range;
+    int64_t last = std::min(first + records_per_range, num_nodes);
+
+    // each record is: int id, double x, double y, double z
+    constexpr std::size_t record_bytes = sizeof(int) + 3 * sizeof(double);
+    buffer.data.resize(record_bytes * std::size_t(last - first));
+    char * ptr = buffer.data.data();
+    for (int64_t i = first; i < last; i++) {
+      int id = int(i) + 1; // gmsh uses 1-based indexing
+      std::memcpy(ptr, &id, sizeof(int));
+      std::memcpy(ptr + sizeof(int), &mesh.nodes[i], 3 * sizeof(double));
+      ptr += record_bytes;
+    }
+  });
   outfile << "\n$EndNodes\n";
 
   /////////////////
   // write elems //
   /////////////////
   outfile << "$Elements\n";
-  outfile << mesh.elements.size() << std::endl;
-
-  // group elements together by type 
-  std::map< io::Element::Type, std::vector< const io::Element * > > element_blocks;
-  for (int i = 0; i < mesh.elements.size(); i++) {
-    const io::Element * e = &mesh.elements[i];
-    element_blocks[e->type].push_back(e);
+  outfile << num_elements(mesh) << std::endl;
+
+  // elements are written in blocks of consecutive elements that share 
+  // the same type and number of tags, so they keep their original order
+  struct Block { io::Element::Type type; int num_tags; int64_t first; int64_t count; };
+  std::vector< Block > blocks;
+  int64_t id = 0;
+  for_each_element(mesh, [&](auto e) {
+    if (blocks.empty() || blocks.back().type != e.type || blocks.back().num_tags != e.num_tags) {
+      blocks.push_back({e.type, e.num_tags, id, 0});
+    }
+    blocks.back().count++;
+    id++;
+  });
+
+  struct Range { std::size_t block; int64_t first; int64_t count; };
+  std::vector< Range > ranges;
+  for (std::size_t b = 0; b < blocks.size(); b++) {
+    for (int64_t first = 0; first < blocks[b].count; first += records_per_range) {
+      ranges.push_back({b, blocks[b].first + first, std::min(records_per_range, blocks[b].count - first)});
+    }
   }
 
-  // then write each block out
-  for (auto & [type, block] : element_blocks) {
-    int etype = gmsh::element_type(type);
-    int block_size = int(block.size());
+  write_in_parallel(outfile, int64_t(ranges.size()), [&](int64_t r, BufferWriter & buffer) {
+    const Block & block = blocks[ranges[r].block];
 
     // gmsh requires two tags: ("physical" and "elementary")
     // if not provided, these will be set to zero.
-    // this assumes all elements in the block have the same
-    // number of tags
-    int num_tags = std::max(int(block[0]->tags.size()), 2);
-
-    outfile.write((char*)&etype, sizeof(int));
-    outfile.write((char*)&block_size, sizeof(int));
-    outfile.write((char*)&num_tags, sizeof(int));
-    int count = 1; // gmsh uses 1-based indexing
-    for (auto * elem : block) {
-      outfile.write((char*)&count, sizeof(int));
-      count++;
+    int num_tags = std::max(block.num_tags, 2);
 
-      for (int i = 0; i < num_tags; i++) {
-        int tag = (i < elem->tags.size()) ? elem->tags[i] : 0;
-        outfile.write((char*)&tag, sizeof(int));
-      }
-
-      // gmsh uses 1-based indexing
-      auto node_ids = elem->node_ids;
-      for (auto & id : node_ids) { id++; }
-      outfile.write((char*)&node_ids[0], sizeof(int) * node_ids.size());
+    // write the header at the start of each block
+    if (ranges[r].first == block.first) {
+      int header[3] = {gmsh::element_type(block.type), int(block.count), num_tags};
+      buffer.raw(header, 3);
     }
-  }
+
+    // each record is: int id, int tags[num_tags], int node_ids[nodes_per_elem]
+    dispatch(block.type, [&](auto T) {
+      constexpr int npe = nodes_per_elem(decltype(T)::value);
+      std::size_t record_size = std::size_t(1 + num_tags + npe);
+      std::size_t offset = buffer.size();
+      buffer.data.resize(offset + sizeof(int) * record_size * std::size_t(ranges[r].count));
+
+      int record[1 + 2 + npe]; // for records that have no more than 2 tags
+      std::vector< int > long_record(record_size > std::size(record) ? record_size : 0);
+      int * values = long_record.empty() ? record : long_record.data();
+
+      char * ptr = buffer.data.data() + offset;
+      for (int64_t i = ranges[r].first; i < ranges[r].first + ranges[r].count; i++) {
+        auto e = element(mesh, std::size_t(i));
+        values[0] = int(i) + 1; // gmsh uses 1-based indexing
+        for (int j = 0; j < num_tags; j++) {
+          values[1 + j] = (j < e.num_tags) ? e.tags[j] : 0;
+        }
+        for (int j = 0; j < npe; j++) {
+          values[1 + num_tags + j] = int(e.node_ids[j]) + 1;
+        }
+        std::memcpy(ptr, values, sizeof(int) * record_size);
+        ptr += sizeof(int) * record_size;
+      }
+    });
+  });
 
   outfile << "\n$EndElements\n";
 
+  export_gmsh_v22_fields(outfile, fields.nodes, "NodeData", true);
+  export_gmsh_v22_fields(outfile, fields.elements, "ElementData", true);
+
   outfile.close();
 
   return false;
 
 }
 
-static bool export_gmsh_v22_ascii(const io::Mesh & mesh, std::string filename) {
+template < typename mesh_t >
+static bool export_gmsh_v22_ascii(const mesh_t & mesh, const io::Fields & fields, std::string filename) {
 
   std::ofstream outfile(filename);
 
@@ -109,7 +222,7 @@ static bool export_gmsh_v22_ascii(const io::Mesh & mesh, std::string filename) {
   /////////////////
   outfile << "$Nodes\n";
   outfile << mesh.nodes.size() << '\n';
-  for (int i = 0; i < mesh.nodes.size(); i++) {
+  for (std::size_t i = 0; i < mesh.nodes.size(); i++) {
     outfile << i+1 << " " << mesh.nodes[i] << '\n';
   }
   outfile << "$EndNodes\n";
@@ -118,224 +231,1782 @@ static bool export_gmsh_v22_ascii(const io::Mesh & mesh, std::string filename) {
   // write elems //
   /////////////////
   outfile << "$Elements\n";
-  outfile << mesh.elements.size() << std::endl;
-  for (int i = 0; i < mesh.elements.size(); i++) {
-    auto [type, ids, tags] = mesh.elements[i];
-    outfile << i+1 << " " << gmsh::element_type(type) << " " << tags.size();
-    for (auto tag : tags) { outfile << " " << tag; }
-    for (auto id : ids) { outfile << " " << id+1; }
+  outfile << num_elements(mesh) << std::endl;
+  std::size_t id = 1; // gmsh uses 1-based indexing
+  for_each_element(mesh, [&](auto e) {
+    outfile << id++ << " " << gmsh::element_type(e.type) << " " << e.num_tags;
+    for (int j = 0; j < e.num_tags; j++) { outfile << " " << e.tags[j]; }
+    for (int j = 0; j < e.num_nodes; j++) { outfile << " " << e.node_ids[j]+1; }
     outfile << '\n';
-  }
+  });
   outfile << "$EndElements\n";
 
+  export_gmsh_v22_fields(outfile, fields.nodes, "NodeData", false);
+  export_gmsh_v22_fields(outfile, fields.elements, "ElementData", false);
+
   outfile.close();
 
   return false;
 
 }
 
-io::Mesh import_gmsh_v22_ascii(std::ifstream & infile) {
+// the ascii $Nodes and $Elements sections have one record per line:
+//
+//   node:      id x y z
+//   element:   id type num_tags tags[num_tags] node_ids[nodes_per_elem]
+//
+// so they are split into line-aligned chunks that are parsed in parallel. 
+// The ids say where each record belongs, so every chunk writes its records 
+// straight into their final slots. Errors are recorded per chunk, and reported
+// once all of the threads are done.
+
+// where the data of the current section ends (the `$End...` line), 
+// numbers never contain a '$', so that is the first one we find
+static const char * section_end(const BufferReader & in) {
+  const char * dollar = static_cast< const char * >(std::memchr(in.ptr, '$', in.remaining()));
+  return dollar ? dollar : in.end;
+}
 
-  io::Mesh mesh;
+// gmsh files are a sequence of sections of the form
+//
+//   $Name
+//   ...
+//   $EndName
+//
+// the importers walk through the section headers, and when a section isn't 
+// needed, jump to its end line instead of reading through it line by line
+
+// the name of the next section (without the '$'), or an empty 
+// string if there are no more, leaving in.ptr at its contents
+static std::string_view next_section(BufferReader & in) {
+  while (true) {
+    in.skip_whitespace();
+    if (in.done()) return {};
+    std::string_view line = in.line();
+    while (!line.empty() && BufferReader::is_space(line.back())) line.remove_suffix(1);
+    if (line.size() > 1 && line[0] == '$') return line.substr(1);
+  }
+}
 
-  ////////////////
-  // read nodes //
-  ////////////////
-  std::string line;
-  infile >> line;
-  if (line != "$Nodes") exit_with_error("invalid file format (nodes)");
+// where the "$End<name>" line of the section starting at `contents` is, 
+// (`contents` must be the start of a line), or nullptr if there isn't one
+static const char * find_section_end(const char * contents, const char * end, std::string_view name) {
+  const char * ptr = contents;
+  while (ptr < end) {
+    const char * dollar = static_cast< const char * >(std::memchr(ptr, '$', std::size_t(end - ptr)));
+    if (dollar == nullptr) return nullptr;
+    std::size_t remaining = std::size_t(end - dollar);
+    if ((dollar == contents || dollar[-1] == '\n') && 
+        remaining >= 4 + name.size() && 
+        std::memcmp(dollar + 1, "End", 3) == 0 && 
+        std::memcmp(dollar + 4, name.data(), name.size()) == 0) {
+      return dollar;
+    }
+    ptr = dollar + 1;
+  }
+  return nullptr;
+}
 
-  int node_id;
-  int num_nodes;
-  infile >> num_nodes;
-  mesh.nodes.resize(num_nodes);
+// move past the end of the section `name`, whose contents start at in.ptr
+static void skip_section(BufferReader & in, std::string_view name) {
+  const char * stop = find_section_end(in.ptr, in.end, name);
+  if (stop == nullptr) exit_with_error("invalid file format (missing $End" + std::string(name) + ")");
+  in.ptr = stop;
+  in.line();
+}
 
-  for (int i = 0; i < num_nodes; i++) {
-    infile >> node_id;
-    mesh.nodes[node_id - 1] = ascii_read_array<double,3>(infile);
+// move to the contents of the next section called `name`, skipping any others
+static bool seek_section(BufferReader & in, std::string_view name) {
+  while (true) {
+    std::string_view section = next_section(in);
+    if (section.empty()) return false;
+    if (section == name) return true;
+    skip_section(in, section);
   }
+}
 
-  infile >> line;
-  if (line != "$EndNodes") exit_with_error("invalid file format (nodes)");
+// call f(i, error) for every i in [0, n) in parallel, and then 
+// return the first error message that any of them reported (if any)
+template < typename callable >
+static std::string try_in_parallel(int64_t n, callable && f) {
+  std::vector< std::string > errors(n);
+  parallel_for(n, [&](int64_t i) { f(i, errors[i]); });
+  for (auto & error : errors) {
+    if (!error.empty()) return error;
+  }
+  return {};
+}
 
-  ////////////////
-  // read elems //
-  ////////////////
+// the same, but exiting if there was an error
+template < typename callable >
+static void run_in_parallel(int64_t n, callable && f) {
+  std::string error = try_in_parallel(n, f);
+  if (!error.empty()) exit_with_error(error);
+}
 
-  // skip through any data sections other than $Elements
-  do {
-    getline(infile, line);
-  } while (infile && line != "$Elements");
+// call f(chunk, error) on line-aligned pieces of [begin, end), where f returns 
+// the number of records it read. Returns the total number of records, 
+// and the first error message that any of the calls reported (if any).
+template < typename callable >
+static int64_t parse_chunks(const char * begin, const char * end, std::string & error, callable && f) {
+  int n = num_chunks(std::size_t(end - begin));
+  std::vector< const char * > bounds = split_lines(begin, end, n);
+  std::vector< int64_t > counts(n, 0);
+  error = try_in_parallel(n, [&](int64_t i, std::string & chunk_error) {
+    BufferReader chunk{bounds[i], bounds[i+1]};
+    counts[i] = f(chunk, chunk_error);
+  });
+  int64_t total = 0;
+  for (auto count : counts) total += count;
+  return total;
+}
+
+// ids are almost always 1, 2, ..., n, so sections are first parsed assuming
+// that they are, with parse(ids) returning an error message if that fails. 
+// Only then are all of the ids collected by gather(), to renumber them 
+// compactly, and the section parsed again.
+template < typename parse_t, typename gather_t >
+static IdMap parse_with_ids(int64_t n, IdMap::Lookups lookups, parse_t && parse, gather_t && gather) {
+  IdMap ids = IdMap::dense(n);
+  std::string error = parse(ids);
+  if (error.empty()) return ids;
+
+  std::vector< int64_t > all_ids = gather();
+  if (int64_t(all_ids.size()) != n) exit_with_error(error);
+  ids = IdMap::sparse(all_ids, lookups);
+  if (!ids.renumbered()) exit_with_error(error);
+
+  error = parse(ids);
+  if (!error.empty()) exit_with_error(error);
+  return ids;
+}
+
+static bool next_record(BufferReader & in) {
+  in.skip_whitespace();
+  return !in.done();
+}
 
-  int num_elems;
-  infile >> num_elems;
+// ignore anything else on this line
+static void skip_rest_of_line(BufferReader & in) {
+  while (in.ptr < in.end && (*in.ptr == ' ' || *in.ptr == '\t' || *in.ptr == '\r')) in.ptr++;
+  if (in.ptr < in.end && *in.ptr != '\n') in.next_line();
+}
 
-  mesh.elements.resize(num_elems);
+// the first number on every line of [begin, end), in order
+static std::vector< int64_t > gather_ids(const char * begin, const char * end) {
+  int n = num_chunks(std::size_t(end - begin));
+  std::vector< const char * > bounds = split_lines(begin, end, n);
+  std::vector< std::vector< int64_t > > chunk_ids(n);
+  run_in_parallel(n, [&](int64_t i, std::string & error) {
+    BufferReader chunk{bounds[i], bounds[i+1]};
+    while (next_record(chunk)) {
+      chunk_ids[i].push_back(chunk.integer< int64_t >());
+      chunk.next_line();
+    }
+    if (!chunk.ok) error = "invalid file format (ids)";
+  });
+  std::vector< int64_t > ids;
+  for (auto & c : chunk_ids) ids.insert(ids.end(), c.begin(), c.end());
+  return ids;
+}
 
-  for (int i = 0; i < num_elems; i++) {
-    auto [elem_id, elem_type, num_tags] = ascii_read_array<int, 3>(infile);
+struct ElementHeader {
+  int64_t id = -1; // zero-based
+  io::Element::Type type = io::Element::Type::Unsupported;
+  int num_tags = 0;
+};
+
+template < typename lookup_t >
+static bool read_element_header(BufferReader & in, const lookup_t & element_ids, ElementHeader & header, std::string & error) {
+  int64_t id = in.integer< int64_t >();
+  int gmsh_type = in.integer< int >();
+  header.num_tags = in.integer< int >();
+  header.type = gmsh::element_type(gmsh_type);
+  header.id = element_ids(id, header.id + 1); // elements are usually in order
+  if (!in.ok || header.num_tags < 0) {
+    error = "invalid file format (elems)";
+  } else if (header.id < 0) {
+    error = "invalid element id: " + std::to_string(id);
+  } else if (header.type == io::Element::Type::Unsupported) {
+    error = "unsupported gmsh element type: " + std::to_string(gmsh_type);
+  }
+  return error.empty();
+}
+
+// node ids that aren't in the map clear in.ok
+template < typename T, typename lookup_t >
+static void read_element_data(BufferReader & in, int * tags, int num_tags, T * node_ids, int npe, const lookup_t & nodes) {
+  for (int j = 0; j < num_tags; j++) {
+    tags[j] = in.integer< int >();
+  }
+  for (int j = 0; j < npe; j++) {
+    int64_t node_id = nodes(in.integer< int64_t >());
+    if (node_id < 0) in.ok = false;
+    node_ids[j] = T(node_id);
+  }
+  skip_rest_of_line(in);
+}
+
+template < typename element_lookup, typename node_lookup >
+static std::string read_ascii_elements(const char * begin, const char * end, int64_t num_elems, const element_lookup & element_ids, const node_lookup & node_ids, io::Mesh & mesh) {
+  mesh.elements.assign(num_elems, io::Element{});
+
+  std::string error;
+  int64_t count = parse_chunks(begin, end, error, [&](BufferReader & chunk, std::string & error) {
+    int64_t count = 0;
+    ElementHeader header{};
+    while (next_record(chunk) && read_element_header(chunk, element_ids, header, error)) {
+      auto & e = mesh.elements[header.id];
+      e.type = header.type;
+      e.tags.resize(header.num_tags);
+      e.node_ids.resize(nodes_per_elem(e.type));
+      read_element_data(chunk, e.tags.data(), header.num_tags, e.node_ids.data(), int(e.node_ids.size()), node_ids);
+      if (!chunk.ok) { error = "invalid file format (elems)"; break; }
+      count++;
+    }
+    return count;
+  });
+
+  if (!error.empty()) return error;
+  if (count != num_elems) return "invalid file format (elems)";
+
+  // if every record was read and none are missing, then the ids were unique
+  for (int64_t i = 0; i < num_elems; i++) {
+    if (mesh.elements[i].node_ids.empty()) return "missing element id: " + std::to_string(i + 1);
+  }
+  return {};
+}
+
+template < typename element_lookup, typename node_lookup, typename index_t >
+static std::string read_ascii_elements(const char * begin, const char * end, int64_t num_elems, const element_lookup & element_ids, const node_lookup & node_ids, io::FlatMesh< index_t > & mesh) {
+
+  // first pass: record each element's type and sizes, so that 
+  // the flat arrays can be allocated once, in element id order
+  mesh.types.assign(num_elems, io::Element::Type::Unsupported);
+  mesh.offsets.assign(num_elems + 1, 0);
+  mesh.tag_offsets.assign(num_elems + 1, 0);
+
+  std::string error;
+  int64_t count = parse_chunks(begin, end, error, [&](BufferReader & chunk, std::string & error) {
+    int64_t count = 0;
+    ElementHeader header{};
+    while (next_record(chunk) && read_element_header(chunk, element_ids, header, error)) {
+      mesh.types[header.id] = header.type;
+      mesh.offsets[header.id + 1] = nodes_per_elem(header.type);
+      mesh.tag_offsets[header.id + 1] = header.num_tags;
+      chunk.next_line();
+      count++;
+    }
+    return count;
+  });
+
+  if (!error.empty()) return error;
+  if (count != num_elems) return "invalid file format (elems)";
+
+  for (int64_t i = 0; i < num_elems; i++) {
+    if (mesh.types[i] == io::Element::Type::Unsupported) return "missing element id: " + std::to_string(i + 1);
+    mesh.offsets[i + 1] += mesh.offsets[i];
+    mesh.tag_offsets[i + 1] += mesh.tag_offsets[i];
+  }
+  mesh.connectivity.resize(mesh.offsets[num_elems]);
+  mesh.tags.resize(mesh.tag_offsets[num_elems]);
+
+  // second pass: parse the tags and node ids into place
+  parse_chunks(begin, end, error, [&](BufferReader & chunk, std::string & error) {
+    int64_t count = 0;
+    ElementHeader header{};
+    while (next_record(chunk) && read_element_header(chunk, element_ids, header, error)) {
+      read_element_data(chunk, &mesh.tags[mesh.tag_offsets[header.id]], header.num_tags, 
+                               &mesh.connectivity[mesh.offsets[header.id]], nodes_per_elem(header.type), node_ids);
+      if (!chunk.ok) { error = "invalid file format (elems)"; break; }
+      count++;
+    }
+    return count;
+  });
+
+  mesh.rebuild_blocks();
+  return error;
+}
+
+// every node record sets one flag in `written`. There are as many records as
+// nodes, so if a node wasn't written then some other node's id was repeated
+// (ids 1, 1, 3 pass as the dense map for 1, 2, 3, since their range is right)
+static std::string missing_node(const std::vector< char > & written) {
+  for (std::size_t i = 0; i < written.size(); i++) {
+    if (!written[i]) return "missing node id: " + std::to_string(i + 1);
+  }
+  return {};
+}
+
+// these start at the contents of the section, and finish after its $End line. 
+// They return the map from the file's ids to indices into the mesh.
+static IdMap read_ascii_nodes(BufferReader & in, std::vector< std::array< double, 3 > > & nodes) {
+
+  int64_t num_nodes = in.integer< int64_t >();
+  if (!in.ok || num_nodes < 0) exit_with_error("invalid file format (nodes)");
+  nodes.resize(num_nodes);
+
+  const char * end = section_end(in);
+  IdMap node_ids = parse_with_ids(num_nodes, IdMap::Lookups::Random, [&](const IdMap & node_ids) {
+    std::string error;
+    std::vector< char > written(num_nodes, 0);
+    int64_t count = parse_chunks(in.ptr, end, error, [&](BufferReader & chunk, std::string & error) {
+      int64_t count = 0;
+      int64_t i = -1;
+      while (next_record(chunk)) {
+        int64_t node_id = chunk.integer< int64_t >();
+        i = node_ids(node_id, i + 1);
+        if (i < 0) {
+          error = "invalid node id: " + std::to_string(node_id);
+          break;
+        }
+        auto & x = nodes[i];
+        x[0] = chunk.real< double >();
+        x[1] = chunk.real< double >();
+        x[2] = chunk.real< double >();
+        if (!chunk.ok) { error = "invalid file format (nodes)"; break; }
+        written[i] = 1;
+        count++;
+      }
+      return count;
+    });
+    if (error.empty() && count != num_nodes) error = "invalid file format (nodes)";
+    if (error.empty()) error = missing_node(written);
+    return error;
+  }, [&]() { return gather_ids(in.ptr, end); });
+  in.ptr = end;
+
+  if (in.word() != "$EndNodes") exit_with_error("invalid file format (nodes)");
+
+  return node_ids;
+
+}
+
+template < typename mesh_t >
+static IdMap read_ascii_elements(BufferReader & in, const IdMap & node_ids, mesh_t & mesh) {
+
+  int64_t num_elems = in.integer< int64_t >();
+  if (!in.ok || num_elems < 0) exit_with_error("invalid file format (elems)");
+
+  const char * end = section_end(in);
+  IdMap element_ids = parse_with_ids(num_elems, IdMap::Lookups::InOrder, [&](const IdMap & element_ids) {
+    return element_ids.with_lookup([&](const auto & elements) {
+      return node_ids.with_lookup([&](const auto & nodes) {
+        return read_ascii_elements(in.ptr, end, num_elems, elements, nodes, mesh);
+      });
+    });
+  }, [&]() { return gather_ids(in.ptr, end); });
+  in.ptr = end;
+
+  if (in.word() != "$EndElements") exit_with_error("invalid file format (elems)");
+
+  return element_ids;
+
+}
+
+// load a (possibly unaligned) value from the file, reversing its bytes 
+// only if the file was written on a machine with the other endianness
+template < bool swap_bytes, typename T >
+static T load(const char * ptr) {
+  T value;
+  std::memcpy(&value, ptr, sizeof(T));
+  if constexpr (swap_bytes) { value = byte_swap(value); }
+  return value;
+}
+
+// each node record is: int id, double x, double y, double z
+static constexpr std::size_t node_record_bytes = sizeof(int) + 3 * sizeof(double);
+
+template < bool swap_bytes >
+static std::string decode_nodes(const char * ptr, const IdMap & node_ids, std::vector< std::array< double, 3 > > & nodes) {
+  int64_t num_nodes = int64_t(nodes.size());
+  std::vector< char > written(num_nodes, 0);
+  for (int64_t i = 0; i < num_nodes; i++) {
+    int id = load< swap_bytes, int >(ptr);
+    int64_t index = node_ids(id, i);
+    if (index < 0) return "invalid node id: " + std::to_string(id);
+    auto & node = nodes[index];
+    node[0] = load< swap_bytes, double >(ptr + 4);
+    node[1] = load< swap_bytes, double >(ptr + 12);
+    node[2] = load< swap_bytes, double >(ptr + 20);
+    written[index] = 1;
+    ptr += node_record_bytes;
+  }
+  return missing_node(written);
+}
+
+// the binary $Elements section is a sequence of blocks, each of which is a 
+// header of 3 ints (gmsh element type, number of elements, number of tags)
+// followed by that many element records of the form: 
+//
+//   int id, int tags[num_tags], int node_ids[nodes_per_elem]
+//
+// this calls f(type, num_tags, block_size, records) for every block, where
+// records points to the block's first element record, and returns a pointer 
+// to the end of the last block (or of the block where f returned false, 
+// if it returns a bool to stop early)
+template < bool swap_bytes, typename callable >
+static const char * for_each_element_block(const char * ptr, const char * end, int64_t num_elems, callable && f) {
+  int64_t element_count = 0;
+  while (element_count < num_elems) {
+    if (end - ptr < 12) exit_with_error("invalid file format (elems)");
+    int gmsh_type = load< swap_bytes, int >(ptr);
+    int block_size = load< swap_bytes, int >(ptr + 4);
+    int num_tags = load< swap_bytes, int >(ptr + 8);
+    ptr += 12;
+
+    io::Element::Type type = gmsh::element_type(gmsh_type);
+    if (type == io::Element::Type::Unsupported) {
+      exit_with_error("unsupported gmsh element type: " + std::to_string(gmsh_type));
+    }
+
+    std::size_t record_bytes = sizeof(int) * std::size_t(1 + num_tags + nodes_per_elem(type));
+    if (block_size < 0 || std::size_t(end - ptr) < record_bytes * std::size_t(block_size)) {
+      exit_with_error("invalid file format (elems)");
+    }
+
+    if constexpr (std::is_same_v< decltype(f(type, num_tags, block_size, ptr)), bool >) {
+      if (!f(type, num_tags, block_size, ptr)) return ptr + record_bytes * std::size_t(block_size);
+    } else {
+      f(type, num_tags, block_size, ptr);
+    }
 
-    // note: gmsh uses 1-based indexing
-    auto & e = mesh.elements[elem_id - 1];
+    ptr += record_bytes * std::size_t(block_size);
+    element_count += block_size;
+  }
+  return ptr;
+}
 
-    e.type = gmsh::element_type(elem_type);
+// the first int of every element record
+template < bool swap_bytes >
+static std::vector< int64_t > gather_element_ids(const char * ptr, const char * end, int64_t num_elems) {
+  std::vector< int64_t > ids;
+  ids.reserve(num_elems);
+  for_each_element_block< swap_bytes >(ptr, end, num_elems, [&](io::Element::Type type, int num_tags, int block_size, const char * record) {
+    std::size_t record_bytes = sizeof(int) * std::size_t(1 + num_tags + nodes_per_elem(type));
+    for (int i = 0; i < block_size; i++) {
+      ids.push_back(load< swap_bytes, int >(record + record_bytes * i));
+    }
+  });
+  return ids;
+}
 
-    e.tags.resize(num_tags);
-    for (int j = 0; j < num_tags; j++) infile >> e.tags[j];
+// element records that refer to ids that aren't in the maps set `error`,
+// and `previous` is the index of the previous element in the file
+template < bool swap_bytes, typename lookup_t >
+static int64_t element_id(const char * record, const lookup_t & element_ids, int64_t previous, std::string & error) {
+  int id = load< swap_bytes, int >(record);
+  int64_t index = element_ids(id, previous + 1);
+  if (index < 0 && error.empty()) error = "invalid element id: " + std::to_string(id);
+  return index;
+}
 
-    int npe = nodes_per_elem(e.type);
-    e.node_ids.resize(npe);
+template < bool swap_bytes, typename T, typename lookup_t >
+static void load_node_ids(const char * record, T * node_ids, int npe, const lookup_t & nodes, std::string & error) {
+  if constexpr (std::is_same_v< lookup_t, DenseLookup >) {
+    bool valid = true;
     for (int j = 0; j < npe; j++) {
-      infile >> e.node_ids[j];
-      e.node_ids[j]--; // one-based to zero-based indices
+      int64_t index = int64_t(load< swap_bytes, int >(record + 4 * j)) - 1;
+      valid &= uint64_t(index) < nodes.count;
+      node_ids[j] = T(index);
+    }
+    if (!valid && error.empty()) error = "invalid node id";
+  } else {
+    for (int j = 0; j < npe; j++) {
+      int id = load< swap_bytes, int >(record + 4 * j);
+      int64_t index = nodes(id);
+      if (index < 0 && error.empty()) error = "invalid node id: " + std::to_string(id);
+      node_ids[j] = T(index);
+    }
+  }
+}
+
+// these set `stop` to the end of the last block
+template < bool swap_bytes, typename element_lookup, typename node_lookup >
+static std::string decode_elements(const char * ptr, const char * end, const element_lookup & element_ids, const node_lookup & node_ids, io::Mesh & mesh, const char *& stop) {
+  int64_t num_elems = int64_t(mesh.elements.size());
+  std::string error;
+  int64_t id = -1;
+  stop = for_each_element_block< swap_bytes >(ptr, end, num_elems, [&](io::Element::Type type, int num_tags, int block_size, const char * record) {
+    int npe = nodes_per_elem(type);
+    for (int i = 0; i < block_size && error.empty(); i++) {
+      id = element_id< swap_bytes >(record, element_ids, id, error);
+      if (id < 0) return false;
+      io::Element & e = mesh.elements[id];
+      e.type = type;
+      e.tags.resize(num_tags);
+      for (int j = 0; j < num_tags; j++) {
+        e.tags[j] = load< swap_bytes, int >(record + 4 * (1 + j));
+      }
+      e.node_ids.resize(npe);
+      load_node_ids< swap_bytes >(record + 4 * (1 + num_tags), e.node_ids.data(), npe, node_ids, error);
+      record += 4 * (1 + num_tags + npe);
     }
+    return error.empty();
+  });
+  if (!error.empty()) return error;
 
-    getline(infile, line);
+  // every record was read, so if none are missing then the ids were unique
+  for (int64_t i = 0; i < num_elems; i++) {
+    if (mesh.elements[i].node_ids.empty()) return "missing element id: " + std::to_string(i + 1);
   }
+  return {};
+}
 
-  infile >> line;
-  if (line != "$EndElements") exit_with_error("invalid file format (elems)");
+template < bool swap_bytes, typename element_lookup, typename node_lookup, typename index_t >
+static std::string decode_elements(const char * ptr, const char * end, const element_lookup & element_ids, const node_lookup & node_ids, io::FlatMesh< index_t > & mesh, const char *& stop) {
+  int64_t num_elems = int64_t(mesh.types.size());
+  std::string error;
+
+  // first pass: record each element's type and sizes, so that 
+  // the flat arrays can be allocated once, in element id order
+  mesh.offsets.assign(num_elems + 1, 0);
+  mesh.tag_offsets.assign(num_elems + 1, 0);
+  int64_t id = -1;
+  for_each_element_block< swap_bytes >(ptr, end, num_elems, [&](io::Element::Type type, int num_tags, int block_size, const char * record) {
+    int npe = nodes_per_elem(type);
+    for (int i = 0; i < block_size; i++) {
+      id = element_id< swap_bytes >(record, element_ids, id, error);
+      if (id < 0) return false;
+
+      // a repeated id would have its records copied twice in the 
+      // second pass, into space sized for only one of them
+      if (mesh.types[id] != io::Element::Type::Unsupported) {
+        error = "duplicate element id: " + std::to_string(load< swap_bytes, int >(record));
+        return false;
+      }
+      mesh.types[id] = type;
+      mesh.offsets[id + 1] = npe;
+      mesh.tag_offsets[id + 1] = num_tags;
+      record += 4 * (1 + num_tags + npe);
+    }
+    return true;
+  });
+  if (!error.empty()) return error;
+
+  for (int64_t i = 0; i < num_elems; i++) {
+    if (mesh.types[i] == io::Element::Type::Unsupported) return "missing element id: " + std::to_string(i + 1);
+    mesh.offsets[i + 1] += mesh.offsets[i];
+    mesh.tag_offsets[i + 1] += mesh.tag_offsets[i];
+  }
+  mesh.connectivity.resize(mesh.offsets[num_elems]);
+  mesh.tags.resize(mesh.tag_offsets[num_elems]);
+
+  // second pass: copy the node ids and tags into place, 
+  // with the number of nodes per element known at compile time
+  id = -1;
+  stop = for_each_element_block< swap_bytes >(ptr, end, num_elems, [&](io::Element::Type type, int num_tags, int block_size, const char * record) {
+    dispatch(type, [&](auto T) {
+      constexpr int npe = nodes_per_elem(decltype(T)::value);
+      for (int i = 0; i < block_size; i++) {
+        id = element_id< swap_bytes >(record, element_ids, id, error);
+        record += 4;
+
+        int * tags = &mesh.tags[mesh.tag_offsets[id]];
+        for (int j = 0; j < num_tags; j++) {
+          tags[j] = load< swap_bytes, int >(record + 4 * j);
+        }
+        record += 4 * num_tags;
+
+        load_node_ids< swap_bytes >(record, &mesh.connectivity[mesh.offsets[id]], npe, node_ids, error);
+        record += 4 * npe;
+      }
+    });
+    return error.empty();
+  });
 
-  infile.close();
+  mesh.rebuild_blocks();
 
-  return mesh;
+  return error;
 }
 
-io::Mesh import_gmsh_v22_binary(std::ifstream & infile, bool swap_bytes) {
+static IdMap read_binary_nodes(BufferReader & in, std::vector< std::array< double, 3 > > & nodes, bool swap_bytes) {
+
+  int64_t num_nodes = in.integer< int64_t >();
+  in.line(); // skip the newline
+  if (!in.ok || num_nodes < 0 || in.remaining() < node_record_bytes * std::size_t(num_nodes)) {
+    exit_with_error("invalid file format (nodes)");
+  }
 
-  io::Mesh mesh;
+  nodes.resize(num_nodes);
+  IdMap node_ids = parse_with_ids(num_nodes, IdMap::Lookups::Random, [&](const IdMap & node_ids) {
+    return swap_bytes ? decode_nodes< true >(in.ptr, node_ids, nodes) : decode_nodes< false >(in.ptr, node_ids, nodes);
+  }, [&]() {
+    std::vector< int64_t > ids(num_nodes);
+    for (int64_t i = 0; i < num_nodes; i++) {
+      const char * record = in.ptr + node_record_bytes * i;
+      ids[i] = swap_bytes ? load< true, int >(record) : load< false, int >(record);
+    }
+    return ids;
+  });
+  in.ptr += node_record_bytes * num_nodes;
 
-  auto read = [&](auto * ptr, std::streamsize size){
-    infile.read((char*)ptr, size);
+  if (in.word() != "$EndNodes") exit_with_error("invalid file format (nodes)");
+
+  return node_ids;
+
+}
+
+template < typename mesh_t >
+static IdMap read_binary_elements(BufferReader & in, const IdMap & node_ids, mesh_t & mesh, bool swap_bytes) {
+
+  int64_t num_elems = in.integer< int64_t >();
+  in.line(); // skip the newline after the number of elements
+  if (!in.ok || num_elems < 0) exit_with_error("invalid file format (elems)");
+
+  const char * stop = in.ptr;
+  IdMap element_ids = parse_with_ids(num_elems, IdMap::Lookups::InOrder, [&](const IdMap & element_ids) {
+    if constexpr (std::is_same_v< mesh_t, io::Mesh >) {
+      mesh.elements.assign(num_elems, io::Element{});
+    } else {
+      mesh.types.assign(num_elems, io::Element::Type::Unsupported);
+    }
+    return element_ids.with_lookup([&](const auto & elements) {
+      return node_ids.with_lookup([&](const auto & nodes) {
+        if (swap_bytes) {
+          return decode_elements< true >(in.ptr, in.end, elements, nodes, mesh, stop);
+        } else {
+          return decode_elements< false >(in.ptr, in.end, elements, nodes, mesh, stop);
+        }
+      });
+    });
+  }, [&]() {
     if (swap_bytes) {
-      uint8_t * byte_ptr = reinterpret_cast<uint8_t*>(ptr);
-      std::reverse(byte_ptr, byte_ptr + sizeof(*ptr));
+      return gather_element_ids< true >(in.ptr, in.end, num_elems);
+    } else {
+      return gather_element_ids< false >(in.ptr, in.end, num_elems);
     }
-  };
+  });
+
+  in.ptr = stop;
+
+  if (in.word() != "$EndElements") exit_with_error("invalid file format (elems)");
+
+  return element_ids;
+
+}
+
+/////////////
+// MSH 4.1 //
+/////////////
+
+// version 4.1 files store nodes and elements in blocks that each belong to a
+// geometric entity (dim, tag), and have no per-element tags. So, elements are
+// given the same two tags that a version 2.2 file would have:
+//
+//   tags = {physical tag of the element's entity (or 0), entity tag}
+//
+// and on export, the elements are grouped into entities by those same tags 
+// (any further tags are not written). 
+//
+// Every block has an explicit size, so the sections are first split into 
+// ranges of at most `records_per_range` nodes or elements (with one quick 
+// pass to find the line boundaries, for ascii files), and then the ranges 
+// are decoded in parallel, straight into their final slots.
+
+// reads one value from either kind of file, where in binary files
+// ints are 4 bytes, and size_t (read as uint64_t) is 8 bytes
+template < bool binary, bool swap_bytes >
+struct Msh41Reader {
+  BufferReader & in;
+
+  template < typename T >
+  T read() {
+    if constexpr (binary) {
+      if (in.remaining() < sizeof(T)) { in.ok = false; return T{}; }
+      T value = load< swap_bytes, T >(in.ptr);
+      in.ptr += sizeof(T);
+      return value;
+    } else if constexpr (std::is_floating_point_v< T >) {
+      return in.real< T >();
+    } else {
+      return in.integer< T >();
+    }
+  }
+};
+
+using EntityKey = std::pair< int, int >; // (dim, tag)
+
+// physical tag of each entity in the $Entities section (if it has one)
+template < bool binary, bool swap_bytes >
+static std::map< EntityKey, int > read_entities(BufferReader & in) {
+  Msh41Reader< binary, swap_bytes > r{in};
+
+  std::map< EntityKey, int > physical_tags;
+
+  uint64_t num_entities[4];
+  for (auto & n : num_entities) n = r.template read< uint64_t >();
+
+  for (int dim = 0; dim < 4 && in.ok; dim++) {
+    for (uint64_t i = 0; i < num_entities[dim] && in.ok; i++) {
+      int tag = r.template read< int >();
+
+      // points have a position, everything else has a bounding box
+      for (int j = 0; j < ((dim == 0) ? 3 : 6); j++) r.template read< double >();
+
+      uint64_t num_physicals = r.template read< uint64_t >();
+      for (uint64_t j = 0; j < num_physicals && in.ok; j++) {
+        int physical = r.template read< int >();
+        if (j == 0) physical_tags[{dim, tag}] = physical;
+      }
+
+      if (dim > 0) {
+        uint64_t num_bounding = r.template read< uint64_t >();
+        for (uint64_t j = 0; j < num_bounding && in.ok; j++) r.template read< int >();
+      }
+    }
+  }
+
+  if (!in.ok) exit_with_error("invalid file format (entities)");
+
+  return physical_tags;
+}
+
+// move past the next n lines, recording where every `stride`-th one starts
+static void skip_lines(BufferReader & in, int64_t n, int64_t stride, std::vector< const char * > & starts) {
+  for (int64_t i = 0; i < n; i++) {
+    if (in.done()) { in.ok = false; return; }
+    if (i % stride == 0) starts.push_back(in.ptr);
+    in.next_line();
+  }
+}
+
+struct NodeRange {
+  const char * tags;
+  const char * coords;
+  int64_t count;
+  int num_params; // parametric coordinates after each x y z
+};
+
+template < bool binary, bool swap_bytes >
+static std::vector< NodeRange > find_node_ranges(BufferReader & in, int64_t & num_nodes, bool & dense) {
+  Msh41Reader< binary, swap_bytes > r{in};
+
+  uint64_t num_blocks = r.template read< uint64_t >();
+  num_nodes = int64_t(r.template read< uint64_t >());
+  uint64_t min_tag = r.template read< uint64_t >();
+  uint64_t max_tag = r.template read< uint64_t >();
+  dense = (min_tag == 1 && max_tag == uint64_t(num_nodes)) || num_nodes == 0;
+  if constexpr (!binary) { in.next_line(); }
+
+  std::vector< NodeRange > ranges;
+  int64_t count = 0;
+  for (uint64_t b = 0; b < num_blocks && in.ok; b++) {
+    int dim = r.template read< int >();
+    r.template read< int >(); // entity tag
+    int parametric = r.template read< int >();
+    int64_t n = int64_t(r.template read< uint64_t >());
+    if (!in.ok || dim < 0 || dim > 3 || n < 0) break;
+    int num_params = parametric ? dim : 0;
+    count += n;
+
+    if constexpr (binary) {
+      std::size_t bytes = sizeof(uint64_t) * (1 + 3 + num_params) * std::size_t(n);
+      if (in.remaining() < bytes) { in.ok = false; break; }
+      const char * tags = in.ptr;
+      const char * coords = in.ptr + sizeof(uint64_t) * n;
+      for (int64_t first = 0; first < n; first += records_per_range) {
+        ranges.push_back({tags + sizeof(uint64_t) * first, 
+                          coords + sizeof(double) * (3 + num_params) * first, 
+                          std::min(records_per_range, n - first), num_params});
+      }
+      in.ptr += bytes;
+    } else {
+      in.next_line();
+      std::vector< const char * > tags, coords;
+      skip_lines(in, n, records_per_range, tags);
+      skip_lines(in, n, records_per_range, coords);
+      for (std::size_t i = 0; i < tags.size() && in.ok; i++) {
+        int64_t first = int64_t(i) * records_per_range;
+        ranges.push_back({tags[i], coords[i], std::min(records_per_range, n - first), num_params});
+      }
+    }
+  }
+
+  if (!in.ok || count != num_nodes) exit_with_error("invalid file format (nodes)");
+
+  return ranges;
+}
+
+template < bool binary, bool swap_bytes >
+static void decode_node_range(const NodeRange & range, const char * end, const IdMap & node_ids, std::vector< std::array< double, 3 > > & nodes, std::vector< char > & written, std::string & error) {
+  BufferReader tags{range.tags, end};
+  BufferReader coords{range.coords, end};
+  Msh41Reader< binary, swap_bytes > t{tags};
+  Msh41Reader< binary, swap_bytes > c{coords};
+  int64_t index = -1;
+  for (int64_t i = 0; i < range.count; i++) {
+    int64_t id = int64_t(t.template read< uint64_t >());
+    index = node_ids(id, index + 1);
+    if (index < 0) {
+      error = "invalid node tag: " + std::to_string(id);
+      return;
+    }
+    auto & x = nodes[index];
+    x[0] = c.template read< double >();
+    x[1] = c.template read< double >();
+    x[2] = c.template read< double >();
+    for (int j = 0; j < range.num_params; j++) c.template read< double >();
+    written[index] = 1;
+  }
+  if (!tags.ok || !coords.ok) error = "invalid file format (nodes)";
+}
+
+struct ElementRange {
+  const char * records;
+  int64_t count;
+  io::Element::Type type;
+  int tags[2];
+};
+
+template < bool binary, bool swap_bytes >
+static std::vector< ElementRange > find_element_ranges(BufferReader & in, int64_t & num_elems, bool & dense, const std::map< EntityKey, int > & physical_tags) {
+  Msh41Reader< binary, swap_bytes > r{in};
+
+  uint64_t num_blocks = r.template read< uint64_t >();
+  num_elems = int64_t(r.template read< uint64_t >());
+  uint64_t min_tag = r.template read< uint64_t >();
+  uint64_t max_tag = r.template read< uint64_t >();
+  dense = (min_tag == 1 && max_tag == uint64_t(num_elems)) || num_elems == 0;
+  if constexpr (!binary) { in.next_line(); }
+
+  std::vector< ElementRange > ranges;
+  int64_t count = 0;
+  for (uint64_t b = 0; b < num_blocks && in.ok; b++) {
+    int dim = r.template read< int >();
+    int entity = r.template read< int >();
+    int gmsh_type = r.template read< int >();
+    int64_t n = int64_t(r.template read< uint64_t >());
+    if (!in.ok || n < 0) break;
+    count += n;
+
+    io::Element::Type type = gmsh::element_type(gmsh_type);
+    if (type == io::Element::Type::Unsupported) {
+      exit_with_error("unsupported gmsh element type: " + std::to_string(gmsh_type));
+    }
+
+    auto physical = physical_tags.find({dim, entity});
+    ElementRange block{nullptr, 0, type, {(physical != physical_tags.end()) ? physical->second : 0, entity}};
+
+    if constexpr (binary) {
+      std::size_t record_bytes = sizeof(uint64_t) * std::size_t(1 + nodes_per_elem(type));
+      if (in.remaining() < record_bytes * std::size_t(n)) { in.ok = false; break; }
+      for (int64_t first = 0; first < n; first += records_per_range) {
+        block.records = in.ptr + record_bytes * first;
+        block.count = std::min(records_per_range, n - first);
+        ranges.push_back(block);
+      }
+      in.ptr += record_bytes * n;
+    } else {
+      in.next_line();
+      std::vector< const char * > starts;
+      skip_lines(in, n, records_per_range, starts);
+      for (std::size_t i = 0; i < starts.size(); i++) {
+        block.records = starts[i];
+        block.count = std::min(records_per_range, n - int64_t(i) * records_per_range);
+        ranges.push_back(block);
+      }
+    }
+  }
+
+  if (!in.ok || count != num_elems) exit_with_error("invalid file format (elems)");
+
+  return ranges;
+}
+
+// calls f(id, read_node_ids) for each element in the range, where id is 
+// its index and read_node_ids(T * node_ids) reads the indices of its nodes
+template < bool binary, bool swap_bytes, typename callable >
+static void for_each_element_record(const ElementRange & range, const char * end, const IdMap & element_ids, const IdMap & node_ids, std::string & error, callable && f) {
+  int npe = nodes_per_elem(range.type);
+  BufferReader in{range.records, end};
+  Msh41Reader< binary, swap_bytes > r{in};
+  int64_t id = -1;
+  for (int64_t i = 0; i < range.count; i++) {
+    const char * record = in.ptr;
+    int64_t tag = int64_t(r.template read< uint64_t >());
+    id = element_ids(tag, id + 1);
+    if (id < 0) {
+      error = "invalid element tag: " + std::to_string(tag);
+      return;
+    }
+    f(id, [&](auto * nodes) {
+      using T = std::remove_pointer_t< decltype(nodes) >;
+      for (int j = 0; j < npe; j++) {
+        int64_t index = node_ids(int64_t(r.template read< uint64_t >()));
+        if (index < 0) in.ok = false;
+        nodes[j] = T(index);
+      }
+    });
+    if constexpr (binary) {
+      in.ptr = record + sizeof(uint64_t) * (1 + npe);
+    } else {
+      skip_rest_of_line(in);
+    }
+  }
+  if (!in.ok) error = "invalid file format (elems)";
+}
+
+template < bool binary, bool swap_bytes >
+static void decode_elements(const std::vector< ElementRange > & ranges, const char * end, const IdMap & element_ids, const IdMap & node_ids, io::Mesh & mesh) {
+  int64_t num_elems = int64_t(mesh.elements.size());
+
+  run_in_parallel(int64_t(ranges.size()), [&](int64_t i, std::string & error) {
+    const ElementRange & range = ranges[i];
+    for_each_element_record< binary, swap_bytes >(range, end, element_ids, node_ids, error, [&](int64_t id, auto read_node_ids) {
+      auto & e = mesh.elements[id];
+      e.type = range.type;
+      e.tags.assign(range.tags, range.tags + 2);
+      e.node_ids.resize(nodes_per_elem(range.type));
+      read_node_ids(e.node_ids.data());
+    });
+  });
+
+  // if every record was read and none are missing, then the ids were unique
+  for (int64_t i = 0; i < num_elems; i++) {
+    if (mesh.elements[i].node_ids.empty()) exit_with_error("missing element id: " + std::to_string(i + 1));
+  }
+}
+
+template < bool binary, bool swap_bytes, typename index_t >
+static void decode_elements(const std::vector< ElementRange > & ranges, const char * end, const IdMap & element_ids, const IdMap & node_ids, io::FlatMesh< index_t > & mesh) {
+  int64_t num_elems = int64_t(mesh.types.size());
+
+  // first pass: record each element's type and sizes, so that 
+  // the flat arrays can be allocated once, in element id order
+  mesh.offsets.assign(num_elems + 1, 0);
+  mesh.tag_offsets.assign(num_elems + 1, 0);
+  run_in_parallel(int64_t(ranges.size()), [&](int64_t i, std::string & error) {
+    const ElementRange & range = ranges[i];
+    for_each_element_record< binary, swap_bytes >(range, end, element_ids, node_ids, error, [&](int64_t id, auto) {
+      mesh.types[id] = range.type;
+      mesh.offsets[id + 1] = nodes_per_elem(range.type);
+      mesh.tag_offsets[id + 1] = 2;
+    });
+  });
+
+  for (int64_t i = 0; i < num_elems; i++) {
+    if (mesh.types[i] == io::Element::Type::Unsupported) exit_with_error("missing element id: " + std::to_string(i + 1));
+    mesh.offsets[i + 1] += mesh.offsets[i];
+    mesh.tag_offsets[i + 1] += mesh.tag_offsets[i];
+  }
+  mesh.connectivity.resize(mesh.offsets[num_elems]);
+  mesh.tags.resize(mesh.tag_offsets[num_elems]);
+
+  // second pass: copy the node ids and tags into place
+  run_in_parallel(int64_t(ranges.size()), [&](int64_t i, std::string & error) {
+    const ElementRange & range = ranges[i];
+    for_each_element_record< binary, swap_bytes >(range, end, element_ids, node_ids, error, [&](int64_t id, auto read_node_ids) {
+      mesh.tags[mesh.tag_offsets[id]] = range.tags[0];
+      mesh.tags[mesh.tag_offsets[id] + 1] = range.tags[1];
+      read_node_ids(&mesh.connectivity[mesh.offsets[id]]);
+    });
+  });
+
+  mesh.rebuild_blocks();
+}
+
+// the tags of the nodes or elements in each range, when they aren't 1, 2, ..., n
+template < bool binary, bool swap_bytes, typename range_t >
+static IdMap gather_tags(const std::vector< range_t > & ranges, const char * end, IdMap::Lookups lookups) {
+  std::vector< std::vector< int64_t > > range_tags(ranges.size());
+  run_in_parallel(int64_t(ranges.size()), [&](int64_t i, std::string & error) {
+    const range_t & range = ranges[i];
+    std::size_t stride = sizeof(uint64_t);
+    const char * start;
+    if constexpr (std::is_same_v< range_t, NodeRange >) {
+      start = range.tags;
+    } else {
+      start = range.records;
+      stride *= std::size_t(1 + nodes_per_elem(range.type));
+    }
+    BufferReader in{start, end};
+    Msh41Reader< binary, swap_bytes > r{in};
+    for (int64_t j = 0; j < range.count; j++) {
+      if constexpr (binary) in.ptr = start + stride * j;
+      range_tags[i].push_back(int64_t(r.template read< uint64_t >()));
+      if constexpr (!binary) in.next_line();
+    }
+    if (!in.ok) error = "invalid file format (tags)";
+  });
+  std::vector< int64_t > tags;
+  for (auto & t : range_tags) tags.insert(tags.end(), t.begin(), t.end());
+  return IdMap::sparse(tags, lookups);
+}
+
+template < bool binary, bool swap_bytes, typename mesh_t >
+static mesh_t import_gmsh_v41_impl(BufferReader & in) {
+
+  mesh_t mesh;
+
+  ///////////////////
+  // read entities //
+  ///////////////////
+
+  // $Entities is optional, and we skip any other sections before $Nodes
+  std::map< EntityKey, int > physical_tags;
+  while (true) {
+    std::string_view section = next_section(in);
+    if (section.empty()) exit_with_error("invalid file format (nodes)");
+    if (section == "Nodes") break;
+    if (section == "Entities") {
+      physical_tags = read_entities< binary, swap_bytes >(in);
+      if (in.word() != "$EndEntities") exit_with_error("invalid file format (entities)");
+    } else {
+      skip_section(in, section);
+    }
+  }
 
   ////////////////
   // read nodes //
   ////////////////
-  std::string line;
-  infile >> line;
-  if (line != "$Nodes") exit_with_error("invalid file format (nodes)");
+  int64_t num_nodes;
+  bool dense_nodes;
+  std::vector< NodeRange > node_ranges = find_node_ranges< binary, swap_bytes >(in, num_nodes, dense_nodes);
+
+  // the header has the smallest and largest tags, so sparse tags are known up front
+  IdMap node_ids = dense_nodes ? IdMap::dense(num_nodes) : gather_tags< binary, swap_bytes >(node_ranges, in.end, IdMap::Lookups::Random);
+  if (node_ids.renumbered()) mesh.original_node_ids = node_ids.ids();
 
-  int id;
-  int num_nodes;
-  infile >> num_nodes;
   mesh.nodes.resize(num_nodes);
-  getline(infile, line); // skip the newline
-  for (int i = 0; i < num_nodes; i++) {
-    // note: gmsh uses 1-based indexing
-    read((char*)&id, sizeof(int)); 
-    read((char*)&mesh.nodes[id-1], sizeof(double) * 3);
+  std::vector< char > written(num_nodes, 0);
+  run_in_parallel(int64_t(node_ranges.size()), [&](int64_t i, std::string & error) {
+    decode_node_range< binary, swap_bytes >(node_ranges[i], in.end, node_ids, mesh.nodes, written, error);
+  });
+  std::string missing = missing_node(written);
+  if (!missing.empty()) exit_with_error(missing);
+
+  if (in.word() != "$EndNodes") exit_with_error("invalid file format (nodes)");
+
+  ////////////////
+  // read elems //
+  ////////////////
+
+  // skip through any data sections other than $Elements
+  if (!seek_section(in, "Elements")) exit_with_error("invalid file format (elems)");
+
+  int64_t num_elems;
+  bool dense_elems;
+  std::vector< ElementRange > element_ranges = find_element_ranges< binary, swap_bytes >(in, num_elems, dense_elems, physical_tags);
+
+  IdMap element_ids = dense_elems ? IdMap::dense(num_elems) : gather_tags< binary, swap_bytes >(element_ranges, in.end, IdMap::Lookups::InOrder);
+  if (element_ids.renumbered()) mesh.original_element_ids = element_ids.ids();
+
+  if constexpr (std::is_same_v< mesh_t, io::Mesh >) {
+    mesh.elements.resize(num_elems);
+  } else {
+    mesh.types.assign(num_elems, io::Element::Type::Unsupported);
   }
+  decode_elements< binary, swap_bytes >(element_ranges, in.end, element_ids, node_ids, mesh);
+
+  if (in.word() != "$EndElements") exit_with_error("invalid file format (elems)");
+
+  return mesh;
+}
+
+template < typename mesh_t >
+static bool export_gmsh_v41_impl(const mesh_t & mesh, std::string filename, bool binary) {
+
+  constexpr double inf = std::numeric_limits< double >::infinity();
+
+  // elements are written in blocks of consecutive elements that share 
+  // the same type and entity, so they keep their original order
+  struct Block { io::Element::Type type; int entity; int64_t first; int64_t count; };
+  struct Entity { std::set< int > physicals; std::array< double, 6 > bounds; };
+  std::vector< Block > blocks;
+  std::map< EntityKey, Entity > entities;
+  int last_physical = 0;
+  int64_t id = 0;
+  for_each_element(mesh, [&](auto e) {
+    // (this is before the file is opened, so nothing is left half written)
+    if (e.type == io::Element::Type::Unsupported) {
+      exit_with_error("unsupported element type in element " + std::to_string(id));
+    }
+    int physical = (e.num_tags > 0) ? e.tags[0] : 0;
+    int entity = (e.num_tags > 1) ? e.tags[1] : 0;
+    if (blocks.empty() || blocks.back().type != e.type || blocks.back().entity != entity) {
+      blocks.push_back({e.type, entity, id, 0});
+      entities.insert({{element_dimension(e.type), entity}, {{}, {inf, inf, inf, -inf, -inf, -inf}}});
+      last_physical = 0;
+    }
+    if (physical != 0 && physical != last_physical) {
+      entities[{element_dimension(e.type), entity}].physicals.insert(physical);
+      last_physical = physical;
+    }
+    blocks.back().count++;
+    id++;
+  });
+
+  // the work items for writing the elements are pieces of those blocks
+  struct Range { std::size_t block; int64_t first; int64_t count; };
+  std::vector< Range > ranges;
+  for (std::size_t b = 0; b < blocks.size(); b++) {
+    for (int64_t first = 0; first < blocks[b].count; first += records_per_range) {
+      ranges.push_back({b, blocks[b].first + first, std::min(records_per_range, blocks[b].count - first)});
+    }
+  }
+
+  // bounding box of each entity, from the nodes of its elements
+  std::vector< std::array< double, 6 > > range_bounds(ranges.size(), {inf, inf, inf, -inf, -inf, -inf});
+  parallel_for(int64_t(ranges.size()), [&](int64_t r) {
+    auto & bounds = range_bounds[r];
+    for (int64_t i = ranges[r].first; i < ranges[r].first + ranges[r].count; i++) {
+      auto e = element(mesh, std::size_t(i));
+      for (int j = 0; j < e.num_nodes; j++) {
+        auto & x = mesh.nodes[e.node_ids[j]];
+        for (int k = 0; k < 3; k++) {
+          bounds[k] = std::min(bounds[k], x[k]);
+          bounds[k+3] = std::max(bounds[k+3], x[k]);
+        }
+      }
+    }
+  });
+  for (std::size_t r = 0; r < ranges.size(); r++) {
+    const Block & block = blocks[ranges[r].block];
+    auto & bounds = entities[{element_dimension(block.type), block.entity}].bounds;
+    for (int k = 0; k < 3; k++) {
+      bounds[k] = std::min(bounds[k], range_bounds[r][k]);
+      bounds[k+3] = std::max(bounds[k+3], range_bounds[r][k+3]);
+    }
+  }
+
+  // all of the nodes go in one block, on the first of the highest-dimensional entities
+  EntityKey node_entity{0, 0};
+  for (auto & block : blocks) {
+    if (element_dimension(block.type) > node_entity.first) {
+      node_entity = {element_dimension(block.type), block.entity};
+    }
+  }
+
+  std::ofstream outfile(filename, std::ios::binary);
+  BufferWriter out;
+
+  auto size = [&](uint64_t value) { 
+    if (binary) { out.raw(value); } else { out.integer(value); out.character(' '); }
+  };
+  auto integer = [&](int value) { 
+    if (binary) { out.raw(value); } else { out.integer(value); out.character(' '); }
+  };
+  auto real = [&](double value) { 
+    if (binary) { out.raw(value); } else { out.real(value); out.character(' '); }
+  };
+  auto end_line = [&]() { 
+    if (!binary) { out.data.back() = '\n'; } 
+  };
+  auto flush = [&]() { 
+    outfile.write(out.data.data(), std::streamsize(out.size()));
+    out.clear();
+  };
+
+  //////////////////
+  // write header //
+  //////////////////
+  const int one = 1;
+  out.text("$MeshFormat\n");
+  out.text(binary ? "4.1 1 8\n" : "4.1 0 8\n");
+  if (binary) { out.raw(one); out.character('\n'); } // used for checking endianness
+  out.text("$EndMeshFormat\n");
+
+  ////////////////////
+  // write entities //
+  ////////////////////
+  uint64_t num_entities[4] = {0, 0, 0, 0};
+  for (auto & [key, entity] : entities) num_entities[key.first]++;
+
+  out.text("$Entities\n");
+  for (auto n : num_entities) size(n);
+  end_line();
+  for (auto & [key, entity] : entities) {
+    integer(key.second);
+    for (double x : entity.bounds) real(x);
+    size(entity.physicals.size());
+    for (int physical : entity.physicals) integer(physical);
+    size(0); // no bounding entities
+    end_line();
+  }
+  if (binary) out.character('\n');
+  out.text("$EndEntities\n");
+
+  /////////////////
+  // write nodes //
+  /////////////////
+  uint64_t num_nodes = mesh.nodes.size();
+  out.text("$Nodes\n");
+  size(num_nodes > 0); // number of blocks
+  size(num_nodes);
+  size(num_nodes > 0);
+  size(num_nodes);
+  end_line();
+  if (num_nodes > 0) {
+    integer(node_entity.first);
+    integer(node_entity.second);
+    integer(0); // not parametric
+    size(num_nodes);
+    end_line();
+  }
+  flush();
+
+  // node tags, then coordinates
+  int64_t num_node_ranges = (int64_t(num_nodes) + records_per_range - 1) / records_per_range;
+  write_in_parallel(outfile, 2 * num_node_ranges, [&](int64_t r, BufferWriter & buffer) {
+    int64_t first = (r % num_node_ranges) * records_per_range;
+    int64_t last = std::min(first + records_per_range, int64_t(num_nodes));
+    for (int64_t i = first; i < last; i++) {
+      if (r < num_node_ranges) {
+        uint64_t tag = uint64_t(i) + 1; // gmsh uses 1-based indexing
+        if (binary) { buffer.raw(tag); } else { buffer.integer(tag); buffer.character('\n'); }
+      } else {
+        auto & x = mesh.nodes[i];
+        if (binary) { 
+          buffer.raw(x.data(), 3); 
+        } else { 
+          buffer.real(x[0]); buffer.character(' ');
+          buffer.real(x[1]); buffer.character(' ');
+          buffer.real(x[2]); buffer.character('\n');
+        }
+      }
+    }
+  });
+
+  if (binary) out.character('\n');
+  out.text("$EndNodes\n");
+
+  /////////////////
+  // write elems //
+  /////////////////
+  out.text("$Elements\n");
+  size(blocks.size());
+  size(num_elements(mesh));
+  size(num_elements(mesh) > 0);
+  size(num_elements(mesh));
+  end_line();
+  flush();
+
+  write_in_parallel(outfile, int64_t(ranges.size()), [&](int64_t r, BufferWriter & buffer) {
+    const Block & block = blocks[ranges[r].block];
+    if (ranges[r].first == block.first) {
+      int header[3] = {element_dimension(block.type), block.entity, gmsh::element_type(block.type)};
+      if (binary) {
+        buffer.raw(header, 3);
+        buffer.raw(uint64_t(block.count));
+      } else {
+        for (int h : header) { buffer.integer(h); buffer.character(' '); }
+        buffer.integer(block.count); 
+        buffer.character('\n');
+      }
+    }
+
+    for (int64_t i = ranges[r].first; i < ranges[r].first + ranges[r].count; i++) {
+      auto e = element(mesh, std::size_t(i));
+      // gmsh uses 1-based indexing
+      if (binary) {
+        uint64_t record[28];
+        record[0] = uint64_t(i) + 1;
+        for (int j = 0; j < e.num_nodes; j++) record[j + 1] = uint64_t(e.node_ids[j]) + 1;
+        buffer.raw(record, 1 + e.num_nodes);
+      } else {
+        buffer.integer(i + 1);
+        for (int j = 0; j < e.num_nodes; j++) {
+          buffer.character(' ');
+          buffer.integer(int64_t(e.node_ids[j]) + 1);
+        }
+        buffer.character('\n');
+      }
+    }
+  });
+
+  if (binary) out.character('\n');
+  out.text("$EndElements\n");
+  flush();
+
+  outfile.close();
+
+  return false;
+
+}
+
+///////////////
+// streaming //
+///////////////
+
+// accumulates decoded records, and passes them to the visitor in batches
+struct BatchBuffer {
+  io::GmshVisitor & visitor;
+  MappedFile & file;
+
+  std::vector< int64_t > ids = {};
+  std::vector< std::array< double, 3 > > coordinates = {};
+
+  io::Element::Type type = io::Element::Type::Unsupported;
+  int num_tags = 0;
+  std::vector< int > tags = {};
+  std::vector< int64_t > node_ids = {};
+
+  bool full() const { return int64_t(ids.size()) == records_per_range; }
+
+  void flush_nodes(const char * position) {
+    if (!ids.empty()) visitor.nodes({ids.size(), ids.data(), coordinates.data()});
+    ids.clear();
+    coordinates.clear();
+    file.release(position);
+  }
+
+  // begin a new element batch if this element can't be part of the current one
+  void start_element(io::Element::Type elem_type, int elem_num_tags, const char * position) {
+    if (elem_type != type || elem_num_tags != num_tags || full()) {
+      flush_elements(position);
+      type = elem_type;
+      num_tags = elem_num_tags;
+    }
+  }
+
+  void flush_elements(const char * position) {
+    if (!ids.empty()) visitor.elements({type, ids.size(), num_tags, ids.data(), tags.data(), node_ids.data()});
+    ids.clear();
+    tags.clear();
+    node_ids.clear();
+    file.release(position);
+  }
+};
+
+// these start at the contents of the section, and finish after its $End line
+template < bool binary, bool swap_bytes >
+static void visit_nodes(BufferReader & in, BatchBuffer & batch) {
+  io::GmshVisitor & visitor = batch.visitor;
+
+  int64_t num_nodes = in.integer< int64_t >();
+  if (!in.ok || num_nodes < 0) exit_with_error("invalid file format (nodes)");
+  if constexpr (binary) {
+    in.line(); // skip the newline
+    if (in.remaining() < node_record_bytes * std::size_t(num_nodes)) {
+      exit_with_error("invalid file format (nodes)");
+    }
+  }
+
+  visitor.begin_nodes(std::size_t(num_nodes));
+  for (int64_t i = 0; i < num_nodes; i++) {
+    int64_t id;
+    std::array< double, 3 > x;
+    if constexpr (binary) {
+      id = load< swap_bytes, int >(in.ptr);
+      for (int j = 0; j < 3; j++) x[j] = load< swap_bytes, double >(in.ptr + sizeof(int) + j * sizeof(double));
+      in.ptr += node_record_bytes;
+    } else {
+      id = in.integer< int64_t >();
+      for (int j = 0; j < 3; j++) x[j] = in.real< double >();
+    }
+    if (id < 1) exit_with_error("invalid node id: " + std::to_string(id));
+    batch.ids.push_back(id - 1); // note: gmsh uses 1-based indexing
+    batch.coordinates.push_back(x);
+    if (batch.full()) batch.flush_nodes(in.ptr);
+  }
+  batch.flush_nodes(in.ptr);
+
+  if (in.word() != "$EndNodes" || !in.ok) exit_with_error("invalid file format (nodes)");
+}
+
+template < bool binary, bool swap_bytes >
+static void visit_elements(BufferReader & in, BatchBuffer & batch) {
+  io::GmshVisitor & visitor = batch.visitor;
+
+  int64_t num_elems = in.integer< int64_t >();
+  if (!in.ok || num_elems < 0) exit_with_error("invalid file format (elems)");
+
+  // the ids aren't checked against the number of elements, 
+  // so visitors of files with sparse ids see those ids (minus one)
+  IdMap file_ids;
+  std::string error;
+
+  visitor.begin_elements(std::size_t(num_elems));
+  if constexpr (binary) {
+    in.line(); // skip the newline after the number of elements
+    in.ptr = for_each_element_block< swap_bytes >(in.ptr, in.end, num_elems, [&](io::Element::Type type, int num_tags, int block_size, const char * record) {
+      int npe = nodes_per_elem(type);
+      for (int i = 0; i < block_size; i++) {
+        batch.start_element(type, num_tags, record);
+        batch.ids.push_back(element_id< swap_bytes >(record, file_ids, -1, error));
+        record += 4;
+        for (int j = 0; j < num_tags; j++) {
+          batch.tags.push_back(load< swap_bytes, int >(record + 4 * j));
+        }
+        record += 4 * num_tags;
+        for (int j = 0; j < npe; j++) {
+          batch.node_ids.push_back(int64_t(load< swap_bytes, int >(record + 4 * j)) - 1);
+        }
+        record += 4 * npe;
+      }
+    });
+    if (!error.empty()) exit_with_error(error);
+  } else {
+    ElementHeader header{};
+    for (int64_t i = 0; i < num_elems; i++) {
+      if (!read_element_header(in, file_ids, header, error)) exit_with_error(error);
+      batch.start_element(header.type, header.num_tags, in.ptr);
+      batch.ids.push_back(header.id);
+      int npe = nodes_per_elem(header.type);
+      std::size_t tag_offset = batch.tags.size();
+      std::size_t node_offset = batch.node_ids.size();
+      batch.tags.resize(tag_offset + header.num_tags);
+      batch.node_ids.resize(node_offset + npe);
+      read_element_data(in, batch.tags.data() + tag_offset, header.num_tags, batch.node_ids.data() + node_offset, npe, file_ids);
+    }
+  }
+  batch.flush_elements(in.ptr);
+
+  if (in.word() != "$EndElements" || !in.ok) exit_with_error("invalid file format (elems)");
+}
 
-  infile >> line;
-  if (line != "$EndNodes") exit_with_error("invalid file format (nodes)");
+template < bool binary, bool swap_bytes >
+static void visit_gmsh_v22_impl(BufferReader & in, MappedFile & file, io::GmshVisitor & visitor) {
+  BatchBuffer batch{visitor, file};
+
+  if (!seek_section(in, "Nodes")) exit_with_error("invalid file format (nodes)");
+  visit_nodes< binary, swap_bytes >(in, batch);
 
   // skip through any data sections other than $Elements
-  do {
-    getline(infile, line);
-  } while (infile && line != "$Elements");
+  if (!seek_section(in, "Elements")) exit_with_error("invalid file format (elems)");
+  visit_elements< binary, swap_bytes >(in, batch);
+}
 
-  int num_elems;
-  infile >> num_elems;
-  mesh.elements.resize(num_elems);
+///////////////////////
+// selective loading //
+///////////////////////
 
-  getline(infile, line); // skip the newline after the number of elements
+// collects the elements that pass the filter, in the order they appear in the file
+struct ElementSelector : public io::GmshVisitor {
+  const io::GmshFilter & filter;
+  const IdMap & node_map;
 
-  // iterate through all the blocks of elements
-  // until all of the elements are accounted for
-  int element_count = 0;
-  do {
-    auto [gmsh_type, block_size, num_tags] = binary_read_array<int,3>(infile);
+  std::vector< int64_t > ids;
+  std::vector< io::Element::Type > types;
+  std::vector< std::size_t > offsets{0};
+  std::vector< int64_t > node_ids;
+  std::vector< std::size_t > tag_offsets{0};
+  std::vector< int > tags;
 
-    io::Element::Type type = gmsh::element_type(gmsh_type);
-    int npe = nodes_per_elem(type);
+  ElementSelector(const io::GmshFilter & f, const IdMap & nodes) : filter(f), node_map(nodes) {}
 
-    for (int i = 0; i < block_size; i++) {
-      int elem_id;
-      read((char*)&elem_id, sizeof(int));
+  template < typename T >
+  static bool contains(const std::vector< T > & values, T value) {
+    return values.empty() || std::find(values.begin(), values.end(), value) != values.end();
+  }
 
-      io::Element & e = mesh.elements[elem_id - 1];
-      e.type = type;
-      e.tags.resize(num_tags);
-      read((char*)&e.tags[0], sizeof(int) * num_tags);
+  void elements(const io::ElementBatch & batch) override {
+    if (!contains(filter.types, batch.type)) return;
+    int npe = nodes_per_elem(batch.type);
+    for (std::size_t i = 0; i < batch.count; i++) {
+      const int * elem_tags = batch.tags + i * batch.num_tags;
+      int physical = (batch.num_tags > 0) ? elem_tags[0] : 0;
+      if (!contains(filter.physical_tags, physical)) continue;
+
+      const int64_t * elem_nodes = batch.node_ids + i * npe;
+      ids.push_back(batch.ids[i]);
+      types.push_back(batch.type);
+      for (int j = 0; j < npe; j++) {
+        int64_t index = node_map(elem_nodes[j] + 1);
+        if (index < 0) exit_with_error("invalid node id: " + std::to_string(elem_nodes[j] + 1));
+        node_ids.push_back(index);
+      }
+      offsets.push_back(node_ids.size());
+      tags.insert(tags.end(), elem_tags, elem_tags + batch.num_tags);
+      tag_offsets.push_back(tags.size());
+    }
+  }
 
-      // note: gmsh uses 1-based indexing
-      e.node_ids.resize(npe);
-      read((char*)&e.node_ids[0], sizeof(int) * npe);
-      for (auto & id : e.node_ids) { id--; }
+  // the selected elements, ordered by id
+  template < typename mesh_t >
+  void copy_to(mesh_t & mesh) const {
+    std::vector< std::size_t > order(ids.size());
+    std::iota(order.begin(), order.end(), 0);
+    if (!std::is_sorted(ids.begin(), ids.end())) {
+      std::sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) { return ids[a] < ids[b]; });
     }
 
-    element_count += block_size;
-  } while (element_count < num_elems);
+    // the kept elements are renumbered 0, 1, ..., so keep their 
+    // original ids unless that numbering is the same as the file's
+    if (!ids.empty() && ids[order.back()] != int64_t(ids.size()) - 1) {
+      for (std::size_t e : order) mesh.original_element_ids.push_back(ids[e] + 1);
+    }
 
-  infile >> line;
+    if constexpr (std::is_same_v< mesh_t, io::Mesh >) {
+      mesh.elements.resize(order.size());
+      for (std::size_t i = 0; i < order.size(); i++) {
+        std::size_t e = order[i];
+        auto & elem = mesh.elements[i];
+        elem.type = types[e];
+        elem.node_ids.assign(node_ids.begin() + offsets[e], node_ids.begin() + offsets[e+1]);
+        elem.tags.assign(tags.begin() + tag_offsets[e], tags.begin() + tag_offsets[e+1]);
+      }
+    } else {
+      using index_t = typename decltype(mesh.offsets)::value_type;
+      mesh.types.resize(order.size());
+      mesh.offsets.assign(1, 0);
+      mesh.tag_offsets.assign(1, 0);
+      mesh.connectivity.reserve(node_ids.size());
+      mesh.tags.reserve(tags.size());
+      for (std::size_t i = 0; i < order.size(); i++) {
+        std::size_t e = order[i];
+        mesh.types[i] = types[e];
+        for (std::size_t j = offsets[e]; j < offsets[e+1]; j++) {
+          mesh.connectivity.push_back(index_t(node_ids[j]));
+        }
+        mesh.tags.insert(mesh.tags.end(), tags.begin() + tag_offsets[e], tags.begin() + tag_offsets[e+1]);
+        mesh.offsets.push_back(index_t(mesh.connectivity.size()));
+        mesh.tag_offsets.push_back(index_t(mesh.tags.size()));
+      }
+      mesh.rebuild_blocks();
+    }
+  }
+};
+
+// sections that aren't needed are jumped over (by searching for their 
+// $End line) rather than parsed, and when elements are filtered by type
+// or tag, only the ones that are kept are stored
+template < bool binary, bool swap_bytes, typename mesh_t >
+static mesh_t import_gmsh_v22_impl(BufferReader & in, MappedFile & file, const io::GmshFilter & filter) {
 
-  if (line != "$EndElements") exit_with_error("invalid file format (elems)");
+  mesh_t mesh;
 
-  infile.close();
+  // without the nodes, node ids are only converted to zero-based
+  IdMap node_ids;
+
+  if (!seek_section(in, "Nodes")) exit_with_error("invalid file format (nodes)");
+  if (!filter.nodes) {
+    skip_section(in, "Nodes");
+  } else if constexpr (binary) {
+    node_ids = read_binary_nodes(in, mesh.nodes, swap_bytes);
+  } else {
+    node_ids = read_ascii_nodes(in, mesh.nodes);
+  }
+  if (node_ids.renumbered()) mesh.original_node_ids = node_ids.ids();
+
+  // skip through any data sections other than $Elements
+  if (!seek_section(in, "Elements")) exit_with_error("invalid file format (elems)");
+  if (!filter.elements) {
+    skip_section(in, "Elements");
+  } else if (!filter.types.empty() || !filter.physical_tags.empty()) {
+    ElementSelector selector(filter, node_ids);
+    BatchBuffer batch{selector, file};
+    visit_elements< binary, swap_bytes >(in, batch);
+    selector.copy_to(mesh);
+  } else {
+    IdMap element_ids;
+    if constexpr (binary) {
+      element_ids = read_binary_elements(in, node_ids, mesh, swap_bytes);
+    } else {
+      element_ids = read_ascii_elements(in, node_ids, mesh);
+    }
+    if (element_ids.renumbered()) mesh.original_element_ids = element_ids.ids();
+  }
 
   return mesh;
 
 }
 
+struct MeshFormat {
+  double version;
+  int filetype; // 0: ascii, 1: binary
+  int datasize;
+  bool swap_bytes;
+};
+
+// read the $MeshFormat section, which is common to every version
+static MeshFormat read_mesh_format(BufferReader & in) {
+  MeshFormat format{};
+
+  std::string_view line = in.word();
+  if (line != "$MeshFormat") exit_with_error("invalid file format (header)" + std::string(line));
+
+  format.version = in.real< double >();
+  format.filetype = in.integer< int >();
+  format.datasize = in.integer< int >();
+  if (!in.ok) exit_with_error("invalid file format (header)");
+
+  if (format.filetype > 1) exit_with_error("unsupported file type");
+
+  if (format.filetype == 1) {
+    in.line(); // skip the newline
+    if (in.remaining() < sizeof(int)) exit_with_error("invalid file format (header)");
+    int one;
+    std::memcpy(&one, in.ptr, sizeof(int));
+    in.ptr += sizeof(int);
+    if (one != 1 && byte_swap(one) != 1) exit_with_error("invalid file format (header)");
+    format.swap_bytes = (one != 1);
+  }
+
+  line = in.word();
+  if (line != "$EndMeshFormat") {
+    exit_with_error("invalid file format (end header):" + std::string(line));
+  }
+
+  return format;
+}
+
 namespace io {
 
 bool export_gmsh_v22(const Mesh & mesh, std::string filename, FileEncoding enc) {
+  return export_gmsh_v22(mesh, filename, enc, Fields{});
+}
+
+bool export_gmsh_v22(const Mesh & mesh, std::string filename, FileEncoding enc, const Fields & fields) {
+  check_fields(fields, mesh.nodes.size(), mesh.elements.size());
+  if (enc == FileEncoding::ASCII) {
+    return export_gmsh_v22_ascii(mesh, fields, filename);
+  } else {
+    return export_gmsh_v22_binary(mesh, fields, filename);
+  }
+}
+
+template < typename index_t >
+bool export_gmsh_v22(const FlatMesh< index_t > & mesh, std::string filename, FileEncoding enc) {
+  return export_gmsh_v22(mesh, filename, enc, Fields{});
+}
+
+template < typename index_t >
+bool export_gmsh_v22(const FlatMesh< index_t > & mesh, std::string filename, FileEncoding enc, const Fields & fields) {
+  check_fields(fields, mesh.nodes.size(), mesh.num_elements());
   if (enc == FileEncoding::ASCII) {
-    return export_gmsh_v22_ascii(mesh, filename);
+    return export_gmsh_v22_ascii(mesh, fields, filename);
   } else {
-    return export_gmsh_v22_binary(mesh, filename);
+    return export_gmsh_v22_binary(mesh, fields, filename);
   }
 }
 
-Mesh import_gmsh_v22(std::string filename) {
+template bool export_gmsh_v22(const FlatMesh< int32_t > &, std::string, FileEncoding);
+template bool export_gmsh_v22(const FlatMesh< int64_t > &, std::string, FileEncoding);
+template bool export_gmsh_v22(const FlatMesh< int32_t > &, std::string, FileEncoding, const Fields &);
+template bool export_gmsh_v22(const FlatMesh< int64_t > &, std::string, FileEncoding, const Fields &);
+
+template < typename mesh_t >
+mesh_t import_gmsh_v22(std::string filename) {
+  return import_gmsh_v22< mesh_t >(filename, GmshFilter{});
+}
 
-  std::ifstream infile(filename);
+template < typename mesh_t >
+mesh_t import_gmsh_v22(std::string filename, const GmshFilter & filter) {
 
-  if (!infile) {
+  MappedFile file(filename);
+
+  if (!file.is_open()) {
     std::cout << "error: " << filename << " not found" << std::endl;
     exit(1);
   }
 
-  std::string line;
+  BufferReader in{file.begin(), file.end()};
+  MeshFormat format = read_mesh_format(in);
 
-  /////////////////
-  // read header //
-  /////////////////
-  infile >> line;
-  if (line != "$MeshFormat") exit_with_error("invalid file format (header)" + line);
+  if (format.version != 2.2) exit_with_error("unsupported version number");
+  if (format.datasize != 8) exit_with_error("invalid data size field");
 
-  double version_number;
-  int filetype;
-  int datasize;
+  if (format.filetype == 0) {
+    return import_gmsh_v22_impl< false, false, mesh_t >(in, file, filter);
+  } else if (format.swap_bytes) {
+    return import_gmsh_v22_impl< true, true, mesh_t >(in, file, filter);
+  } else {
+    return import_gmsh_v22_impl< true, false, mesh_t >(in, file, filter);
+  }
 
-  infile >> version_number >> filetype >> datasize;
-  if (version_number != 2.2) exit_with_error("unsupported version number");
-  if (filetype > 1) exit_with_error("unsupported file type");
-  if (datasize != 8) exit_with_error("invalid data size field");
+}
 
-  if (filetype == 0) {
-    infile >> line;
-    if (line != "$EndMeshFormat") {
-      exit_with_error("invalid file format (end header):" + line);
-    }
-    return import_gmsh_v22_ascii(infile);
+template Mesh import_gmsh_v22(std::string);
+template FlatMesh< int32_t > import_gmsh_v22(std::string);
+template FlatMesh< int64_t > import_gmsh_v22(std::string);
+
+template Mesh import_gmsh_v22(std::string, const GmshFilter &);
+template FlatMesh< int32_t > import_gmsh_v22(std::string, const GmshFilter &);
+template FlatMesh< int64_t > import_gmsh_v22(std::string, const GmshFilter &);
+
+std::vector< GmshSection > index_gmsh(std::string filename) {
+
+  MappedFile file(filename);
+
+  if (!file.is_open()) {
+    std::cout << "error: " << filename << " not found" << std::endl;
+    exit(1);
+  }
+
+  std::vector< GmshSection > sections;
+
+  BufferReader in{file.begin(), file.end()};
+  while (true) {
+    std::string_view name = next_section(in);
+    if (name.empty()) break;
+    const char * stop = find_section_end(in.ptr, in.end, name);
+    if (stop == nullptr) exit_with_error("invalid file format (missing $End" + std::string(name) + ")");
+    sections.push_back({std::string(name), std::size_t(in.ptr - file.begin()), std::size_t(stop - file.begin())});
+    in.ptr = stop;
+    in.line();
+  }
+
+  return sections;
+
+}
+
+void visit_gmsh_v22(std::string filename, GmshVisitor & visitor) {
+
+  MappedFile file(filename);
+
+  if (!file.is_open()) {
+    std::cout << "error: " << filename << " not found" << std::endl;
+    exit(1);
+  }
+
+  BufferReader in{file.begin(), file.end()};
+  MeshFormat format = read_mesh_format(in);
+
+  if (format.version != 2.2) exit_with_error("unsupported version number");
+  if (format.datasize != 8) exit_with_error("invalid data size field");
+
+  if (format.filetype == 0) {
+    visit_gmsh_v22_impl< false, false >(in, file, visitor);
+  } else if (format.swap_bytes) {
+    visit_gmsh_v22_impl< true, true >(in, file, visitor);
   } else {
-    getline(infile, line); // skip the newline
-    int one;
-    infile.read((char*)&one, 4);
-    bool swap_bytes = (one != 1);
-    infile >> line;
-    if (line != "$EndMeshFormat") {
-      exit_with_error("invalid file format (end header):" + line);
-    }
-    return import_gmsh_v22_binary(infile, swap_bytes);
+    visit_gmsh_v22_impl< true, false >(in, file, visitor);
   }
 
 }
 
+bool export_gmsh_v41(const Mesh & mesh, std::string filename, FileEncoding enc) {
+  return export_gmsh_v41_impl(mesh, filename, enc == FileEncoding::Binary);
+}
+
+template < typename index_t >
+bool export_gmsh_v41(const FlatMesh< index_t > & mesh, std::string filename, FileEncoding enc) {
+  return export_gmsh_v41_impl(mesh, filename, enc == FileEncoding::Binary);
+}
+
+template bool export_gmsh_v41(const FlatMesh< int32_t > &, std::string, FileEncoding);
+template bool export_gmsh_v41(const FlatMesh< int64_t > &, std::string, FileEncoding);
+
+template < typename mesh_t >
+mesh_t import_gmsh_v41(std::string filename) {
+
+  MappedFile file(filename);
+
+  if (!file.is_open()) {
+    std::cout << "error: " << filename << " not found" << std::endl;
+    exit(1);
+  }
+
+  BufferReader in{file.begin(), file.end()};
+  MeshFormat format = read_mesh_format(in);
+
+  if (format.version != 4.1) exit_with_error("unsupported version number");
+  if (format.datasize != 8) exit_with_error("invalid data size field");
+
+  if (format.filetype == 0) {
+    return import_gmsh_v41_impl< false, false, mesh_t >(in);
+  } else if (format.swap_bytes) {
+    return import_gmsh_v41_impl< true, true, mesh_t >(in);
+  } else {
+    return import_gmsh_v41_impl< true, false, mesh_t >(in);
+  }
+
+}
+
+template Mesh import_gmsh_v41(std::string);
+template FlatMesh< int32_t > import_gmsh_v41(std::string);
+template FlatMesh< int64_t > import_gmsh_v41(std::string);
+
 } // namespace io
\ No newline at end of file
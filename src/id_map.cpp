@@ -0,0 +1,148 @@
+#include "id_map.hpp"
+
+#include "util.hpp"
+#include "parallel.hpp"
+
+// least-significant-digit radix sort, 11 bits at a time, that stops once the
+// remaining digits are zero for every key. Each pass counts and then scatters
+// contiguous blocks of keys in parallel, which keeps the sort stable.
+static void radix_sort(std::vector< uint64_t > & keys, uint64_t max_key) {
+  constexpr int digit_bits = 11;
+  constexpr int num_digits = 1 << digit_bits;
+
+  int64_t n = int64_t(keys.size());
+  int64_t num_blocks = std::max< int64_t >(1, std::min< int64_t >(io::get_num_threads(), n >> 16));
+  auto block_begin = [&](int64_t b) { return (n * b) / num_blocks; };
+
+  std::vector< uint64_t > buffer(keys.size());
+  std::vector< std::array< int64_t, num_digits > > offsets(num_blocks);
+
+  for (int shift = 0; shift < 64 && (max_key >> shift) != 0; shift += digit_bits) {
+    parallel_for(num_blocks, [&](int64_t b) {
+      auto & count = offsets[b];
+      count.fill(0);
+      for (int64_t i = block_begin(b); i < block_begin(b + 1); i++) {
+        count[(keys[i] >> shift) & (num_digits - 1)]++;
+      }
+    });
+
+    // ordered by digit, and then by block within each digit
+    int64_t total = 0;
+    for (int d = 0; d < num_digits; d++) {
+      for (auto & count : offsets) {
+        int64_t c = count[d];
+        count[d] = total;
+        total += c;
+      }
+    }
+
+    parallel_for(num_blocks, [&](int64_t b) {
+      auto & offset = offsets[b];
+      for (int64_t i = block_begin(b); i < block_begin(b + 1); i++) {
+        buffer[offset[(keys[i] >> shift) & (num_digits - 1)]++] = keys[i];
+      }
+    });
+
+    keys.swap(buffer);
+  }
+}
+
+IdMap IdMap::dense(int64_t n) {
+  IdMap map;
+  map.kind = Kind::Dense;
+  map.count = n;
+  return map;
+}
+
+IdMap IdMap::sparse(const std::vector< int64_t > & ids, Lookups lookups) {
+  int64_t n = int64_t(ids.size());
+  if (n == 0) return dense(0);
+
+  int64_t min_id = ids[0];
+  int64_t max_id = ids[0];
+  bool sorted = true;
+  for (int64_t i = 0; i < n; i++) {
+    min_id = std::min(min_id, ids[i]);
+    max_id = std::max(max_id, ids[i]);
+    if (i > 0 && ids[i] <= ids[i - 1]) sorted = false;
+  }
+
+  // if the ids are distinct, then they're 1, 2, ..., n (and when they
+  // aren't, the readers find an index that no record was written to)
+  if (min_id == 1 && max_id == n) return dense(n);
+
+  IdMap map;
+  map.kind = Kind::Sorted;
+  map.count = n;
+  map.min_id = min_id;
+
+  uint64_t range = uint64_t(max_id) - uint64_t(min_id);
+  if (sorted) {
+    map.sorted_ids = ids;
+  } else {
+    std::vector< uint64_t > keys(n);
+    for (int64_t i = 0; i < n; i++) keys[i] = uint64_t(ids[i]) - uint64_t(min_id);
+    radix_sort(keys, range);
+    map.sorted_ids.resize(n);
+    for (int64_t i = 0; i < n; i++) {
+      if (i > 0 && keys[i] == keys[i - 1]) {
+        exit_with_error("duplicate id: " + std::to_string(int64_t(keys[i] + uint64_t(min_id))));
+      }
+      map.sorted_ids[i] = int64_t(keys[i] + uint64_t(min_id));
+    }
+  }
+
+  if (lookups == Lookups::InOrder) return map;
+
+  if (range < 4 * uint64_t(n)) {
+    map.kind = Kind::Table;
+    map.table.assign(range + 1, -1);
+    parallel_for(n, [&](int64_t i) { map.table[uint64_t(map.sorted_ids[i]) - uint64_t(min_id)] = i; });
+  } else {
+    map.kind = Kind::Hash;
+
+    // at most half full, with one shard per thread,
+    // as long as the shards aren't too small
+    map.hash_bits = 4;
+    while ((int64_t(1) << map.hash_bits) < 2 * n) map.hash_bits++;
+    int shard_bits = 0;
+    while ((2 << shard_bits) <= io::get_num_threads() && map.hash_bits - (shard_bits + 1) >= 10) shard_bits++;
+
+    // an unlucky shard can go over its load cap, but one shard for the whole table can't
+    if (!map.fill_hash_table(shard_bits)) map.fill_hash_table(0);
+  }
+
+  return map;
+}
+
+int64_t IdMap::search(int64_t id) const {
+  auto it = std::lower_bound(sorted_ids.begin(), sorted_ids.end(), id);
+  return (it != sorted_ids.end() && *it == id) ? int64_t(it - sorted_ids.begin()) : -1;
+}
+
+bool IdMap::fill_hash_table(int shard_bits) {
+  slots.assign(std::size_t(1) << hash_bits, Slot{0, -1});
+  shard_mask = (uint64_t(1) << (hash_bits - shard_bits)) - 1;
+
+  // a shard more than 3/4 full makes for long probe sequences (and a full one
+  // would leave lookups of missing ids with no empty slot to stop at), so
+  // that counts as a failure too. The whole table is at most half full.
+  uint64_t max_load = 3 * (shard_mask + 1) / 4;
+
+  int64_t num_shards = int64_t(1) << shard_bits;
+  std::vector< char > filled(num_shards, 1);
+  parallel_for(num_shards, [&](int64_t s) {
+    uint64_t load = 0;
+    for (int64_t i = 0; i < count; i++) {
+      uint64_t slot = hash(sorted_ids[i]);
+      if (int64_t(slot >> (hash_bits - shard_bits)) != s) continue;
+      if (++load > max_load) { filled[s] = 0; return; }
+
+      uint64_t shard = slot & ~shard_mask;
+      while (slots[slot].index >= 0) slot = shard | ((slot + 1) & shard_mask);
+      slots[slot] = {sorted_ids[i], i};
+    }
+  });
+
+  return std::find(filled.begin(), filled.end(), 0) == filled.end();
+}
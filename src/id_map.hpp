@@ -0,0 +1,105 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+// maps the ids that a file uses for its nodes or elements to zero-based
+// indices. Ids are usually 1, 2, ..., n, so the index is just id - 1, but
+// files from partitioned or merged sessions can have gaps and very large ids.
+// Those are renumbered compactly, in increasing order of id. 
+//
+// Ids that are looked up in the order they're stored in the file (e.g. element
+// ids, while reading the elements) are usually sorted, so lookups are given
+// a hint (the previous index + 1), and only fall back to a binary search 
+// over the sorted ids when that's wrong. Ids that are looked up in random
+// order (node ids in the connectivity) also get an index: a lookup table 
+// for (id - smallest id), when the ids are clustered, or an open-addressing
+// hash table, when they aren't.
+//
+// Looking up an id that isn't in the map gives -1.
+
+// lookups in a map of the ids 1, 2, ..., n
+struct DenseLookup {
+  uint64_t count;
+  int64_t operator()(int64_t id) const { return (uint64_t(id) - 1 < count) ? id - 1 : -1; }
+  int64_t operator()(int64_t id, int64_t /* hint */) const { return (*this)(id); }
+};
+
+class IdMap {
+ public:
+  enum class Lookups { InOrder, Random };
+
+  // with nothing to check against, every id maps to id - 1
+  IdMap() = default;
+
+  // the ids 1, 2, ..., n
+  static IdMap dense(int64_t n);
+
+  // any set of distinct ids, in any order (this exits if there are duplicates)
+  static IdMap sparse(const std::vector< int64_t > & ids, Lookups lookups);
+
+  // whether the ids aren't just 1, 2, ..., n
+  bool renumbered() const { return kind != Kind::Unchecked && kind != Kind::Dense; }
+
+  // the original id of every index (empty unless renumbered)
+  const std::vector< int64_t > & ids() const { return sorted_ids; }
+
+  // calls f(lookup), where lookup gives the same indices as this map. Unless
+  // the ids were renumbered, that's a DenseLookup, so that loops over many
+  // ids in f don't check which kind of map this is for each one.
+  template < typename callable >
+  auto with_lookup(callable && f) const {
+    if (kind == Kind::Dense) return f(DenseLookup{uint64_t(count)});
+    if (kind == Kind::Unchecked) return f(DenseLookup{~uint64_t(0)});
+    return f(*this);
+  }
+
+  int64_t operator()(int64_t id, int64_t hint) const {
+    if (renumbered() && uint64_t(hint) < uint64_t(count) && sorted_ids[hint] == id) return hint;
+    return (*this)(id);
+  }
+
+  int64_t operator()(int64_t id) const {
+    switch (kind) {
+      case Kind::Unchecked: return id - 1;
+      case Kind::Dense: return (uint64_t(id) - 1 < uint64_t(count)) ? id - 1 : -1;
+      case Kind::Sorted: return search(id);
+      case Kind::Table: {
+        uint64_t key = uint64_t(id) - uint64_t(min_id);
+        return (key < table.size()) ? table[key] : -1;
+      }
+      case Kind::Hash: {
+        uint64_t slot = hash(id);
+        uint64_t shard = slot & ~shard_mask;
+        for (uint64_t probes = 0; probes <= shard_mask; probes++) {
+          const Slot & s = slots[slot];
+          if (s.index < 0) return -1;
+          if (s.id == id) return s.index;
+          slot = shard | ((slot + 1) & shard_mask);
+        }
+        return -1;
+      }
+    }
+    return -1;
+  }
+
+ private:
+  enum class Kind { Unchecked, Dense, Sorted, Table, Hash };
+
+  // linear probing stays within one shard of the table,
+  // so that the shards can be filled in parallel
+  struct Slot { int64_t id; int64_t index; };
+
+  uint64_t hash(int64_t id) const { return (uint64_t(id) * 0x9E3779B97F4A7C15ull) >> (64 - hash_bits); }
+  bool fill_hash_table(int shard_bits);
+  int64_t search(int64_t id) const;
+
+  Kind kind = Kind::Unchecked;
+  int64_t count = 0;
+  int64_t min_id = 0;
+  std::vector< int64_t > sorted_ids;
+  std::vector< int64_t > table;
+  std::vector< Slot > slots;
+  int hash_bits = 0;
+  uint64_t shard_mask = 0;
+};
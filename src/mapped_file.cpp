@@ -0,0 +1,65 @@
+#include "mapped_file.hpp"
+
+#include <fstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MESH_HAVE_MMAP
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+MappedFile::MappedFile(std::string filename) : ptr(nullptr), bytes(0), released(0), mapped(false), opened(false) {
+
+#ifdef MESH_HAVE_MMAP
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd == -1) return;
+
+  struct stat info;
+  bool have_size = (fstat(fd, &info) == 0);
+  if (have_size) {
+    bytes = std::size_t(info.st_size);
+    if (bytes > 0) {
+      void * addr = mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (addr != MAP_FAILED) {
+        // the importers mostly make a single pass front-to-back
+        madvise(addr, bytes, MADV_SEQUENTIAL);
+        ptr = static_cast< const char * >(addr);
+        mapped = true;
+      }
+    }
+  }
+  close(fd);
+  if (mapped || (have_size && bytes == 0)) { opened = true; return; }
+#endif
+
+  // fall back to reading the whole file
+  std::ifstream infile(filename, std::ios::binary | std::ios::ate);
+  if (!infile) return;
+  bytes = std::size_t(infile.tellg());
+  buffer.resize(bytes);
+  infile.seekg(0);
+  infile.read(buffer.data(), bytes);
+  ptr = buffer.data();
+  opened = bool(infile);
+
+}
+
+void MappedFile::release(const char * upto) {
+#ifdef MESH_HAVE_MMAP
+  if (!mapped) return;
+  static const std::size_t page_size = std::size_t(sysconf(_SC_PAGESIZE));
+  std::size_t stop = (std::size_t(upto - ptr) / page_size) * page_size;
+  if (stop > released) {
+    madvise(const_cast< char * >(ptr) + released, stop - released, MADV_DONTNEED);
+    released = stop;
+  }
+#endif
+}
+
+MappedFile::~MappedFile() {
+#ifdef MESH_HAVE_MMAP
+  if (mapped) { munmap(const_cast< char * >(ptr), bytes); }
+#endif
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+// read-only view of the entire contents of a file. On POSIX systems 
+// the file is memory-mapped, so its contents are paged in by the OS 
+// as they are accessed. Elsewhere, the file is read into memory.
+class MappedFile {
+ public:
+  MappedFile(std::string filename);
+  ~MappedFile();
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile & operator=(const MappedFile &) = delete;
+
+  bool is_open() const { return opened; }
+  const char * data() const { return ptr; }
+  const char * begin() const { return ptr; }
+  const char * end() const { return ptr + bytes; }
+  std::size_t size() const { return bytes; }
+
+  // tell the OS that [begin(), upto) won't be read again, so that the pages
+  // can be dropped right away. This keeps the memory used by a single pass 
+  // over a large file bounded (it does nothing if the file isn't mapped).
+  void release(const char * upto);
+
+ private:
+  const char * ptr;
+  std::size_t bytes;
+  std::size_t released;
+  bool mapped;
+  bool opened;
+  std::vector< char > buffer;
+};
@@ -0,0 +1,129 @@
+#pragma once
+
+#include "mesh/io.hpp"
+
+#include <cstddef>
+#include <type_traits>
+
+// non-owning view of a single element's data, so that each exporter 
+// can be written once and run directly over either Mesh or FlatMesh
+template < typename index_t >
+struct ElementView {
+  io::Element::Type type;
+  const index_t * node_ids;
+  int num_nodes;
+  const int * tags;
+  int num_tags;
+};
+
+// same as ElementView, but for an element whose type (and so, number of nodes)
+// is known at compile time. Kernels written as generic lambdas accept either one,
+// and loops over num_nodes have a constant trip count for FixedElementView
+template < io::Element::Type T, typename index_t >
+struct FixedElementView {
+  static constexpr io::Element::Type type = T;
+  static constexpr int num_nodes = io::nodes_per_elem(T);
+  const index_t * node_ids;
+  const int * tags;
+  int num_tags;
+};
+
+// the integer type used for node ids in each kind of mesh
+template < typename mesh_t >
+struct index_type;
+
+template <>
+struct index_type< io::Mesh > { using type = int; };
+
+template < typename index_t >
+struct index_type< io::FlatMesh< index_t > > { using type = index_t; };
+
+template < typename mesh_t >
+using index_type_t = typename index_type< mesh_t >::type;
+
+inline std::size_t num_elements(const io::Mesh & mesh) { return mesh.elements.size(); }
+
+template < typename index_t >
+std::size_t num_elements(const io::FlatMesh< index_t > & mesh) { return mesh.num_elements(); }
+
+inline ElementView< int > element(const io::Mesh & mesh, std::size_t i) {
+  const io::Element & e = mesh.elements[i];
+  return {e.type, e.node_ids.data(), int(e.node_ids.size()), e.tags.data(), int(e.tags.size())};
+}
+
+template < typename index_t >
+ElementView< index_t > element(const io::FlatMesh< index_t > & mesh, std::size_t i) {
+  index_t first_id = mesh.offsets[i];
+  index_t first_tag = mesh.tag_offsets[i];
+  return {
+    mesh.types[i], 
+    mesh.connectivity.data() + first_id, int(mesh.offsets[i+1] - first_id),
+    mesh.tags.data() + first_tag, int(mesh.tag_offsets[i+1] - first_tag)
+  };
+}
+
+template < io::Element::Type T >
+using element_type_constant = std::integral_constant< io::Element::Type, T >;
+
+// calls f(element_type_constant< type >{}), 
+// turning a runtime element type into a compile-time one 
+template < typename callable >
+void dispatch(io::Element::Type type, callable && f) {
+  using T = io::Element::Type;
+  switch (type) {
+    case T::Line2:   f(element_type_constant< T::Line2 >{}); break;
+    case T::Line3:   f(element_type_constant< T::Line3 >{}); break;
+    case T::Tri3:    f(element_type_constant< T::Tri3 >{}); break;
+    case T::Tri6:    f(element_type_constant< T::Tri6 >{}); break;
+    case T::Quad4:   f(element_type_constant< T::Quad4 >{}); break;
+    case T::Quad8:   f(element_type_constant< T::Quad8 >{}); break;
+    case T::Quad9:   f(element_type_constant< T::Quad9 >{}); break;
+    case T::Tet4:    f(element_type_constant< T::Tet4 >{}); break;
+    case T::Tet10:   f(element_type_constant< T::Tet10 >{}); break;
+    case T::Pyr5:    f(element_type_constant< T::Pyr5 >{}); break;
+    case T::Pyr13:   f(element_type_constant< T::Pyr13 >{}); break;
+    case T::Pyr14:   f(element_type_constant< T::Pyr14 >{}); break;
+    case T::Prism6:  f(element_type_constant< T::Prism6 >{}); break;
+    case T::Prism15: f(element_type_constant< T::Prism15 >{}); break;
+    case T::Prism18: f(element_type_constant< T::Prism18 >{}); break;
+    case T::Hex8:    f(element_type_constant< T::Hex8 >{}); break;
+    case T::Hex20:   f(element_type_constant< T::Hex20 >{}); break;
+    case T::Hex27:   f(element_type_constant< T::Hex27 >{}); break;
+    case T::Unsupported: break;
+  }
+}
+
+// visit every element (in order) with f(ElementView)
+template < typename callable >
+void for_each_element(const io::Mesh & mesh, callable && f) {
+  for (std::size_t i = 0; i < mesh.elements.size(); i++) {
+    f(element(mesh, i));
+  }
+}
+
+// visit every element (in order) with f(FixedElementView< type, index_t >), 
+// dispatching on the element type once per block rather than once per element
+template < typename index_t, typename callable >
+void for_each_element(const io::FlatMesh< index_t > & mesh, callable && f) {
+  for (const io::ElementBlock< index_t > & block : mesh.blocks) {
+
+    if (block.type == io::Element::Type::Unsupported) {
+      for (index_t i = block.first; i < block.first + block.count; i++) {
+        f(element(mesh, i));
+      }
+      continue;
+    }
+
+    dispatch(block.type, [&](auto type) {
+      constexpr io::Element::Type T = decltype(type)::value;
+      constexpr int stride = io::nodes_per_elem(T);
+      const index_t * node_ids = mesh.connectivity.data() + mesh.offsets[block.first];
+      for (index_t i = block.first; i < block.first + block.count; i++) {
+        index_t first_tag = mesh.tag_offsets[i];
+        f(FixedElementView< T, index_t >{node_ids, mesh.tags.data() + first_tag, int(mesh.tag_offsets[i+1] - first_tag)});
+        node_ids += stride;
+      }
+    });
+
+  }
+}
@@ -138,7 +138,7 @@ namespace gmsh {
 
   using io::Element;
 
-  inline Element::Type element_type(int i){
+  constexpr Element::Type element_type(int i){
     switch (i) {
       case  1: return Element::Type::Line2;
       case  8: return Element::Type::Line3;
@@ -162,7 +162,7 @@ namespace gmsh {
     }
   }
 
-  inline int element_type(Element::Type type){
+  constexpr int element_type(Element::Type type){
     switch (type) {
       case Element::Type::Line2:       return 1;
       case Element::Type::Line3:       return 8;
@@ -327,7 +327,7 @@ namespace vtk {
 
   using io::Element;
 
-  inline Element::Type element_type(int i){
+  constexpr Element::Type element_type(int i){
     switch (i) {
       case  3: return Element::Type::Line2;
       case 21: return Element::Type::Line3;
@@ -351,7 +351,7 @@ namespace vtk {
     }
   }
 
-  inline int element_type(Element::Type type){
+  constexpr int element_type(Element::Type type){
     switch (type) {
       case Element::Type::Line2:       return  3;
       case Element::Type::Line3:       return 21;
@@ -376,11 +376,32 @@ namespace vtk {
     return -1;
   }
 
-  inline std::vector<int> permutation(Element::Type type) {
+  // non-owning view of one of the permutation tables below
+  struct Permutation {
+    const int * data;
+    int size;
+    constexpr const int * begin() const { return data; }
+    constexpr const int * end() const { return data + size; }
+    constexpr int operator[](int i) const { return data[i]; }
+  };
+
+  inline constexpr int identity[27] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26};
+  inline constexpr int tet10[10] = {0, 1, 2, 3, 4, 5, 6, 7, 9, 8};
+  inline constexpr int pyr13[13] = {0, 1, 2, 3, 4, 5, 8, 10, 6, 7, 9, 11, 12};
+  inline constexpr int pyr14[14] = {0, 1, 2, 3, 4, 5, 8, 10, 6, 7, 9, 11, 12, 13};
+  inline constexpr int prism15[15] = {0, 1, 2, 3, 4, 5, 6, 9, 7, 12, 14, 13, 8, 10, 11};
+  inline constexpr int prism18[18] = {0, 1, 2, 3, 4, 5, 6, 9, 7, 12, 14, 13, 8, 10, 11, 15, 17, 16};
+  inline constexpr int hex20[20] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 11, 13, 9, 16, 18, 19, 17, 10, 12, 14, 15};
+  inline constexpr int hex27[27] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 11, 13, 9, 16, 18, 19, 17, 10, 12, 14, 15, 22, 23, 21, 24, 20, 25, 26};
+
+  // the tables are static, so looking up a permutation 
+  // for every element costs nothing, and can be done at compile time
+  constexpr Permutation permutation(Element::Type type) {
     switch (type) {
 
+      case Element::Type::Unsupported: return {identity, 0};
+
       // many of the elements share the same node ordering
-      case Element::Type::Unsupported:
       case Element::Type::Line2:
       case Element::Type::Line3:
       case Element::Type::Tri3:
@@ -392,28 +413,21 @@ namespace vtk {
       case Element::Type::Pyr5:
       case Element::Type::Prism6:
       case Element::Type::Hex8: {
-        return identity_permutation(nodes_per_elem(type));
+        return {identity, io::nodes_per_elem(type)};
       }
 
       // but some of the quadratic elements assign numbers
       // to edge/face nodes in a different order
-      case Element::Type::Tet10:
-        return {0, 1, 2, 3, 4, 5, 6, 7, 9, 8};
-      case Element::Type::Pyr13:
-        return {0, 1, 2, 3, 4, 5, 8, 10, 6, 7, 9, 11, 12};
-      case Element::Type::Pyr14:
-        return {0, 1, 2, 3, 4, 5, 8, 10, 6, 7, 9, 11, 12, 13};
-      case Element::Type::Prism15:
-        return {0, 1, 2, 3, 4, 5, 6, 9, 7, 12, 14, 13, 8, 10, 11};
-      case Element::Type::Prism18:
-        return {0, 1, 2, 3, 4, 5, 6, 9, 7, 12, 14, 13, 8, 10, 11, 15, 17, 16};
-      case Element::Type::Hex20:
-        return {0, 1, 2, 3, 4, 5, 6, 7, 8, 11, 13, 9, 16, 18, 19, 17, 10, 12, 14, 15};
-      case Element::Type::Hex27:
-        return {0, 1, 2, 3, 4, 5, 6, 7, 8, 11, 13, 9, 16, 18, 19, 17, 10, 12, 14, 15, 22, 23, 21, 24, 20, 25, 26};
+      case Element::Type::Tet10:   return {tet10, 10};
+      case Element::Type::Pyr13:   return {pyr13, 13};
+      case Element::Type::Pyr14:   return {pyr14, 14};
+      case Element::Type::Prism15: return {prism15, 15};
+      case Element::Type::Prism18: return {prism18, 18};
+      case Element::Type::Hex20:   return {hex20, 20};
+      case Element::Type::Hex27:   return {hex27, 27};
     }
 
-    return {};
+    return {identity, 0};
   }
 
 }
\ No newline at end of file
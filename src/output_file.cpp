@@ -0,0 +1,55 @@
+#include "output_file.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MESH_HAVE_PWRITE
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+OutputFile::OutputFile(std::string filename, std::size_t size) : fd(-1), opened(false) {
+
+#ifdef MESH_HAVE_PWRITE
+  fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd == -1) return;
+
+  // setting the size up front means that writes past the current end 
+  // of the file don't have to extend it (which serializes them)
+  if (ftruncate(fd, off_t(size)) != 0) {
+    close(fd);
+    fd = -1;
+    return;
+  }
+  opened = true;
+#else
+  stream.open(filename, std::ios::binary | std::ios::trunc);
+  opened = bool(stream);
+  (void)size;
+#endif
+
+}
+
+bool OutputFile::write(std::size_t offset, const char * data, std::size_t bytes) {
+#ifdef MESH_HAVE_PWRITE
+  while (bytes > 0) {
+    ssize_t written = pwrite(fd, data, bytes, off_t(offset));
+    if (written < 0 && errno == EINTR) continue;
+    if (written <= 0) return false;
+    data += written;
+    offset += std::size_t(written);
+    bytes -= std::size_t(written);
+  }
+  return true;
+#else
+  std::lock_guard< std::mutex > lock(stream_mutex);
+  stream.seekp(std::streamoff(offset));
+  stream.write(data, std::streamsize(bytes));
+  return bool(stream);
+#endif
+}
+
+OutputFile::~OutputFile() {
+#ifdef MESH_HAVE_PWRITE
+  if (fd != -1) close(fd);
+#endif
+}
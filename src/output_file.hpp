@@ -0,0 +1,31 @@
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <fstream>
+#include <cstddef>
+
+// write-only file whose final size is known before anything is written, so 
+// that threads can fill in their own (disjoint) parts of it in any order. On
+// POSIX systems the pieces are written with pwrite. Elsewhere, they go 
+// through an ofstream, one write at a time.
+class OutputFile {
+ public:
+  OutputFile(std::string filename, std::size_t size);
+  ~OutputFile();
+
+  OutputFile(const OutputFile &) = delete;
+  OutputFile & operator=(const OutputFile &) = delete;
+
+  bool is_open() const { return opened; }
+
+  // write `bytes` bytes of `data` to the file, starting at byte `offset`.
+  // Returns false if the write failed (e.g. the disk is full).
+  bool write(std::size_t offset, const char * data, std::size_t bytes);
+
+ private:
+  int fd;
+  bool opened;
+  std::ofstream stream;
+  std::mutex stream_mutex;
+};
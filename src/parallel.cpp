@@ -0,0 +1,14 @@
+#include "parallel.hpp"
+
+namespace io {
+
+static int thread_count = 0;
+
+void set_num_threads(int n) { thread_count = n; }
+
+int get_num_threads() {
+  if (thread_count > 0) return thread_count;
+  return std::max(int(std::thread::hardware_concurrency()), 1);
+}
+
+}
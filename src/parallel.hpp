@@ -0,0 +1,49 @@
+#pragma once
+
+#include "mesh/io.hpp"
+
+#include <thread>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+
+// call f(i) for every i in [0, n), with the range split into 
+// contiguous pieces across (up to) io::get_num_threads() threads
+template < typename callable >
+void parallel_for(int64_t n, callable && f) {
+  int64_t num_workers = std::min< int64_t >(io::get_num_threads(), n);
+  if (num_workers <= 1) {
+    for (int64_t i = 0; i < n; i++) f(i);
+    return;
+  }
+
+  std::vector< std::thread > workers;
+  workers.reserve(num_workers);
+  for (int64_t w = 0; w < num_workers; w++) {
+    workers.emplace_back([&f, n, w, num_workers]() {
+      for (int64_t i = (n * w) / num_workers; i < (n * (w + 1)) / num_workers; i++) f(i);
+    });
+  }
+  for (auto & worker : workers) worker.join();
+}
+
+// number of pieces to split `bytes` of text into, so that each thread
+// gets one piece, but pieces aren't so small that threads aren't worth it
+inline int num_chunks(std::size_t bytes, std::size_t min_chunk_bytes = std::size_t(1) << 16) {
+  std::size_t n = std::min< std::size_t >(io::get_num_threads(), bytes / min_chunk_bytes);
+  return int(std::max< std::size_t >(n, 1));
+}
+
+// split [begin, end) into n pieces of roughly equal size, where every
+// piece starts at the beginning of a line. Piece i is [bounds[i], bounds[i+1]),
+// and some pieces may be empty if the lines are very long.
+inline std::vector< const char * > split_lines(const char * begin, const char * end, int n) {
+  std::vector< const char * > bounds(n + 1, end);
+  bounds[0] = begin;
+  for (int i = 1; i < n; i++) {
+    const char * target = std::max(begin + (end - begin) * i / n, bounds[i-1]);
+    const char * newline = static_cast< const char * >(std::memchr(target, '\n', std::size_t(end - target)));
+    bounds[i] = newline ? newline + 1 : end;
+  }
+  return bounds;
+}
@@ -1,338 +1,411 @@
 #include "mesh/io.hpp"
 
 #include "util.hpp"
-
+#include "weld.hpp"
+#include "boundary.hpp"
+#include "parallel.hpp"
+#include "mesh_view.hpp"
+#include "mapped_file.hpp"
+#include "buffer_reader.hpp"
+#include "tessellation.hpp"
+#include "output_file.hpp"
+#include "byte_order.hpp"
+
+#include <atomic>
+#include <limits>
+#include <cstring>
 #include <fstream>
+#include <string_view>
 
 using io::Element;
 
-// tessellation pattern for tri6 (1 tri6 -> 16 tri3)
-//
-// o
-// * *
-// *   *
-// *     *
-// * * * * *
-// * *     * *
-// *   *   *   *
-// *     * *     *
-// o * * * * * * * o
-// * *     * *     * *
-// *   *   *   *   *   *
-// *     * *     * *     *
-// * * * * * * * * * * * * *         
-// * *     * *     * *     * *
-// *   *   *   *   *   *   *   *
-// *     * *     * *     * *     *
-// o * * * * * * * o * * * * * * * o
-//
+// ascii files start with "solid", but so do the headers of some binary files,
+// so a file is binary if its size matches the triangle count in its header
+static bool is_binary_stl(const MappedFile & file) {
+  if (file.size() >= 84) {
+    uint32_t num_triangles;
+    std::memcpy(&num_triangles, file.data() + 80, sizeof(uint32_t));
+    if (is_big_endian) num_triangles = byte_swap(num_triangles);
+    if (84 + 50 * uint64_t(num_triangles) == file.size()) return true;
+  }
+  return !(file.size() >= 5 && std::string_view(file.data(), 5) == "solid");
+}
+
+// skip whitespace and then `keyword`, clearing in.ok if it isn't there
+static void expect(BufferReader & in, std::string_view keyword) {
+  in.skip_whitespace();
+  if (in.remaining() >= keyword.size() && std::memcmp(in.ptr, keyword.data(), keyword.size()) == 0) {
+    in.ptr += keyword.size();
+  } else {
+    in.ok = false;
+  }
+}
+
+static bool starts_with(const BufferReader & in, std::string_view keyword) {
+  return in.remaining() >= keyword.size() && std::memcmp(in.ptr, keyword.data(), keyword.size()) == 0;
+}
+
+// the facets are of the form
 //
-// tessellation pattern for Quad8, Quad9 (1 Quad8/9 -> 32 tri3)
+//   facet normal nx ny nz
+//     outer loop
+//       vertex x y z
+//       vertex x y z
+//       vertex x y z
+//     endloop
+//   endfacet
 //
-// o * * * * * * * o * * * * * * * o
-// * *     * *     *     * *     * *
-// *   *   *   *   *   *   *   *   *
-// *     * *     * * *     * *     *
-// * * * * * * * * * * * * * * * * *
-// * *     * *     *     * *     * *
-// *   *   *   *   *   *   *   *   *
-// *     * *     * * *     * *     *
-// o * * * * * * *(o)* * * * * * * o
-// *     * *     * * *     * *     *
-// *   *   *   *   *   *   *   *   *
-// * *     * *     *     * *     * *
-// * * * * * * * * * * * * * * * * *
-// *     * *     * * *     * *     *
-// *   *   *   *   *   *   *   *   *
-// * *     * *     *     * *     * *
-// o * * * * * * * o * * * * * * * o
-
-int triangles_per_element(Element::Type type){
-  switch (type) {
-    case Element::Type::Line2:       return 0;
-    case Element::Type::Line3:       return 0;
-    case Element::Type::Tri3:        return 1;
-    case Element::Type::Tri6:        return 16;
-    case Element::Type::Quad4:       return 4;
-    case Element::Type::Quad8:       return 32;
-    case Element::Type::Quad9:       return 32;
-    case Element::Type::Tet4:        return 0;
-    case Element::Type::Tet10:       return 0;
-    case Element::Type::Pyr5:        return 0;
-    case Element::Type::Pyr13:       return 0;
-    case Element::Type::Pyr14:       return 0;
-    case Element::Type::Prism6:      return 0;
-    case Element::Type::Prism15:     return 0;
-    case Element::Type::Prism18:     return 0;
-    case Element::Type::Hex8:        return 0;
-    case Element::Type::Hex20:       return 0;
-    case Element::Type::Hex27:       return 0;
-    case Element::Type::Unsupported: return -1;
+// and some files have several "solid name ... endsolid name" sections
+static bool read_ascii_facets(BufferReader & in, std::vector< std::array< double, 3 > > & vertices) {
+  while (true) {
+    in.skip_whitespace();
+    if (in.done()) break;
+    if (starts_with(in, "endsolid") || starts_with(in, "solid")) {
+      in.next_line();
+      continue;
+    }
+    expect(in, "facet");
+    expect(in, "normal");
+    for (int i = 0; i < 3; i++) in.real< double >(); // discard normal values
+    expect(in, "outer");
+    expect(in, "loop");
+    for (int i = 0; i < 3; i++) {
+      expect(in, "vertex");
+      double x = in.real< double >();
+      double y = in.real< double >();
+      double z = in.real< double >();
+      vertices.push_back({x, y, z});
+    }
+    expect(in, "endloop");
+    expect(in, "endfacet");
+    if (!in.ok) return false;
   }
-  return -1;
+  return true;
 }
 
-using Triangle = std::array<vec3f, 3>;
-
-std::vector< Triangle > tessellate_quad(const vec3f p[5][5]) {
-
-  std::vector< Triangle > output;
-  output.reserve(32);
-  for (int i = 0; i < 4; i++) {
-    for (int j = 0; j < 4; j++) {
-      vec3f q[4] = {p[i][j], p[i+1][j], p[i+1][j+1], p[i][j+1]};
-
-      // j       
-      // ^       
-      // |       
-      // 1 1 0 0 
-      // 1 1 0 0 
-      // 0 0 1 1
-      // 0 0 1 1 --> i
-      int offset = (i / 2) ^ (j / 2);
-
-      // offset = 0   offset = 1
-      //  3 * * 2      3 * * 2
-      //  *   * *      * *   * 
-      //  * *   *      *   * *
-      //  0 * * 1      0 * * 1 
-      output.push_back({q[0], q[1], q[2+offset]});
-      output.push_back({q[2], q[3], q[0+offset]});
-    }
+// the start of the first facet at or after p (or end), where a facet starts with
+// the word "facet" (which excludes the "facet" in "endfacet")
+static const char * next_facet(const char * p, const char * begin, const char * end) {
+  std::string_view text(begin, std::size_t(end - begin));
+  for (std::size_t i = std::size_t(p - begin); (i = text.find("facet", i)) != std::string_view::npos; i += 5) {
+    bool word_start = (i == 0 || BufferReader::is_space(text[i - 1]));
+    bool word_end = (i + 5 < text.size() && BufferReader::is_space(text[i + 5]));
+    if (word_start && word_end) return begin + i;
   }
-  return output;
+  return end;
+}
 
+// the number of facets in [begin, end), estimated from the size of the first one
+static std::size_t estimate_facets(const char * begin, const char * end) {
+  const char * first = next_facet(begin, begin, end);
+  const char * second = next_facet(first + 1, begin, end);
+  if (second == end) return 1;
+  return std::size_t(end - begin) / std::size_t(second - first) + 1;
 }
 
-std::vector< Triangle > tessellate(Element::Type type, const vec3f * p) {
-
-  switch (type) {
-
-    case Element::Type::Tri3: return {{p[0], p[1], p[2]}};
-
-    case Element::Type::Tri6: {
-      float xi[2];
-      vec3f n[5][5];
-      for (int j = 0; j < 5; j++) {
-        xi[1] = j * 0.25f;
-        for (int i = 0; i < 5; i++) {
-          xi[0] = i * 0.25f;
-          n[i][j] = p[0] * (1 - xi[0] - xi[1]) * (1 - 2 * xi[0] - 2 * xi[1]) +
-                    p[1] * xi[0] * (2 * xi[0] - 1)                           +
-                    p[2] * xi[1] * (2 * xi[1] - 1)                           +
-                    p[3] * 4 * xi[0] * (1 - xi[0] - xi[1])                   +
-                    p[4] * 4 * xi[0] * xi[1]                                 +
-                    p[5] * 4 * xi[1] * (1 - xi[0] - xi[1]);
-        }
-      }
-
-      std::vector< Triangle > output;
-      output.reserve(16);
-      for (int j = 0; j < 4; j++) {
-        for (int i = 0; i < 4 - j; i++) {
-          vec3f q[4] = {n[i][j], n[i+1][j], n[i+1][j+1], n[i][j+1]};
-          output.push_back({q[0], q[1], q[3]});
-          if ((i + j) < 3) { output.push_back({q[1], q[2], q[3]}); }
-        }
-      }
-      return output;
-    }
+static void read_ascii_stl(const MappedFile & file, std::vector< std::array< double, 3 > > & vertices) {
 
-    case Element::Type::Quad4: {
-      vec3f c = (p[0] + p[1] + p[2] + p[3]) * 0.25f;
-      return {{p[0], p[1], c}, {p[1], p[2], c}, {p[2], p[3], c}, {p[3], p[0], c}};
-    }
+  BufferReader in{file.begin(), file.end()};
+  in.next_line(); // skip "solid name"
 
-    case Element::Type::Quad8: {
-
-      float xi[2];
-      vec3f n[5][5];
-      for (int i = 0; i < 5; i++) {
-        xi[0] = -1.0f + i * 0.5f;
-        for (int j = 0; j < 5; j++) {
-          xi[1] = -1.0f + j * 0.5f;
-          n[i][j] = p[0] * (1 - xi[0]) * (1 - xi[1]) * (1 + xi[0] + xi[1]) * (-0.25f) +
-                    p[1] * (1 + xi[0]) * (1 - xi[1]) * (1 - xi[0] + xi[1]) * (-0.25f) +
-                    p[2] * (1 + xi[0]) * (1 + xi[1]) * (1 - xi[0] - xi[1]) * (-0.25f) +
-                    p[3] * (1 - xi[0]) * (1 + xi[1]) * (1 + xi[0] - xi[1]) * (-0.25f) +
-                    p[4] * (1 - xi[0] * xi[0]) * (1 - xi[1]) * (0.5f) +
-                    p[5] * (1 + xi[0]) * (1 - xi[1] * xi[1]) * (0.5f) +
-                    p[6] * (1 - xi[0] * xi[0]) * (1 + xi[1]) * (0.5f) +
-                    p[7] * (1 - xi[0]) * (1 - xi[1] * xi[1]) * (0.5f);
-        }
-      }
+  // the facets are split into pieces for each thread, which are read
+  // into their own arrays (sized with some slack, so they rarely grow) 
+  int n = num_chunks(in.remaining());
+  std::vector< const char * > bounds(n + 1, in.end);
+  bounds[0] = in.ptr;
+  for (int i = 1; i < n; i++) {
+    const char * target = std::max(in.ptr + (in.remaining() * i) / n, bounds[i-1]);
+    bounds[i] = next_facet(target, in.ptr, in.end);
+  }
 
-      return tessellate_quad(n);
+  std::vector< std::vector< std::array< double, 3 > > > chunk_vertices(n);
+  std::vector< char > ok(n, true);
+  parallel_for(n, [&](int64_t i) {
+    auto & v = (n == 1) ? vertices : chunk_vertices[i];
+    std::size_t estimate = estimate_facets(bounds[i], bounds[i+1]);
+    v.reserve(3 * (estimate + estimate / 8));
+    BufferReader chunk{bounds[i], bounds[i+1]};
+    ok[i] = read_ascii_facets(chunk, v);
+  });
+
+  if (std::find(ok.begin(), ok.end(), false) != ok.end()) exit_with_error("invalid file format (stl)");
+
+  if (n > 1) {
+    std::vector< std::size_t > offsets(n + 1, 0);
+    for (int i = 0; i < n; i++) offsets[i + 1] = offsets[i] + chunk_vertices[i].size();
+    vertices.resize(offsets[n]);
+    parallel_for(n, [&](int64_t i) {
+      std::copy(chunk_vertices[i].begin(), chunk_vertices[i].end(), vertices.begin() + offsets[i]);
+      std::vector< std::array< double, 3 > >().swap(chunk_vertices[i]);
+    });
+  }
 
-    }
+}
 
-    case Element::Type::Quad9: {
-
-      constexpr float phi[5][3] = {{ 1.000, 0.000,  0.000}, 
-                                   { 0.375, 0.750, -0.125}, 
-                                   { 0.000, 1.000,  0.000}, 
-                                   {-0.125, 0.750,  0.375}, 
-                                   { 0.000, 0.000,  1.000}};
-
-      vec3f n[5][5];
-      for (int i = 0; i < 5; i++) {
-        for (int j = 0; j < 5; j++) {
-          n[i][j] = p[0] * phi[i][0] * phi[j][0] +
-                    p[1] * phi[i][2] * phi[j][0] +
-                    p[2] * phi[i][2] * phi[j][2] +
-                    p[3] * phi[i][0] * phi[j][2] +
-                    p[4] * phi[i][1] * phi[j][0] +
-                    p[5] * phi[i][2] * phi[j][1] +
-                    p[6] * phi[i][1] * phi[j][2] +
-                    p[7] * phi[i][0] * phi[j][1] +
-                    p[8] * phi[i][1] * phi[j][1];
-        }
-      }
+// a binary file is an 80-byte header, the number of triangles (uint32_t), 
+// and then a 50-byte record for every triangle, of the form:
+//
+//   float normal[3], float vertices[3][3], uint16_t attributes
+//
+// all little-endian. The records have a fixed size, so they're 
+// decoded in parallel, straight into their final slots.
+static constexpr std::size_t stl_record_bytes = 50;
+
+static void read_binary_stl(const MappedFile & file, std::vector< std::array< double, 3 > > & vertices) {
+
+  if (file.size() < 84) exit_with_error("invalid file format (stl)");
+
+  uint32_t num_triangles;
+  std::memcpy(&num_triangles, file.data() + 80, sizeof(uint32_t));
+  if (is_big_endian) num_triangles = byte_swap(num_triangles);
+  if (file.size() < 84 + stl_record_bytes * std::size_t(num_triangles)) exit_with_error("invalid file format (stl)");
+
+  const char * records = file.data() + 84;
+  vertices.resize(3 * std::size_t(num_triangles));
+  parallel_for(num_triangles, [&](int64_t i) {
+    float v[9];
+    std::memcpy(v, records + stl_record_bytes * i + 3 * sizeof(float), sizeof(v)); // skip the normal
+    if (is_big_endian) byte_swap(v, 9);
+    for (int j = 0; j < 3; j++) {
+      vertices[3 * i + j] = {v[3 * j], v[3 * j + 1], v[3 * j + 2]};
+    }
+  });
 
-      return tessellate_quad(n);
+}
 
-    } 
+// triangle i has vertices 3i, 3i+1 and 3i+2, which are nodes node_id(3i), ...
+template < typename callable >
+static void set_triangles(io::Mesh & mesh, int64_t num_triangles, callable && node_id) {
+  mesh.elements.resize(num_triangles);
+  parallel_for(num_triangles, [&](int64_t i) {
+    auto & e = mesh.elements[i];
+    e.type = Element::Type::Tri3;
+    e.node_ids = {int(node_id(3 * i)), int(node_id(3 * i + 1)), int(node_id(3 * i + 2))};
+  });
+}
 
-    default: return {};
-  }
+template < typename index_t, typename callable >
+static void set_triangles(io::FlatMesh< index_t > & mesh, int64_t num_triangles, callable && node_id) {
+  mesh.types.assign(num_triangles, Element::Type::Tri3);
+  mesh.offsets.resize(num_triangles + 1);
+  mesh.tag_offsets.assign(num_triangles + 1, 0);
+  mesh.connectivity.resize(3 * num_triangles);
+  parallel_for(num_triangles + 1, [&](int64_t i) { mesh.offsets[i] = index_t(3 * i); });
+  parallel_for(3 * num_triangles, [&](int64_t i) { mesh.connectivity[i] = index_t(node_id(i)); });
+  mesh.rebuild_blocks();
 }
 
 namespace io {
 
-Mesh import_stl(std::string filename) {
+template < typename mesh_t >
+mesh_t import_stl(std::string filename) {
+  return import_stl< mesh_t >(filename, StlOptions{});
+}
 
-  Mesh mesh;
+template < typename mesh_t >
+mesh_t import_stl(std::string filename, const StlOptions & options) {
 
-  std::ifstream infile(filename);
+  MappedFile file(filename);
 
-  if (!infile) {
+  if (!file.is_open()) {
     std::cout << "error: " << filename << " not found" << std::endl;
     exit(1);
   }
 
-  std::string line;
-
-  /////////////////
-  // read header //
-  /////////////////
-  char header[80];
-  infile.read(header, 5);
-
-  if (std::string(header, header+5) == "solid") {
-    // ASCII format
-    getline(infile, line); // skip the rest of the first line
-
-    auto expect = [](const std::string & tok, const std::string & str) {
-      if (tok != str) {
-        std::cout << "expected '" << str << "', but got '" << tok << "'" << std::endl;
-      }
-    };
+  std::vector< std::array< double, 3 > > vertices;
+  if (is_binary_stl(file)) {
+    read_binary_stl(file, vertices);
+  } else {
+    read_ascii_stl(file, vertices);
+  }
 
-    double unused;
-    int count = 0;
-    std::array< double, 3 > coords;
-
-    std::string word;
-    infile >> word;
-
-    while(word != "endsolid") {
-      expect(word, "facet"); 
-      infile >> word; expect(word, "normal");
-      infile >> unused >> unused >> unused; // discard normal values
-        infile >> word; expect(word, "outer"); 
-        infile >> word; expect(word, "loop");
-          infile >> word; expect(word, "vertex");
-          infile >> coords[0] >> coords[1] >> coords[2];
-          mesh.nodes.push_back(coords);
-          infile >> word; expect(word, "vertex");
-          infile >> coords[0] >> coords[1] >> coords[2];
-          mesh.nodes.push_back(coords);
-          infile >> word; expect(word, "vertex");
-          infile >> coords[0] >> coords[1] >> coords[2];
-          mesh.nodes.push_back(coords);
-          mesh.elements.push_back({Element::Type::Tri3, {count, count+1, count+2}, {}});
-          count += 3;
-        infile >> word; expect(word, "endloop");
-      infile >> word; expect(word, "endfacet");
-      infile >> word;
-    }
+  int64_t num_triangles = int64_t(vertices.size() / 3);
+  if (uint64_t(vertices.size()) > uint64_t(std::numeric_limits< index_type_t< mesh_t > >::max())) {
+    exit_with_error("too many vertices for 32-bit node ids, use FlatMesh< int64_t >");
+  }
 
+  mesh_t mesh;
+  if (options.weld) {
+    auto new_ids = weld_vertices< index_type_t< mesh_t > >(vertices, options.tolerance);
+    set_triangles(mesh, num_triangles, [&](int64_t i) { return new_ids[i]; });
   } else {
-    // binary format
-    infile.read(header+5, 75); // skip the rest of the 80-byte header
-
-    int num_triangles;
-    infile.read((char*)&num_triangles, sizeof(int));
-
-    vec3f normal;
-    vec3f v[3];
-    uint16_t attributes;
-    for (int i = 0; i < num_triangles; i++) {
-      infile.read((char *)&normal, sizeof(vec3f)); // unused
-      infile.read((char *)&v[0],   sizeof(vec3f));
-      infile.read((char *)&v[1],   sizeof(vec3f));
-      infile.read((char *)&v[2],   sizeof(vec3f));
-      infile.read((char *)&attributes, 2); // unused
-
-      mesh.nodes.push_back({v[0][0], v[0][1], v[0][2]});
-      mesh.nodes.push_back({v[1][0], v[1][1], v[1][2]});
-      mesh.nodes.push_back({v[2][0], v[2][1], v[2][2]});
-      mesh.elements.push_back({Element::Type::Tri3, {3*i, 3*i+1, 3*i+2}, {}});
-    }
+    set_triangles(mesh, num_triangles, [](int64_t i) { return i; });
   }
+  mesh.nodes = std::move(vertices);
 
   return mesh;
 
 }
 
-bool export_stl(const Mesh & mesh, std::string filename) {
+template Mesh import_stl(std::string);
+template FlatMesh< int32_t > import_stl(std::string);
+template FlatMesh< int64_t > import_stl(std::string);
+
+template Mesh import_stl(std::string, const StlOptions &);
+template FlatMesh< int32_t > import_stl(std::string, const StlOptions &);
+template FlatMesh< int64_t > import_stl(std::string, const StlOptions &);
+
+// the exporter tessellates the elements in ranges of this many (in parallel), and each 
+// range collects its triangles in a buffer of about this size between writes to the file
+static constexpr int64_t elements_per_range = int64_t(1) << 14;
+static constexpr std::size_t buffer_bytes = std::size_t(1) << 20;
+
+// in the adaptive mode, each quadratic element gets its own number of subdivisions
+template < typename mesh_t >
+static std::vector< uint8_t > choose_subdivisions(const mesh_t & elements, 
+                                                  const std::vector< std::array< double, 3 > > & nodes, 
+                                                  const io::StlExportOptions & options) {
+  std::vector< uint8_t > subdivisions(num_elements(elements), 1);
+  parallel_for(int64_t(subdivisions.size()), [&](int64_t i) {
+    auto e = element(elements, std::size_t(i));
+    if (!is_quadratic_surface(e.type)) return;
+    std::array< double, 3 > x[9];
+    for (int j = 0; j < e.num_nodes; j++) x[j] = nodes[e.node_ids[j]];
+    double error = chord_error(e.type, x);
+    subdivisions[i] = uint8_t(subdivisions_for(error, options.chord_tolerance, options.max_subdivisions));
+  });
+  return subdivisions;
+}
 
-  std::ofstream outfile(filename, std::ios::binary);
+template < typename mesh_t >
+static bool export_stl_impl(const mesh_t & mesh, std::string filename, const io::StlExportOptions & options) {
 
-  // header: 80 bytes
-  uint8_t header[80];
-  outfile.write((char*)&header[0], 80);
+  bool adaptive = options.chord_tolerance > 0.0;
+  int limit = adaptive ? options.max_subdivisions : options.subdivisions;
+  if (limit < 1 || limit > max_subdivisions) {
+    exit_with_error("export_stl: the number of subdivisions must be between 1 and " + std::to_string(max_subdivisions));
+  }
+
+  // volume elements are written as the faces on their exterior (except 
+  // for the ones that are already in the mesh as surface elements)
+  auto faces = boundary_faces(mesh, true);
+  int64_t num_surfaces = int64_t(num_elements(mesh));
+  int64_t n = num_surfaces + int64_t(num_elements(faces));
+  auto with_element = [&](int64_t i, auto && f) {
+    if (i < num_surfaces) {
+      f(element(mesh, std::size_t(i)));
+    } else {
+      f(element(faces, std::size_t(i - num_surfaces)));
+    }
+  };
 
-  // 4 bytes to encode number of triangles
-  uint32_t num_triangles = 0;
-  for (auto & e : mesh.elements) {
-    num_triangles += triangles_per_element(e.type);
+  std::vector< uint8_t > subdivisions;
+  if (adaptive) {
+    subdivisions = choose_subdivisions(mesh, mesh.nodes, options);
+    std::vector< uint8_t > face_subdivisions = choose_subdivisions(faces, mesh.nodes, options);
+    subdivisions.insert(subdivisions.end(), face_subdivisions.begin(), face_subdivisions.end());
   }
-  outfile.write((char*)&num_triangles, 4);
+  auto subdivisions_of = [&](int64_t i) { return adaptive ? int(subdivisions[i]) : options.subdivisions; };
+
+  // the elements are tessellated in ranges, in parallel. Every element's 
+  // number of triangles is known up front, so a prefix sum over the ranges
+  // gives where each range's triangles go in the file.
+  int64_t num_ranges = (n + elements_per_range - 1) / elements_per_range;
+  auto range_begin = [&](int64_t r) { return std::min(r * elements_per_range, n); };
+  std::vector< uint64_t > first_triangle(num_ranges + 1, 0);
+  parallel_for(num_ranges, [&](int64_t r) {
+    for (int64_t i = range_begin(r); i < range_begin(r + 1); i++) {
+      with_element(i, [&](auto e) {
+        first_triangle[r + 1] += uint64_t(std::max(triangles_per_element(e.type, subdivisions_of(i)), 0));
+      });
+    }
+  });
+  for (int64_t r = 0; r < num_ranges; r++) first_triangle[r + 1] += first_triangle[r];
 
-  // unused here, but part of the STL file specification
-  uint16_t attributes; 
+  uint64_t total_triangles = first_triangle[num_ranges];
+  if (total_triangles > UINT32_MAX) {
+    exit_with_error("too many triangles for the STL format (limit is 2^32 - 1)");
+  }
 
-  constexpr int max_nodes = 27;
-  vec3f nodes[max_nodes]; 
+  OutputFile outfile(filename, 84 + 50 * total_triangles);
+  if (!outfile.is_open()) {
+    exit_with_error("export_stl: unable to open " + filename);
+  }
 
-  for (auto & e : mesh.elements) {
+  // header: 80 bytes (left blank), and 4 bytes for the number of triangles
+  char header[84] = {};
+  uint32_t num_triangles = uint32_t(total_triangles);
+  copy_to_little_endian(&num_triangles, 1, header + 80);
+  bool ok = outfile.write(0, header, 84);
+
+  std::atomic< bool > failed(!ok);
+  parallel_for(num_ranges, [&](int64_t r) {
+
+    // records are collected in a buffer, and written once it's full
+    std::size_t offset = 84 + 50 * first_triangle[r];
+    std::size_t used = 0;
+    std::vector< char > buffer(buffer_bytes + 50 * tessellation_batch_size * max_triangles_per_element);
+    auto write_buffer = [&]() {
+      if (used > 0 && !outfile.write(offset, buffer.data(), used)) failed = true;
+      offset += used;
+      used = 0;
+    };
 
-    // load the nodes for this element
-    for (int i = 0; i < nodes_per_elem(e.type); i++) {
-      for (int j = 0; j < 3; j++) {
-        nodes[i][j] = mesh.nodes[e.node_ids[i]][j];
-      }
-    }
+    // consecutive elements of the same type (and subdivisions) are tessellated together
+    TessellationBatch batch;
+    auto flush = [&]() {
+      used += tessellate(batch, buffer.data() + used);
+      batch.count = 0;
+      if (used >= buffer_bytes) write_buffer();
+    };
 
-    auto triangles = tessellate(e.type, nodes);
+    for (int64_t i = range_begin(r); i < range_begin(r + 1); i++) {
+      with_element(i, [&](auto e) {
 
-    for (auto & [p0, p1, p2] : triangles) {
-      vec3f n = normalize(cross(p1 - p0, p2 - p0));
+        int subdivisions = subdivisions_of(i);
 
-      outfile.write((char *)&n,  sizeof(vec3f));
-      outfile.write((char *)&p0, sizeof(vec3f));
-      outfile.write((char *)&p1, sizeof(vec3f));
-      outfile.write((char *)&p2, sizeof(vec3f));
-      outfile.write((char *)&attributes, 2);
+        // skip lines and volume elements 
+        if (triangles_per_element(e.type) <= 0) return;
+
+        if (batch.count == tessellation_batch_size || 
+            (batch.count > 0 && (batch.type != e.type || batch.subdivisions != subdivisions))) flush();
+
+        batch.type = e.type;
+        batch.subdivisions = subdivisions;
+        for (int k = 0; k < e.num_nodes; k++) {
+          for (int j = 0; j < 3; j++) {
+            batch.x[k][j][batch.count] = float(mesh.nodes[e.node_ids[k]][j]);
+          }
+        }
+        batch.count++;
+
+      });
     }
+    flush();
+    write_buffer();
 
-  }
+  });
 
-  outfile.close();
+  if (failed) {
+    exit_with_error("export_stl: unable to write " + filename);
+  }
 
   return false;
 
 }
 
-} // namespace io
\ No newline at end of file
+bool export_stl(const Mesh & mesh, std::string filename) {
+  return export_stl_impl(mesh, filename, StlExportOptions{});
+}
+
+bool export_stl(const Mesh & mesh, std::string filename, const StlExportOptions & options) {
+  return export_stl_impl(mesh, filename, options);
+}
+
+template < typename index_t >
+bool export_stl(const FlatMesh< index_t > & mesh, std::string filename) {
+  return export_stl_impl(mesh, filename, StlExportOptions{});
+}
+
+template < typename index_t >
+bool export_stl(const FlatMesh< index_t > & mesh, std::string filename, const StlExportOptions & options) {
+  return export_stl_impl(mesh, filename, options);
+}
+
+template bool export_stl(const FlatMesh< int32_t > &, std::string);
+template bool export_stl(const FlatMesh< int64_t > &, std::string);
+
+template bool export_stl(const FlatMesh< int32_t > &, std::string, const StlExportOptions &);
+template bool export_stl(const FlatMesh< int64_t > &, std::string, const StlExportOptions &);
+
+} // namespace io
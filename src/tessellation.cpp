@@ -0,0 +1,207 @@
+#include "tessellation.hpp"
+
+#include "byte_order.hpp"
+#include "mesh_view.hpp"
+#include "util.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <type_traits>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define MESH_X86_SIMD
+#endif
+
+using io::Element;
+
+// one value per element of a batch
+using lanes = float __attribute__((vector_size(sizeof(float) * tessellation_batch_size)));
+
+// the samples and normals are evaluated for the whole batch at once, as 
+// small matrix products with the (constant) weights, and then transposed 
+// into the records of each element
+template < Element::Type T, int n >
+__attribute__((always_inline))
+inline std::size_t tessellate_batch(const TessellationBatch & batch, char * output) {
+  constexpr auto & pattern = tessellation_pattern< T, n >;
+  using pattern_t = std::decay_t< decltype(pattern) >;
+
+  lanes x[pattern_t::num_nodes][3];
+  std::memcpy(x, batch.x, sizeof(x));
+
+  lanes samples[pattern_t::num_samples][3];
+  for (int i = 0; i < pattern_t::num_samples; i++) {
+    for (int d = 0; d < 3; d++) {
+      lanes sum = {};
+      for (int j = 0; j < pattern_t::num_nodes; j++) {
+        if (pattern.weights[i][j] != 0.0f) sum += pattern.weights[i][j] * x[j][d];
+      }
+      samples[i][d] = sum;
+    }
+  }
+
+  lanes normals[pattern_t::num_triangles][3];
+  for (int t = 0; t < pattern_t::num_triangles; t++) {
+    const lanes * p0 = samples[pattern.triangles[t][0]];
+    const lanes * p1 = samples[pattern.triangles[t][1]];
+    const lanes * p2 = samples[pattern.triangles[t][2]];
+    lanes u[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+    lanes v[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+    lanes normal[3] = {
+      u[1] * v[2] - u[2] * v[1],
+      u[2] * v[0] - u[0] * v[2],
+      u[0] * v[1] - u[1] * v[0]
+    };
+    lanes norm = normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2];
+    for (int k = 0; k < tessellation_batch_size; k++) norm[k] = std::sqrt(norm[k]);
+    lanes scale = 1.0f / norm;
+    for (int d = 0; d < 3; d++) normals[t][d] = normal[d] * scale;
+  }
+
+  char * record = output;
+  for (int k = 0; k < batch.count; k++) {
+    for (int t = 0; t < pattern_t::num_triangles; t++) {
+      const lanes * p0 = samples[pattern.triangles[t][0]];
+      const lanes * p1 = samples[pattern.triangles[t][1]];
+      const lanes * p2 = samples[pattern.triangles[t][2]];
+      float values[13] = { // the last 2 bytes are the unused attributes
+        normals[t][0][k], normals[t][1][k], normals[t][2][k],
+        p0[0][k], p0[1][k], p0[2][k],
+        p1[0][k], p1[1][k], p1[2][k],
+        p2[0][k], p2[1][k], p2[2][k],
+        0.0f
+      };
+      std::memcpy(record, values, 50);
+      record += 50;
+    }
+  }
+
+  // STL files are little-endian
+  if (is_big_endian) {
+    for (char * r = output; r < record; r += 50) byte_swap(r, r, 12, sizeof(float));
+  }
+
+  return std::size_t(record - output);
+}
+
+template < Element::Type T, int n >
+static std::size_t tessellate_generic(const TessellationBatch & batch, char * output) {
+  return tessellate_batch< T, n >(batch, output);
+}
+
+#ifdef MESH_X86_SIMD
+// the same code, but with 8-wide registers (and no FMA, so the results 
+// are the same as tessellate_generic's, bit for bit)
+template < Element::Type T, int n >
+__attribute__((target("avx2")))
+static std::size_t tessellate_avx2(const TessellationBatch & batch, char * output) {
+  return tessellate_batch< T, n >(batch, output);
+}
+#endif
+
+template < Element::Type T, int n >
+static std::size_t tessellate_dispatch(const TessellationBatch & batch, char * output) {
+  static_assert(tessellation_pattern< T, n >.num_triangles == triangles_per_element(T, n));
+#ifdef MESH_X86_SIMD
+  static const bool has_avx2 = __builtin_cpu_supports("avx2");
+  if (has_avx2) return tessellate_avx2< T, n >(batch, output);
+#endif
+  return tessellate_generic< T, n >(batch, output);
+}
+
+// calls f(std::integral_constant< int, n >{}) for n = subdivisions
+template < typename callable >
+static void dispatch_subdivisions(int subdivisions, callable && f) {
+  static_assert(max_subdivisions == 8);
+  switch (subdivisions) {
+    case 1: f(std::integral_constant< int, 1 >{}); break;
+    case 2: f(std::integral_constant< int, 2 >{}); break;
+    case 3: f(std::integral_constant< int, 3 >{}); break;
+    case 4: f(std::integral_constant< int, 4 >{}); break;
+    case 5: f(std::integral_constant< int, 5 >{}); break;
+    case 6: f(std::integral_constant< int, 6 >{}); break;
+    case 7: f(std::integral_constant< int, 7 >{}); break;
+    case 8: f(std::integral_constant< int, 8 >{}); break;
+    default: exit_with_error("unsupported number of subdivisions: " + std::to_string(subdivisions));
+  }
+}
+
+std::size_t tessellate(const TessellationBatch & batch, char * output) {
+  std::size_t bytes = 0;
+  dispatch(batch.type, [&](auto type) {
+    constexpr Element::Type T = decltype(type)::value;
+    if constexpr (is_quadratic_surface(T)) {
+      dispatch_subdivisions(batch.subdivisions, [&](auto n) {
+        bytes = tessellate_dispatch< T, decltype(n)::value >(batch, output);
+      });
+    } else if constexpr (triangles_per_element(T) > 0) {
+      bytes = tessellate_dispatch< T, 1 >(batch, output);
+    }
+  });
+  return bytes;
+}
+
+using vec3 = std::array< double, 3 >;
+
+static vec3 operator-(const vec3 & u, const vec3 & v) { return {u[0] - v[0], u[1] - v[1], u[2] - v[2]}; }
+static double dot(const vec3 & u, const vec3 & v) { return u[0] * v[0] + u[1] * v[1] + u[2] * v[2]; }
+
+// the distance from the parabola through a, m, b (in that order) to the line through a and b, 
+// which is the part of m - (a + b) / 2 that's perpendicular to that line
+static double edge_error(const vec3 & a, const vec3 & m, const vec3 & b) {
+  vec3 d = {m[0] - 0.5 * (a[0] + b[0]), m[1] - 0.5 * (a[1] + b[1]), m[2] - 0.5 * (a[2] + b[2])};
+  vec3 t = b - a;
+  double tt = dot(t, t);
+  if (tt > 0.0) {
+    double s = dot(d, t) / tt;
+    for (int i = 0; i < 3; i++) d[i] -= s * t[i];
+  }
+  return std::sqrt(dot(d, d));
+}
+
+// the distance from p to the plane through a, b, c
+static double plane_distance(const vec3 & p, const vec3 & a, const vec3 & b, const vec3 & c) {
+  vec3 n = cross(b - a, c - a);
+  double nn = dot(n, n);
+  return (nn > 0.0) ? std::abs(dot(p - a, n)) / std::sqrt(nn) : 0.0;
+}
+
+double chord_error(Element::Type type, const vec3 * x) {
+  double error = 0.0;
+  dispatch(type, [&](auto t) {
+    constexpr Element::Type T = decltype(t)::value;
+    if constexpr (is_quadratic_surface(T)) {
+      constexpr bool is_tri = (T == Element::Type::Tri6);
+      constexpr int num_corners = is_tri ? 3 : 4;
+      for (int i = 0; i < num_corners; i++) {
+        error = std::max(error, edge_error(x[i], x[num_corners + i], x[(i + 1) % num_corners]));
+      }
+
+      // the interior is checked at the samples of the default tessellation
+      constexpr auto & pattern = tessellation_pattern< T, 4 >;
+      for (int i = 0; i < pattern.num_samples; i++) {
+        vec3 p = {0.0, 0.0, 0.0};
+        for (int j = 0; j < pattern.num_nodes; j++) {
+          for (int d = 0; d < 3; d++) p[d] += double(pattern.weights[i][j]) * x[j][d];
+        }
+        double distance;
+        if constexpr (is_tri) {
+          distance = plane_distance(p, x[0], x[1], x[2]);
+        } else {
+          // sample 5 * i + j is at xi = (i / 4, j / 4), where the corner 
+          // triangle (0, 1, 2) covers j <= i, and (2, 3, 0) covers j >= i
+          distance = (i % 5 <= i / 5) ? plane_distance(p, x[0], x[1], x[2]) : plane_distance(p, x[2], x[3], x[0]);
+        }
+        error = std::max(error, distance);
+      }
+    }
+  });
+  return error;
+}
+
+int subdivisions_for(double error, double tolerance, int max) {
+  if (!(error > tolerance)) return 1;
+  double n = std::ceil(std::sqrt(error / tolerance));
+  return (n < max) ? int(n) : max;
+}
@@ -0,0 +1,280 @@
+#pragma once
+
+#include "mesh/io.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// quadratic surface elements are tessellated by subdividing each of their 
+// edges `subdivisions` times, and linear ones always use the same pattern
+constexpr int max_subdivisions = 8;
+
+// tessellation pattern for tri6, with 4 subdivisions (1 tri6 -> 16 tri3)
+//
+// o
+// * *
+// *   *
+// *     *
+// * * * * *
+// * *     * *
+// *   *   *   *
+// *     * *     *
+// o * * * * * * * o
+// * *     * *     * *
+// *   *   *   *   *   *
+// *     * *     * *     *
+// * * * * * * * * * * * * *         
+// * *     * *     * *     * *
+// *   *   *   *   *   *   *   *
+// *     * *     * *     * *     *
+// o * * * * * * * o * * * * * * * o
+//
+//
+// tessellation pattern for Quad8, Quad9, with 4 subdivisions (1 Quad8/9 -> 32 tri3)
+//
+// o * * * * * * * o * * * * * * * o
+// * *     * *     *     * *     * *
+// *   *   *   *   *   *   *   *   *
+// *     * *     * * *     * *     *
+// * * * * * * * * * * * * * * * * *
+// * *     * *     *     * *     * *
+// *   *   *   *   *   *   *   *   *
+// *     * *     * * *     * *     *
+// o * * * * * * *(o)* * * * * * * o
+// *     * *     * * *     * *     *
+// *   *   *   *   *   *   *   *   *
+// * *     * *     *     * *     * *
+// * * * * * * * * * * * * * * * * *
+// *     * *     * * *     * *     *
+// *   *   *   *   *   *   *   *   *
+// * *     * *     *     * *     * *
+// o * * * * * * * o * * * * * * * o
+
+constexpr int triangles_per_element(io::Element::Type type, int subdivisions = 4){
+  int n = subdivisions;
+  switch (type) {
+    case io::Element::Type::Line2:       return 0;
+    case io::Element::Type::Line3:       return 0;
+    case io::Element::Type::Tri3:        return 1;
+    case io::Element::Type::Tri6:        return n * n;
+    case io::Element::Type::Quad4:       return 4;
+    case io::Element::Type::Quad8:       return 2 * n * n;
+    case io::Element::Type::Quad9:       return 2 * n * n;
+    case io::Element::Type::Tet4:        return 0;
+    case io::Element::Type::Tet10:       return 0;
+    case io::Element::Type::Pyr5:        return 0;
+    case io::Element::Type::Pyr13:       return 0;
+    case io::Element::Type::Pyr14:       return 0;
+    case io::Element::Type::Prism6:      return 0;
+    case io::Element::Type::Prism15:     return 0;
+    case io::Element::Type::Prism18:     return 0;
+    case io::Element::Type::Hex8:        return 0;
+    case io::Element::Type::Hex20:       return 0;
+    case io::Element::Type::Hex27:       return 0;
+    case io::Element::Type::Unsupported: return -1;
+  }
+  return -1;
+}
+
+constexpr bool is_quadratic_surface(io::Element::Type type) {
+  return type == io::Element::Type::Tri6 || type == io::Element::Type::Quad8 || type == io::Element::Type::Quad9;
+}
+
+constexpr int max_triangles_per_element = 2 * max_subdivisions * max_subdivisions;
+
+// a surface element is tessellated by evaluating its shape functions at a 
+// fixed set of sample points, and connecting those points with a fixed set 
+// of triangles. The shape function values at the sample points are the same 
+// for every element of a given type, so they're computed at compile time
+template < int n, int s, int t >
+struct TessellationPattern {
+  static constexpr int num_nodes = n;
+  static constexpr int num_samples = s;
+  static constexpr int num_triangles = t;
+  float weights[s][n] = {};     // sample i is the sum of weights[i][j] * node j
+  uint8_t triangles[t][3] = {}; // in terms of the samples
+};
+
+namespace detail {
+
+// quadratic lagrange polynomials on [0, 1] for the nodes at 0, 1/2 and 1
+constexpr double lagrange0(double t) { return (1 - t) * (1 - 2 * t); }
+constexpr double lagrange1(double t) { return 4 * t * (1 - t); }
+constexpr double lagrange2(double t) { return t * (2 * t - 1); }
+
+// the n * n triangles of the samples at xi = (i / n, j / n), for i + j <= n
+template < int n, typename pattern_t >
+constexpr void subdivide_triangle(pattern_t & p) {
+  auto sample = [](int i, int j) { return (n + 1) * j - j * (j - 1) / 2 + i; };
+  int k = 0;
+  for (int j = 0; j < n; j++) {
+    for (int i = 0; i < n - j; i++) {
+      int q[4] = {sample(i, j), sample(i+1, j), sample(i+1, j+1), sample(i, j+1)};
+      p.triangles[k][0] = q[0]; p.triangles[k][1] = q[1]; p.triangles[k][2] = q[3]; k++;
+      if ((i + j) < n - 1) { 
+        p.triangles[k][0] = q[1]; p.triangles[k][1] = q[2]; p.triangles[k][2] = q[3]; k++;
+      }
+    }
+  }
+}
+
+// the 2 * n * n triangles of the (n+1) x (n+1) grid of samples on a 
+// quadrilateral, where sample (n + 1) * i + j is at xi = (i / n, j / n)
+template < int n, typename pattern_t >
+constexpr void subdivide_quad(pattern_t & p) {
+  int k = 0;
+  for (int i = 0; i < n; i++) {
+    for (int j = 0; j < n; j++) {
+      int q[4] = {(n+1) * i + j, (n+1) * (i+1) + j, (n+1) * (i+1) + (j+1), (n+1) * i + (j+1)};
+
+      // the diagonals point away from the center, e.g. for n = 4
+      //
+      // j       
+      // ^       
+      // |       
+      // 1 1 0 0 
+      // 1 1 0 0 
+      // 0 0 1 1
+      // 0 0 1 1 --> i
+      int offset = (2 * i >= n) ^ (2 * j >= n);
+
+      // offset = 0   offset = 1
+      //  3 * * 2      3 * * 2
+      //  *   * *      * *   * 
+      //  * *   *      *   * *
+      //  0 * * 1      0 * * 1 
+      p.triangles[k][0] = q[0]; p.triangles[k][1] = q[1]; p.triangles[k][2] = q[2+offset]; k++;
+      p.triangles[k][0] = q[2]; p.triangles[k][1] = q[3]; p.triangles[k][2] = q[0+offset]; k++;
+    }
+  }
+}
+
+template < io::Element::Type T, int n >
+constexpr auto make_tessellation_pattern() {
+  using type = io::Element::Type;
+  constexpr int num_nodes = io::nodes_per_elem(T);
+
+  if constexpr (T == type::Tri3) {
+    TessellationPattern< num_nodes, 3, 1 > p;
+    for (int i = 0; i < 3; i++) {
+      p.weights[i][i] = 1.0f;
+      p.triangles[0][i] = i;
+    }
+    return p;
+  }
+
+  if constexpr (T == type::Tri6) {
+    TessellationPattern< num_nodes, (n + 1) * (n + 2) / 2, n * n > p;
+    int k = 0;
+    for (int j = 0; j <= n; j++) {
+      for (int i = 0; i <= n - j; i++) {
+        double xi[2] = {double(i) / n, double(j) / n};
+        double phi[6] = {
+          (1 - xi[0] - xi[1]) * (1 - 2 * xi[0] - 2 * xi[1]),
+          xi[0] * (2 * xi[0] - 1),
+          xi[1] * (2 * xi[1] - 1),
+          4 * xi[0] * (1 - xi[0] - xi[1]),
+          4 * xi[0] * xi[1],
+          4 * xi[1] * (1 - xi[0] - xi[1])
+        };
+        for (int m = 0; m < 6; m++) p.weights[k][m] = float(phi[m]);
+        k++;
+      }
+    }
+    subdivide_triangle< n >(p);
+    return p;
+  }
+
+  if constexpr (T == type::Quad4) {
+    // the corners, and the center
+    TessellationPattern< num_nodes, 5, 4 > p;
+    for (int i = 0; i < 4; i++) {
+      p.weights[i][i] = 1.0f;
+      p.weights[4][i] = 0.25f;
+      p.triangles[i][0] = i;
+      p.triangles[i][1] = (i + 1) % 4;
+      p.triangles[i][2] = 4;
+    }
+    return p;
+  }
+
+  if constexpr (T == type::Quad8) {
+    TessellationPattern< num_nodes, (n + 1) * (n + 1), 2 * n * n > p;
+    for (int i = 0; i <= n; i++) {
+      for (int j = 0; j <= n; j++) {
+        double xi[2] = {-1.0 + (2.0 * i) / n, -1.0 + (2.0 * j) / n};
+        double phi[8] = {
+          (1 - xi[0]) * (1 - xi[1]) * (1 + xi[0] + xi[1]) * (-0.25),
+          (1 + xi[0]) * (1 - xi[1]) * (1 - xi[0] + xi[1]) * (-0.25),
+          (1 + xi[0]) * (1 + xi[1]) * (1 - xi[0] - xi[1]) * (-0.25),
+          (1 - xi[0]) * (1 + xi[1]) * (1 + xi[0] - xi[1]) * (-0.25),
+          (1 - xi[0] * xi[0]) * (1 - xi[1]) * 0.5,
+          (1 + xi[0]) * (1 - xi[1] * xi[1]) * 0.5,
+          (1 - xi[0] * xi[0]) * (1 + xi[1]) * 0.5,
+          (1 - xi[0]) * (1 - xi[1] * xi[1]) * 0.5
+        };
+        for (int m = 0; m < 8; m++) p.weights[(n + 1) * i + j][m] = float(phi[m]);
+      }
+    }
+    subdivide_quad< n >(p);
+    return p;
+  }
+
+  if constexpr (T == type::Quad9) {
+    TessellationPattern< num_nodes, (n + 1) * (n + 1), 2 * n * n > p;
+    for (int i = 0; i <= n; i++) {
+      for (int j = 0; j <= n; j++) {
+        double s = double(i) / n, t = double(j) / n;
+        double u[3] = {lagrange0(s), lagrange1(s), lagrange2(s)};
+        double v[3] = {lagrange0(t), lagrange1(t), lagrange2(t)};
+        double phi[9] = {
+          u[0] * v[0], u[2] * v[0], u[2] * v[2], u[0] * v[2],
+          u[1] * v[0], u[2] * v[1], u[1] * v[2], u[0] * v[1],
+          u[1] * v[1]
+        };
+        for (int m = 0; m < 9; m++) p.weights[(n + 1) * i + j][m] = float(phi[m]);
+      }
+    }
+    subdivide_quad< n >(p);
+    return p;
+  }
+}
+
+}
+
+// only defined for the element types with triangles_per_element(T) > 0, 
+// where `subdivisions` only matters for the quadratic ones
+template < io::Element::Type T, int subdivisions >
+inline constexpr auto tessellation_pattern = detail::make_tessellation_pattern< T, subdivisions >();
+
+// the distance between a quadratic surface element (with nodes x) and the 
+// triangles of its corners (1 for a Tri6, 2 for a Quad8/9), counting both 
+// how far its edges bow away from straight lines, and how far its interior 
+// bulges out of the plane of those triangles. Subdividing each edge n times 
+// reduces this error by about a factor of n^2.
+double chord_error(io::Element::Type type, const std::array< double, 3 > * x);
+
+// the fewest subdivisions (up to `max`) of an element with the given 
+// chord_error that bring its error within `tolerance` 
+int subdivisions_for(double error, double tolerance, int max);
+
+constexpr int tessellation_batch_size = 8;
+
+// the nodes of up to tessellation_batch_size elements of the same type 
+// and subdivision level, stored by lane (i.e. x[node][component][element]), 
+// so that the elements are tessellated together with SIMD instructions
+struct TessellationBatch {
+  io::Element::Type type = io::Element::Type::Unsupported;
+  int subdivisions = 4;
+  int count = 0;
+  alignas(32) float x[27][3][tessellation_batch_size] = {};
+};
+
+// write the 50-byte binary STL records (normal, 3 vertices, 2 unused bytes) of 
+// the triangles of every element in the batch to output, in order. Returns the 
+// number of bytes written, which is at most
+//
+//   50 * tessellation_batch_size * max_triangles_per_element
+//
+std::size_t tessellate(const TessellationBatch & batch, char * output);
@@ -2,6 +2,8 @@
 
 #include "mesh/io.hpp"
 
+#include "byte_order.hpp"
+
 #include <cmath>
 #include <array>
 #include <tuple>
@@ -51,25 +53,6 @@ void binary_write_array(std::ofstream & outfile, const std::array<T,n> & arr) {
 }
 
 
-template < typename T >
-T ascii_read(std::ifstream & infile) {
-  T out; 
-  infile >> out;
-  return out;
-}
-
-template < typename ... T >
-std::tuple<T...> ascii_read_tuple(std::ifstream & infile) {
-  return std::tuple{ascii_read<T>(infile) ...};
-}
-
-template < typename T, size_t n >
-std::array<T,n> ascii_read_array(std::ifstream & infile) {
-  std::array<T,n> out; 
-  for (int i = 0; i < n; i++) infile >> out[i];
-  return out;
-}  
-
 using vec3f = std::array<float, 3>;
 
 template < typename T, size_t n > 
@@ -114,21 +97,3 @@ inline std::vector<int> identity_permutation(int n) {
   for (int i = 0; i < n; i++) { P[i] = i; }
   return P;
 }
-
-static const bool is_big_endian = [](){
-  int64_t x16 = 1;
-  int32_t *x8 = reinterpret_cast<int32_t*>(&x16);
-  return !*x8;
-}();
-
-template <typename T>
-T to_big_endian(T value) {
-  if (!is_big_endian) {
-    auto it = reinterpret_cast<uint8_t*>(&value);
-    std::reverse(it, it + sizeof(T)); // value is now in swapped from little to big endianness
-  }
-  return value;
-}
-
-template <typename T>
-T from_big_endian(T value) { to_big_endian(value); }
\ No newline at end of file
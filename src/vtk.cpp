@@ -1,19 +1,81 @@
 #include "mesh/io.hpp"
 
 #include "util.hpp"
+#include "mesh_view.hpp"
 #include "node_ordering.hpp"
+#include "buffer_writer.hpp"
+#include "buffer_reader.hpp"
+#include "mapped_file.hpp"
+#include "vtk_import.hpp"
+#include "fields.hpp"
 
+#include <cctype>
 #include <fstream>
+#include <iostream>
+#include <string_view>
 
 using io::Mesh;
-  
-template <typename T>
-void write_binary(std::ofstream &outfile, T value) {
-  T be_value = to_big_endian(value);
-  outfile.write((char*)&be_value, sizeof(T));
+
+// the binary arrays are encoded in ranges of (at most) this many nodes or
+// elements, in parallel, and written out in order. So, only a few ranges 
+// are held in memory at a time, rather than a copy of every array.
+static constexpr int64_t records_per_range = int64_t(1) << 16;
+
+// legacy vtk files are big-endian, so each range is 
+// assembled in native byte order and then converted in place
+template < typename T >
+static T * resize_for(BufferWriter & buffer, std::size_t count) {
+  buffer.data.resize(sizeof(T) * count);
+  return reinterpret_cast< T * >(&buffer.data[0]);
+}
+
+static void convert_to_big_endian(BufferWriter & buffer, std::size_t value_bytes) {
+  if (!is_big_endian) byte_swap(&buffer.data[0], &buffer.data[0], buffer.size() / value_bytes, value_bytes);
 }
 
-static bool export_vtk_ascii(const Mesh & mesh, std::string filename) {
+static const char * legacy_type_name(double) { return "double"; }
+static const char * legacy_type_name(float) { return "float"; }
+static const char * legacy_type_name(int32_t) { return "int"; }
+static const char * legacy_type_name(int64_t) { return "vtktypeint64"; }
+
+// the fields are written as FIELD arrays, since (unlike SCALARS or VECTORS)
+// those can have any number of components, in ranges of values like the geometry
+static void write_fields(std::ofstream & outfile, const std::vector< io::Field > & fields, 
+                         const char * section, std::size_t count, bool binary) {
+  if (fields.empty()) return;
+  outfile << section << " " << count << '\n';
+  outfile << "FIELD FieldData " << fields.size() << '\n';
+  for (auto & field : fields) {
+    std::visit([&](const auto & values) {
+      using T = typename std::decay_t< decltype(values) >::value_type;
+      outfile << field.name << " " << field.num_components << " " << count << " " << legacy_type_name(T{}) << '\n';
+
+      int64_t num_values = int64_t(values.size());
+      int64_t values_per_range = records_per_range * field.num_components;
+      int64_t num_ranges = (num_values + values_per_range - 1) / values_per_range;
+      write_in_parallel(outfile, num_ranges, [&](int64_t r, BufferWriter & buffer) {
+        int64_t first = r * values_per_range;
+        int64_t last = std::min(first + values_per_range, num_values);
+        if (binary) {
+          copy_to_big_endian(&values[first], std::size_t(last - first), resize_for< T >(buffer, std::size_t(last - first)));
+        } else {
+          for (int64_t i = first; i < last; i++) {
+            if constexpr (std::is_floating_point_v< T >) {
+              buffer.real(values[i]);
+            } else {
+              buffer.integer(values[i]);
+            }
+            buffer.character((i + 1) % field.num_components ? ' ' : '\n');
+          }
+        }
+      });
+      if (binary) outfile << '\n';
+    }, field.values);
+  }
+}
+
+template < typename mesh_t >
+static bool export_vtk_ascii(const mesh_t & mesh, const io::Fields & fields, std::string filename) {
 
   std::ofstream outfile(filename, std::ios::binary | std::ios::trunc);
 
@@ -27,34 +89,41 @@ static bool export_vtk_ascii(const Mesh & mesh, std::string filename) {
     outfile << x << " " << y << " " << z << '\n';
   }
 
-  int32_t nelems = mesh.elements.size();
-  int32_t size = 0;
-  for (auto & elem : mesh.elements) {
-    size += 1 + nodes_per_elem(elem.type);
+  int64_t nelems = num_elements(mesh);
+  int64_t size = 0;
+  for_each_element(mesh, [&](auto elem) {
+    size += 1 + elem.num_nodes;
+  });
+  if (size > INT32_MAX || mesh.nodes.size() > std::size_t(INT32_MAX)) {
+    exit_with_error("legacy vtk files are limited to 32-bit connectivity, use export_vtu instead");
   }
   outfile << "CELLS " << nelems << " " << size << '\n';
-  for (auto & elem : mesh.elements) {
+  for_each_element(mesh, [&](auto elem) {
     if (elem.type == io::Element::Type::Pyr14) {
       exit_with_error("vtk does not support 14-node pyramid elements");
     }
-    outfile << nodes_per_elem(elem.type);
+    outfile << elem.num_nodes;
     for (int32_t i : vtk::permutation(elem.type)) {
       int32_t id = elem.node_ids[i];
       outfile << " " << id;
     }
     outfile << '\n';
-  }
+  });
 
   outfile << "CELL_TYPES " << nelems << '\n';
-  for (auto & elem: mesh.elements) {
+  for_each_element(mesh, [&](auto elem) {
     outfile << vtk::element_type(elem.type) << '\n';
-  }
+  });
+
+  write_fields(outfile, fields.nodes, "POINT_DATA", mesh.nodes.size(), false);
+  write_fields(outfile, fields.elements, "CELL_DATA", std::size_t(nelems), false);
   outfile.close();
 
   return false;
 }
 
-static bool export_vtk_binary(const Mesh & mesh, std::string filename) {
+template < typename mesh_t >
+static bool export_vtk_binary(const mesh_t & mesh, const io::Fields & fields, std::string filename) {
 
   std::ofstream outfile(filename, std::ios::binary | std::ios::trunc);
 
@@ -63,49 +132,260 @@ static bool export_vtk_binary(const Mesh & mesh, std::string filename) {
   outfile << "BINARY\n";
   outfile << "DATASET UNSTRUCTURED_GRID\n";
 
-  outfile << "POINTS " << mesh.nodes.size() << " float\n";
-  for (auto p : mesh.nodes) {
-    write_binary(outfile, float(p[0]));
-    write_binary(outfile, float(p[1]));
-    write_binary(outfile, float(p[2]));
-  }
+  int64_t num_nodes = int64_t(mesh.nodes.size());
+  int64_t num_node_ranges = (num_nodes + records_per_range - 1) / records_per_range;
+  outfile << "POINTS " << num_nodes << " float\n";
+  write_in_parallel(outfile, num_node_ranges, [&](int64_t r, BufferWriter & buffer) {
+    int64_t first = r * records_per_range;
+    int64_t last = std::min(first + records_per_range, num_nodes);
+    float * points = resize_for< float >(buffer, std::size_t(3 * (last - first)));
+    for (int64_t i = first; i < last; i++) {
+      for (int j = 0; j < 3; j++) *points++ = float(mesh.nodes[i][j]);
+    }
+    convert_to_big_endian(buffer, sizeof(float));
+  });
   outfile << '\n';
 
-  int32_t nelems = mesh.elements.size();
-  int32_t size = 0;
-  for (auto & elem : mesh.elements) {
-    size += 1 + nodes_per_elem(elem.type);
+  int64_t nelems = num_elements(mesh);
+  int64_t size = 0;
+  for_each_element(mesh, [&](auto elem) {
+    size += 1 + elem.num_nodes;
+  });
+  if (size > INT32_MAX || mesh.nodes.size() > std::size_t(INT32_MAX)) {
+    exit_with_error("legacy vtk files are limited to 32-bit connectivity, use export_vtu instead");
   }
+
+  int64_t num_element_ranges = (nelems + records_per_range - 1) / records_per_range;
+  auto element_range = [&](int64_t r) {
+    int64_t first = r * records_per_range;
+    return std::pair{first, std::min(first + records_per_range, nelems)};
+  };
+
   outfile << "CELLS " << nelems << " " << size << '\n';
-  for (auto & elem : mesh.elements) {
-    int32_t npe = nodes_per_elem(elem.type);
-    write_binary(outfile, npe);
-    for (int32_t i : vtk::permutation(elem.type)) {
-      int32_t id = elem.node_ids[i];
-      write_binary(outfile, id);
+  write_in_parallel(outfile, num_element_ranges, [&](int64_t r, BufferWriter & buffer) {
+    auto [first, last] = element_range(r);
+    std::size_t count = 0;
+    for (int64_t i = first; i < last; i++) count += 1 + element(mesh, std::size_t(i)).num_nodes;
+    int32_t * cells = resize_for< int32_t >(buffer, count);
+    for (int64_t i = first; i < last; i++) {
+      auto elem = element(mesh, std::size_t(i));
+      *cells++ = elem.num_nodes;
+      for (int j : vtk::permutation(elem.type)) *cells++ = int32_t(elem.node_ids[j]);
     }
-  }
+    convert_to_big_endian(buffer, sizeof(int32_t));
+  });
   outfile << '\n';
   
   outfile << "CELL_TYPES " << nelems << '\n';
-  for (auto & elem: mesh.elements) {
-    write_binary(outfile, vtk::element_type(elem.type));
-  }
+  write_in_parallel(outfile, num_element_ranges, [&](int64_t r, BufferWriter & buffer) {
+    auto [first, last] = element_range(r);
+    int32_t * cell_types = resize_for< int32_t >(buffer, std::size_t(last - first));
+    for (int64_t i = first; i < last; i++) {
+      *cell_types++ = vtk::element_type(element(mesh, std::size_t(i)).type);
+    }
+    convert_to_big_endian(buffer, sizeof(int32_t));
+  });
   outfile << '\n';
 
+  write_fields(outfile, fields.nodes, "POINT_DATA", mesh.nodes.size(), true);
+  write_fields(outfile, fields.elements, "CELL_DATA", std::size_t(nelems), true);
   outfile.close();
 
   return false;
 }
 
+// the name used in .vtu files for one of the legacy data types, or "" if it isn't supported
+static std::string_view legacy_type(std::string_view type) {
+  if (type == "char") return "Int8";
+  if (type == "unsigned_char") return "UInt8";
+  if (type == "short") return "Int16";
+  if (type == "unsigned_short") return "UInt16";
+  if (type == "int" || type == "vtktypeint32") return "Int32";
+  if (type == "unsigned_int") return "UInt32";
+  if (type == "long" || type == "vtktypeint64") return "Int64";
+  if (type == "unsigned_long" || type == "vtktypeuint64") return "UInt64";
+  if (type == "float") return "Float32";
+  if (type == "double") return "Float64";
+  return "";
+}
+
+// read `count` values of the given (legacy) type that start on the next line, 
+// converted to T. Binary data is big-endian, and ASCII data continues until
+// the next line that starts with a keyword.
+template < typename T >
+static std::vector< T > read_legacy_values(BufferReader & in, std::size_t count, std::string_view type, bool binary) {
+  std::string_view name = legacy_type(type);
+  if (name.empty()) exit_with_error("unsupported data type (vtk): " + std::string(type));
+  in.next_line();
+
+  if (binary) {
+    std::size_t size = std::size_t(value_bytes(name));
+    if (in.remaining() / size < count) exit_with_error("invalid file format (vtk): the file is truncated");
+    std::vector< uint8_t > bytes(size * count);
+    if (is_big_endian) {
+      std::memcpy(bytes.data(), in.ptr, bytes.size());
+    } else {
+      byte_swap(bytes.data(), in.ptr, count, size);
+    }
+    in.ptr += bytes.size();
+    return convert_values< T >(bytes.data(), count, name);
+  }
+
+  const char * begin = in.ptr;
+  const char * end = begin;
+  while (end < in.end && !std::isalpha(static_cast< unsigned char >(*end))) {
+    const char * newline = static_cast< const char * >(std::memchr(end, '\n', std::size_t(in.end - end)));
+    end = newline ? newline + 1 : in.end;
+  }
+  in.ptr = end;
+
+  bool ok = true;
+  std::vector< T > values;
+  if constexpr (std::is_floating_point_v< T >) {
+    values = parse_ascii_values< T >(begin, end, ok);
+  } else {
+    // (integers are parsed as int64_t, so that e.g. uint8_t isn't read as a character)
+    std::vector< int64_t > integers = parse_ascii_values< int64_t >(begin, end, ok);
+    values.assign(integers.begin(), integers.end());
+  }
+  if (!ok || values.size() != count) exit_with_error("invalid file format (vtk)");
+  return values;
+}
+
 namespace io {
 
+template < typename mesh_t >
+mesh_t import_vtk(std::string filename) {
+
+  MappedFile file(filename);
+
+  if (!file.is_open()) {
+    std::cout << "error: " << filename << " not found" << std::endl;
+    exit(1);
+  }
+
+  BufferReader in{file.begin(), file.end()};
+  if (in.line().substr(0, 22) != "# vtk DataFile Version") exit_with_error("invalid file format (vtk)");
+  in.line(); // title
+
+  std::string_view encoding = in.word();
+  if (encoding != "ASCII" && encoding != "BINARY") exit_with_error("invalid file format (vtk)");
+  bool binary = (encoding == "BINARY");
+
+  if (in.word() != "DATASET" || in.word() != "UNSTRUCTURED_GRID") {
+    exit_with_error("invalid file format (vtk): only UNSTRUCTURED_GRID datasets are supported");
+  }
+
+  mesh_t mesh;
+  VtkCells cells;
+  bool have_points = false, have_cells = false, have_types = false;
+
+  while (true) {
+    std::string_view keyword = in.word();
+
+    if (keyword == "POINTS") {
+      std::size_t n = in.integer< std::size_t >();
+      std::string_view type = in.word();
+      if (!in.ok) exit_with_error("invalid file format (vtk points)");
+      std::vector< double > coordinates = read_legacy_values< double >(in, 3 * n, type, binary);
+      mesh.nodes.resize(n);
+      std::memcpy(mesh.nodes.data(), coordinates.data(), sizeof(double) * coordinates.size());
+      have_points = true;
+    } else if (keyword == "CELLS") {
+      std::size_t n = in.integer< std::size_t >();
+      std::size_t size = in.integer< std::size_t >();
+      if (!in.ok) exit_with_error("invalid file format (vtk cells)");
+
+      BufferReader peek = in;
+      if (peek.word() == "OFFSETS") {
+        // version 5.1: n offsets (starting with 0), then size node ids 
+        std::string_view type = peek.word();
+        cells.offsets = read_legacy_values< int64_t >(peek, n, type, binary);
+        if (peek.word() != "CONNECTIVITY") exit_with_error("invalid file format (vtk cells)");
+        type = peek.word();
+        cells.connectivity = read_legacy_values< int64_t >(peek, size, type, binary);
+        in = peek;
+      } else {
+        // older versions: each cell is its number of nodes, and then their ids
+        std::vector< int64_t > values = read_legacy_values< int64_t >(in, size, "int", binary);
+        // (cell i starts at values[offsets[i] + i])
+        cells.offsets.assign(n + 1, 0);
+        std::size_t k = 0;
+        for (std::size_t i = 0; i < n; i++) {
+          if (k >= size || values[k] < 0 || uint64_t(values[k]) > size - k - 1) exit_with_error("invalid file format (vtk cells)");
+          cells.offsets[i + 1] = cells.offsets[i] + values[k];
+          k += std::size_t(values[k]) + 1;
+        }
+        if (k != size) exit_with_error("invalid file format (vtk cells)");
+
+        cells.connectivity.resize(size - n);
+        parallel_for(int64_t(n), [&](int64_t i) {
+          std::copy(values.begin() + cells.offsets[i] + i + 1, values.begin() + cells.offsets[i + 1] + i + 1, 
+                    cells.connectivity.begin() + cells.offsets[i]);
+        });
+      }
+      have_cells = true;
+    } else if (keyword == "CELL_TYPES") {
+      std::size_t n = in.integer< std::size_t >();
+      if (!in.ok) exit_with_error("invalid file format (vtk cell types)");
+      std::vector< int32_t > types = read_legacy_values< int32_t >(in, n, "int", binary);
+      cells.types.resize(n);
+      for (std::size_t i = 0; i < n; i++) cells.types[i] = (types[i] > 0 && types[i] < 256) ? uint8_t(types[i]) : 0;
+      have_types = true;
+    } else if (keyword == "METADATA") {
+      // a block of information about the array before it, that ends with a blank line
+      in.next_line();
+      while (!in.done() && !in.line().empty()) {}
+    } else if (keyword.empty() || keyword == "POINT_DATA" || keyword == "CELL_DATA" || keyword == "FIELD") {
+      break;
+    } else {
+      exit_with_error("invalid file format (vtk): unexpected " + std::string(keyword));
+    }
+  }
+
+  if (!have_points || !have_cells || !have_types || cells.types.size() + 1 != cells.offsets.size()) {
+    exit_with_error("invalid file format (vtk)");
+  }
+  set_cells(mesh, cells, "vtk");
+
+  return mesh;
+}
+
+template Mesh import_vtk(std::string);
+template FlatMesh< int32_t > import_vtk(std::string);
+template FlatMesh< int64_t > import_vtk(std::string);
+
 bool export_vtk(const Mesh & mesh, std::string filename, FileEncoding enc) {
+  return export_vtk(mesh, filename, enc, Fields{});
+}
+
+bool export_vtk(const Mesh & mesh, std::string filename, FileEncoding enc, const Fields & fields) {
+  check_fields(fields, mesh.nodes.size(), mesh.elements.size());
   if (enc == FileEncoding::ASCII) {
-    return export_vtk_ascii(mesh, filename);
+    return export_vtk_ascii(mesh, fields, filename);
   } else {
-    return export_vtk_binary(mesh, filename);
+    return export_vtk_binary(mesh, fields, filename);
   }
 }
 
-} // namespace io
\ No newline at end of file
+template < typename index_t >
+bool export_vtk(const FlatMesh< index_t > & mesh, std::string filename, FileEncoding enc) {
+  return export_vtk(mesh, filename, enc, Fields{});
+}
+
+template < typename index_t >
+bool export_vtk(const FlatMesh< index_t > & mesh, std::string filename, FileEncoding enc, const Fields & fields) {
+  check_fields(fields, mesh.nodes.size(), mesh.num_elements());
+  if (enc == FileEncoding::ASCII) {
+    return export_vtk_ascii(mesh, fields, filename);
+  } else {
+    return export_vtk_binary(mesh, fields, filename);
+  }
+}
+
+template bool export_vtk(const FlatMesh< int32_t > &, std::string, FileEncoding);
+template bool export_vtk(const FlatMesh< int64_t > &, std::string, FileEncoding);
+template bool export_vtk(const FlatMesh< int32_t > &, std::string, FileEncoding, const Fields &);
+template bool export_vtk(const FlatMesh< int64_t > &, std::string, FileEncoding, const Fields &);
+
+} // namespace io
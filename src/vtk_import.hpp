@@ -0,0 +1,176 @@
+#pragma once
+
+#include "mesh/io.hpp"
+
+#include "util.hpp"
+#include "parallel.hpp"
+#include "buffer_reader.hpp"
+#include "node_ordering.hpp"
+
+#include <atomic>
+#include <limits>
+#include <vector>
+#include <cstring>
+#include <string_view>
+
+// helpers shared by the legacy vtk and xml vtu importers
+
+// the size of the values of a data array, given the name of its type 
+// in a .vtu file (e.g. "Float32"), or 0 if the type isn't supported
+inline int value_bytes(std::string_view type) {
+  if (type == "Int8" || type == "UInt8") return 1;
+  if (type == "Int16" || type == "UInt16") return 2;
+  if (type == "Int32" || type == "UInt32" || type == "Float32") return 4;
+  if (type == "Int64" || type == "UInt64" || type == "Float64") return 8;
+  return 0;
+}
+
+// convert `count` values of the given type (in native byte order) to T
+template < typename T >
+std::vector< T > convert_values(const uint8_t * data, std::size_t count, std::string_view type) {
+  std::vector< T > values(count);
+  auto convert = [&](auto source) {
+    using source_t = decltype(source);
+    int64_t num_ranges = int64_t((count + 65535) / 65536);
+    parallel_for(num_ranges, [&](int64_t r) {
+      std::size_t first = std::size_t(r) * 65536;
+      std::size_t last = std::min(first + 65536, count);
+      for (std::size_t i = first; i < last; i++) {
+        source_t value;
+        std::memcpy(&value, data + sizeof(source_t) * i, sizeof(source_t));
+        values[i] = T(value);
+      }
+    });
+  };
+  if (type == "Int8")         convert(int8_t{});
+  else if (type == "UInt8")   convert(uint8_t{});
+  else if (type == "Int16")   convert(int16_t{});
+  else if (type == "UInt16")  convert(uint16_t{});
+  else if (type == "Int32")   convert(int32_t{});
+  else if (type == "UInt32")  convert(uint32_t{});
+  else if (type == "Int64")   convert(int64_t{});
+  else if (type == "UInt64")  convert(uint64_t{});
+  else if (type == "Float32") convert(float{});
+  else if (type == "Float64") convert(double{});
+  else exit_with_error("unsupported data array type: " + std::string(type));
+  return values;
+}
+
+// parse the whitespace-separated numbers in the text [begin, end), which is 
+// split into pieces that are parsed in parallel. `ok` is set to false if one
+// of them doesn't parse.
+template < typename T >
+std::vector< T > parse_ascii_values(const char * begin, const char * end, bool & ok) {
+  int n = num_chunks(std::size_t(end - begin));
+  std::vector< const char * > bounds(n + 1, end);
+  bounds[0] = begin;
+  for (int i = 1; i < n; i++) {
+    const char * p = std::max(begin + (end - begin) * i / n, bounds[i - 1]);
+    while (p < end && !BufferReader::is_space(*p)) p++;
+    bounds[i] = p;
+  }
+
+  std::vector< std::vector< T > > pieces(n);
+  std::vector< char > piece_ok(n, 1);
+  parallel_for(n, [&](int64_t i) {
+    BufferReader in{bounds[i], bounds[i + 1]};
+    in.skip_whitespace();
+    while (!in.done()) {
+      if constexpr (std::is_floating_point_v< T >) {
+        pieces[i].push_back(in.real< T >());
+      } else {
+        pieces[i].push_back(in.integer< T >());
+      }
+      if (!in.ok) break;
+      in.skip_whitespace();
+    }
+    piece_ok[i] = in.ok;
+  });
+
+  std::size_t total = 0;
+  for (int i = 0; i < n; i++) {
+    ok = ok && piece_ok[i];
+    total += pieces[i].size();
+  }
+
+  std::vector< T > values;
+  values.reserve(total);
+  for (auto & piece : pieces) values.insert(values.end(), piece.begin(), piece.end());
+  return values;
+}
+
+// the cells of a vtk or vtu file, as read by the importers: cell i has vtk 
+// cell type types[i], and its nodes (in vtk's ordering) are 
+// connectivity[offsets[i] ... offsets[i+1]), so offsets starts with 0
+struct VtkCells {
+  std::vector< uint8_t > types;
+  std::vector< int64_t > offsets{0};
+  std::vector< int64_t > connectivity;
+};
+
+// convert the cells to elements of `mesh` (with their nodes back in gmsh's 
+// ordering, and no tags), checking that every cell has a supported type, the
+// right number of nodes, and node ids in [0, mesh.nodes.size())
+template < typename mesh_t >
+void set_cells(mesh_t & mesh, const VtkCells & cells, const char * format) {
+  using index_t = index_type_t< mesh_t >;
+
+  int64_t n = int64_t(cells.types.size());
+  int64_t num_nodes = int64_t(mesh.nodes.size());
+  if (int64_t(cells.offsets.size()) != n + 1 || cells.offsets[n] != int64_t(cells.connectivity.size())) {
+    exit_with_error(std::string("invalid file format (") + format + " cells)");
+  }
+  if (uint64_t(std::max< int64_t >(num_nodes, cells.offsets[n])) > uint64_t(std::numeric_limits< index_t >::max())) {
+    exit_with_error(std::string("too many nodes for 32-bit indices (") + format + "), use FlatMesh< int64_t >");
+  }
+
+  std::atomic< int > bad_type(-1);
+  std::atomic< bool > bad_ids(false);
+  parallel_for(n, [&](int64_t i) {
+    io::Element::Type type = vtk::element_type(int(cells.types[i]));
+    if (type == io::Element::Type::Unsupported) {
+      bad_type = int(cells.types[i]);
+    } else if (cells.offsets[i + 1] - cells.offsets[i] != io::nodes_per_elem(type)) {
+      bad_ids = true;
+    } else {
+      for (int64_t k = cells.offsets[i]; k < cells.offsets[i + 1]; k++) {
+        if (cells.connectivity[k] < 0 || cells.connectivity[k] >= num_nodes) bad_ids = true;
+      }
+    }
+  });
+  if (bad_type != -1) {
+    exit_with_error(std::string("unsupported vtk cell type ") + std::to_string(bad_type.load()) + " (" + format + ")");
+  }
+  if (bad_ids) {
+    exit_with_error(std::string("invalid file format (") + format + " cells)");
+  }
+
+  // vtk node j is gmsh node permutation[j]
+  auto copy_nodes = [&](int64_t i, index_t * node_ids) {
+    const int64_t * ids = cells.connectivity.data() + cells.offsets[i];
+    vtk::Permutation permutation = vtk::permutation(vtk::element_type(int(cells.types[i])));
+    for (int j = 0; j < permutation.size; j++) node_ids[permutation[j]] = index_t(ids[j]);
+  };
+
+  if constexpr (std::is_same_v< mesh_t, io::Mesh >) {
+    mesh.elements.resize(std::size_t(n));
+    parallel_for(n, [&](int64_t i) {
+      io::Element & e = mesh.elements[i];
+      e.type = vtk::element_type(int(cells.types[i]));
+      e.node_ids.resize(std::size_t(cells.offsets[i + 1] - cells.offsets[i]));
+      copy_nodes(i, e.node_ids.data());
+    });
+  } else {
+    mesh.types.resize(std::size_t(n));
+    mesh.offsets.resize(std::size_t(n + 1));
+    mesh.connectivity.resize(cells.connectivity.size());
+    mesh.tag_offsets.assign(std::size_t(n + 1), 0);
+    parallel_for(n, [&](int64_t i) {
+      mesh.types[i] = vtk::element_type(int(cells.types[i]));
+      mesh.offsets[i] = index_t(cells.offsets[i]);
+      copy_nodes(i, mesh.connectivity.data() + cells.offsets[i]);
+    });
+    mesh.offsets[n] = index_t(cells.offsets[n]);
+    mesh.rebuild_blocks();
+  }
+}
@@ -2,22 +2,28 @@
 #include "mesh/io.hpp"
 #include "util.hpp"
 #include "base64.hpp"
+#include "mesh_view.hpp"
 #include "node_ordering.hpp"
+#include "vtk_import.hpp"
+#include "fields.hpp"
+#include "mapped_file.hpp"
+#include "parallel.hpp"
+#include "buffer_writer.hpp"
 
+#include <atomic>
 #include <cstring>
+#include <functional>
 #include <iostream>
+#include <string_view>
 
-std::vector<uint8_t> compress(const std::vector<uint8_t>& uncompressed_data) {
-  unsigned long uncompressed_bytes = uncompressed_data.size();
+// returns zlib's error code
+static int compress(const uint8_t * uncompressed_data, std::size_t uncompressed_bytes, std::vector<uint8_t> & compressed_data) {
   unsigned long compressed_bytes = compressBound(uncompressed_bytes);
-  std::vector<uint8_t> compressed_data(compressed_bytes); // allocate enough size for output buffer
+  compressed_data.resize(compressed_bytes); // allocate enough size for output buffer
   int error = compress((Bytef *)&compressed_data[0], &compressed_bytes, 
-                       (Bytef *)&uncompressed_data[0], uncompressed_bytes);
-  if (error) {
-    std::cout << "zlib error while compressing: " << error << std::endl;
-  } 
+                       (const Bytef *)uncompressed_data, uncompressed_bytes);
   compressed_data.resize(compressed_bytes);
-  return compressed_data;
+  return error;
 }
 
 namespace io {
@@ -34,26 +40,6 @@ void append_to_byte_array(uint8_t * & ptr, const std::vector<T> & data) {
   ptr += sizeof(T) * data.size();
 }
 
-template < typename new_type, typename old_type, size_t n >
-std::vector< std::array< new_type, n > > convert(const std::vector< std::array< old_type, n > > & old_data) {
-  std::vector< std::array< new_type, n > > new_data(old_data.size());
-  for (std::size_t i = 0; i < old_data.size(); i++) {
-    for (std::size_t j = 0; j < n; j++) {
-      new_data[i][j] = new_type(old_data[i][j]);
-    }
-  }
-  return new_data;
-}
-
-template < typename new_type, typename old_type >
-std::vector< new_type > convert(const std::vector< old_type > & old_data) {
-  std::vector< new_type > new_data(old_data.size());
-  for (std::size_t i = 0; i < old_data.size(); i++) {
-    new_data[i] = new_type(old_data[i]);
-  }
-  return new_data;
-}
-
 // although not documented in VTK's official .vtu, spec, following <https://itk.org/Wiki/VTK_XML_Formats>,
 // the binary data header is formatted as:
 //     [#blocks][#u-size][#p-size][#c-size-1][#c-size-2]...[#c-size-#blocks][DATA]
@@ -65,123 +51,255 @@ std::vector< new_type > convert(const std::vector< old_type > & old_data) {
 //     [#c-size-i] = Size in bytes of block i after compression
 // Once the data is compressed and the header is generated, the data can be written as
 //     output << Base64::encode(header) << Base64::encode(compress(data_1)) << Base64::encode(compress(data_2)) ...
+//
+// The blocks are independent, so they're compressed (and base64-encoded) in parallel, a few
+// at a time, and written out in order. The header can't be filled in until every block
+// is compressed, but its length only depends on the number of blocks, so room is left
+// for it at the start, and it's written once the blocks are done. Appended arrays are
+// written the same way, but as raw bytes.
 template < typename header_int_t >
-void write_compressed_data(const std::vector<uint8_t> &data_bytes,
+void write_compressed_data(const uint8_t * data_bytes,
+                           std::size_t total_bytes,
                            std::ofstream &outfile,
-                           std::size_t block_size_in_MB = 4)
+                           std::size_t bytes_per_block,
+                           bool base64)
 {
-  header_int_t total_bytes = data_bytes.size();
-  header_int_t bytes_per_block = block_size_in_MB * 1048576u;
-  header_int_t remainder = total_bytes % bytes_per_block;
-  header_int_t quotient = total_bytes / bytes_per_block;
-  header_int_t number_of_blocks = quotient + 1;
-  header_int_t size_of_last_block = remainder;
+  std::size_t remainder = total_bytes % bytes_per_block;
+  std::size_t quotient = total_bytes / bytes_per_block;
+  std::size_t number_of_blocks = quotient + 1;
+  std::size_t size_of_last_block = remainder;
 
   std::vector<uint8_t> header_bytes((3 + number_of_blocks) * sizeof(header_int_t));
   header_int_t * header = (header_int_t *)&header_bytes[0];
-  header[0] = number_of_blocks;
-  header[1] = bytes_per_block;
-  header[2] = size_of_last_block;
+  header[0] = header_int_t(number_of_blocks);
+  header[1] = header_int_t(bytes_per_block);
+  header[2] = header_int_t(size_of_last_block);
 
-  std::vector<std::vector<uint8_t>> compressed_bytes(number_of_blocks);
+  std::streampos header_position = outfile.tellp();
+  outfile << std::string(base64 ? Base64::EncodedSize(header_bytes.size()) : header_bytes.size(), '=');
+
+  std::atomic< int > error(Z_OK);
+  write_in_parallel(outfile, int64_t(number_of_blocks), [&](int64_t i, BufferWriter & buffer) {
+    std::size_t block_size = (std::size_t(i) == number_of_blocks - 1) ? size_of_last_block : bytes_per_block;
+    std::vector<uint8_t> compressed;
+    int block_error = compress(data_bytes + i * bytes_per_block, block_size, compressed);
+    if (block_error != Z_OK) error = block_error;
+    header[3+i] = header_int_t(compressed.size());
+    if (base64) {
+      buffer.data.resize(Base64::EncodedSize(compressed.size()));
+      Base64::Encode(compressed.data(), compressed.size(), &buffer.data[0]);
+    } else {
+      buffer.raw(compressed.data(), compressed.size());
+    }
+  });
+  if (error != Z_OK) {
+    std::cout << "zlib error while compressing: " << error << std::endl;
+  }
 
-  for (header_int_t i = 0; i < number_of_blocks; ++i) {
-    header_int_t block_size = (i == number_of_blocks - 1) ? size_of_last_block : bytes_per_block;
-    std::vector<uint8_t>::const_iterator start = data_bytes.begin() + i * bytes_per_block;
-    std::vector<uint8_t>::const_iterator stop  = start + block_size;
-    std::vector<uint8_t> block_vector(start, stop);
-    compressed_bytes[i] = compress(block_vector);
-    header[3+i] = compressed_bytes[i].size();
+  std::streampos end = outfile.tellp();
+  outfile.seekp(header_position);
+  if (base64) {
+    outfile << Base64::Encode(header_bytes);
+  } else {
+    outfile.write((const char *)&header_bytes[0], std::streamsize(header_bytes.size()));
   }
+  outfile.seekp(end);
+  if (base64) outfile << '\n';
+}
+
+// without compression, the data is just [#bytes][DATA], and base64 text is encoded 
+// in parallel in pieces of whole 3-byte groups (which encode independently)
+template < typename header_int_t >
+void write_uncompressed_data(const uint8_t * data_bytes,
+                             std::size_t total_bytes,
+                             std::ofstream &outfile,
+                             bool base64)
+{
+  header_int_t header = header_int_t(total_bytes);
+  if (base64) {
+    std::vector<uint8_t> header_bytes(sizeof(header_int_t));
+    std::memcpy(&header_bytes[0], &header, sizeof(header_int_t));
+    outfile << Base64::Encode(header_bytes);
 
-  outfile << Base64::Encode(header_bytes);
-  for (const auto &compressed : compressed_bytes) {
-    outfile << Base64::Encode(compressed);
+    constexpr std::size_t bytes_per_piece = std::size_t(3) << 20;
+    int64_t num_pieces = int64_t((total_bytes + bytes_per_piece - 1) / bytes_per_piece);
+    write_in_parallel(outfile, num_pieces, [&](int64_t i, BufferWriter & buffer) {
+      std::size_t first = std::size_t(i) * bytes_per_piece;
+      std::size_t count = std::min(bytes_per_piece, total_bytes - first);
+      buffer.data.resize(Base64::EncodedSize(count));
+      Base64::Encode(data_bytes + first, count, &buffer.data[0]);
+    });
+    outfile << '\n';
+  } else {
+    outfile.write((const char *)&header, sizeof(header_int_t));
+    outfile.write((const char *)data_bytes, std::streamsize(total_bytes));
   }
-  outfile << '\n';
 }
 
 std::string type_name(uint32_t) { return "UInt32"; }
+std::string type_name(uint64_t) { return "UInt64"; }
 std::string type_name(int32_t) { return "Int32"; }
+std::string type_name(int64_t) { return "Int64"; }
 std::string type_name(float) { return "Float32"; }
 std::string type_name(double) { return "Float64"; }
 
-template < typename float_t, typename int_t, typename header_int_t = uint32_t >
-bool export_vtu_impl(const Mesh & mesh, std::string filename, std::size_t block_size_in_MB = 4) {
+// the values of a DataArray, which are either in the buffer passed 
+// to an ArrayBytes function, or somewhere that outlives the writer
+struct ByteSpan {
+  const uint8_t * data;
+  std::size_t size;
+};
+
+using ArrayBytes = std::function< ByteSpan(std::vector< uint8_t > & buffer) >;
 
-  int_t num_nodes = int_t(mesh.nodes.size());
-  int_t num_elements = int_t(mesh.elements.size());
+// writes DataArrays inline, as base64 text, or (with options.appended) as raw bytes 
+// in the <AppendedData> section after the grid. Appended DataArray tags come before
+// their data, so they're written with room for their offsets (20 digits, zero-padded), 
+// which are filled in once the data is written.
+template < typename header_int_t >
+struct DataArrayWriter {
+  std::ofstream & outfile;
+  const VtuExportOptions & options;
+  std::vector< std::pair< std::streampos, ArrayBytes > > appended;
+
+  // `attributes` are everything but the format (and offset) of the DataArray tag
+  void write(std::string attributes, ArrayBytes bytes) {
+    if (options.appended) {
+      outfile << "<DataArray " << attributes << " format=\"appended\" offset=\"";
+      appended.push_back({outfile.tellp(), std::move(bytes)});
+      outfile << std::string(20, '0') << "\"/>\n";
+    } else {
+      outfile << "<DataArray " << attributes << " format=\"binary\">\n";
+      std::vector< uint8_t > buffer;
+      write_data(bytes(buffer), true);
+      outfile << "</DataArray>\n";
+    }
+  }
+
+  void write_data(ByteSpan span, bool base64) {
+    if (options.compress) {
+      write_compressed_data<header_int_t>(span.data, span.size, outfile, options.block_size, base64);
+    } else {
+      write_uncompressed_data<header_int_t>(span.data, span.size, outfile, base64);
+    }
+  }
+
+  // (after </UnstructuredGrid>)
+  void write_appended_data() {
+    if (appended.empty()) return;
+    outfile << "<AppendedData encoding=\"raw\">\n_";
+    std::streampos start = outfile.tellp();
+    for (auto & [offset_position, bytes] : appended) {
+      std::streampos position = outfile.tellp();
+      std::vector< uint8_t > buffer;
+      write_data(bytes(buffer), false);
+
+      std::string offset = std::to_string(int64_t(position - start));
+      std::streampos end = outfile.tellp();
+      outfile.seekp(offset_position + std::streamoff(20 - offset.size()));
+      outfile << offset;
+      outfile.seekp(end);
+    }
+    outfile << "\n</AppendedData>\n";
+  }
+};
+
+// fields are written as they are stored in memory (byte_order is the native one), 
+// so their values are compressed straight from the field, without a copy
+template < typename header_int_t >
+void write_fields(const std::vector< Field > & fields, std::string section, DataArrayWriter< header_int_t > & arrays) {
+  if (fields.empty()) return;
+  arrays.outfile << "<" << section << ">\n";
+  for (auto & field : fields) {
+    std::visit([&](const auto & values) {
+      using T = typename std::decay_t< decltype(values) >::value_type;
+      arrays.write("type=\"" + type_name(T{}) + "\" Name=\"" + field.name + "\" NumberOfComponents=\"" + 
+                   std::to_string(field.num_components) + "\"", [&values](std::vector< uint8_t > &) {
+        return ByteSpan{reinterpret_cast< const uint8_t * >(values.data()), sizeof(T) * values.size()};
+      });
+    }, field.values);
+  }
+  arrays.outfile << "</" << section << ">\n";
+}
+
+template < typename float_t, typename int_t, typename header_int_t = uint32_t, typename mesh_t = Mesh >
+bool export_vtu_impl(const mesh_t & mesh, const Fields & fields, std::string filename, const VtuExportOptions & options) {
+
+  std::size_t num_nodes = mesh.nodes.size();
+  std::size_t num_elems = num_elements(mesh);
 
   std::ofstream outfile(filename, std::ios::binary | std::ios::trunc);
+  DataArrayWriter< header_int_t > arrays{outfile, options, {}};
 
   outfile << "<?xml version=\"1.0\"?>\n";
   std::string byte_order = is_big_endian ? "BigEndian" : "LittleEndian";
-  outfile << "<VTKFile type=\"UnstructuredGrid\" version=\"0.1\" byte_order=\"" << byte_order
-          << "\" compressor=\"vtkZLibDataCompressor\" header_type=\"" << type_name(header_int_t{}) << "\">\n";
+  outfile << "<VTKFile type=\"UnstructuredGrid\" version=\"0.1\" byte_order=\"" << byte_order << "\"";
+  if (options.compress) outfile << " compressor=\"vtkZLibDataCompressor\"";
+  outfile << " header_type=\"" << type_name(header_int_t{}) << "\">\n";
   outfile << "<UnstructuredGrid>\n";
-  outfile << "<Piece NumberOfPoints=\"" << mesh.nodes.size() << "\" NumberOfCells=\"" << mesh.elements.size() << "\">\n";
+  outfile << "<Piece NumberOfPoints=\"" << mesh.nodes.size() << "\" NumberOfCells=\"" << num_elems << "\">\n";
+
+  write_fields(fields.nodes, "PointData", arrays);
+  write_fields(fields.elements, "CellData", arrays);
 
   outfile << "<Points>\n";
-  outfile << "<DataArray type=\"" << type_name(float_t{}) << "\" Name=\"Points\" NumberOfComponents=\"3\" format=\"binary\">\n";
-  {
-    uint32_t data_bytes = num_nodes * sizeof(float_t) * 3;
-    std::vector<uint8_t> byte_vector(data_bytes);
-    uint8_t * ptr = &byte_vector[0];
-    append_to_byte_array(ptr, convert< float_t >(mesh.nodes));
-    write_compressed_data<header_int_t>(byte_vector, outfile, block_size_in_MB);
-  }
-  outfile << "</DataArray>\n";
+  arrays.write("type=\"" + type_name(float_t{}) + "\" Name=\"Points\" NumberOfComponents=\"3\"", [&](std::vector< uint8_t > & byte_vector) {
+    std::size_t data_bytes = num_nodes * sizeof(float_t) * 3;
+    byte_vector.resize(data_bytes);
+    uint8_t * ptr = byte_vector.data();
+    for (auto & p : mesh.nodes) {
+      for (auto x : p) {
+        append_to_byte_array(ptr, float_t(x));
+      }
+    }
+    return ByteSpan{byte_vector.data(), data_bytes};
+  });
   outfile << "</Points>\n";
 
   outfile << "<Cells>\n";
-  outfile << "<DataArray type=\"" << type_name(int_t{}) << "\" Name=\"connectivity\" format=\"binary\">\n";
-  {
-    uint32_t data_bytes = 0;
-    for (auto & elem : mesh.elements) {
-      data_bytes += sizeof(int_t) * nodes_per_elem(elem.type);
-    }
-    std::vector<uint8_t> byte_vector(data_bytes);
-    uint8_t * ptr = &byte_vector[0];
-    for (auto & elem : mesh.elements) {
+  arrays.write("type=\"" + type_name(int_t{}) + "\" Name=\"connectivity\"", [&](std::vector< uint8_t > & byte_vector) {
+    std::size_t data_bytes = 0;
+    for_each_element(mesh, [&](auto elem) {
+      data_bytes += sizeof(int_t) * vtk::permutation(elem.type).size;
+    });
+    byte_vector.resize(data_bytes);
+    uint8_t * ptr = byte_vector.data();
+    for_each_element(mesh, [&](auto elem) {
       for (int32_t i : vtk::permutation(elem.type)) {
         int_t id = elem.node_ids[i];
         append_to_byte_array(ptr, id);
       }
-    }
-    write_compressed_data<header_int_t>(byte_vector, outfile, block_size_in_MB);
-  }
-  outfile << "</DataArray>\n";
+    });
+    return ByteSpan{byte_vector.data(), data_bytes};
+  });
 
-  outfile << "<DataArray type=\"" << type_name(int_t{}) << "\" Name=\"offsets\" format=\"binary\">\n";
-  {
-    uint32_t data_bytes = num_elements * sizeof(int_t);
-    std::vector<uint8_t> byte_vector(data_bytes);
-    uint8_t * ptr = &byte_vector[0];
+  arrays.write("type=\"" + type_name(int_t{}) + "\" Name=\"offsets\"", [&](std::vector< uint8_t > & byte_vector) {
+    std::size_t data_bytes = num_elems * sizeof(int_t);
+    byte_vector.resize(data_bytes);
+    uint8_t * ptr = byte_vector.data();
     int_t offset = 0;
-    for (auto & elem : mesh.elements) {
-      offset += nodes_per_elem(elem.type);
+    for_each_element(mesh, [&](auto elem) {
+      offset += vtk::permutation(elem.type).size;
       append_to_byte_array(ptr, offset);
-    }
-    write_compressed_data<header_int_t>(byte_vector, outfile, block_size_in_MB);
-  }
-  outfile << "</DataArray>\n";
+    });
+    return ByteSpan{byte_vector.data(), data_bytes};
+  });
 
-  outfile << "<DataArray type=\"UInt8\" Name=\"types\" format=\"binary\">\n";
-  {
-    uint32_t data_bytes = num_elements;
-    std::vector<uint8_t> byte_vector(data_bytes);
-    uint8_t * ptr = &byte_vector[0];
-    for (auto & elem : mesh.elements) {
+  arrays.write("type=\"UInt8\" Name=\"types\"", [&](std::vector< uint8_t > & byte_vector) {
+    std::size_t data_bytes = num_elems;
+    byte_vector.resize(data_bytes);
+    uint8_t * ptr = byte_vector.data();
+    for_each_element(mesh, [&](auto elem) {
       uint8_t vtk_id = vtk::element_type(elem.type);
       append_to_byte_array(ptr, vtk_id);
-    }
-    write_compressed_data<header_int_t>(byte_vector, outfile, block_size_in_MB);
-  }
-  outfile << "</DataArray>\n";
+    });
+    return ByteSpan{byte_vector.data(), data_bytes};
+  });
   outfile << "</Cells>\n";
 
   outfile << "</Piece>\n";
   outfile << "</UnstructuredGrid>\n";
+  arrays.write_appended_data();
   outfile << "</VTKFile>\n";
 
   outfile.close();
@@ -189,8 +307,492 @@ bool export_vtu_impl(const Mesh & mesh, std::string filename, std::size_t block_
   return false;
 }
 
+// 32-bit connectivity and 32-bit block headers are used when they can represent the 
+// data, and 64-bit ones otherwise (or when the mesh itself uses 64-bit indices)
+template < typename mesh_t >
+bool export_vtu_auto(const mesh_t & mesh, const Fields & fields, const VtuExportOptions & options, std::size_t num_ids, std::string filename) {
+  check_fields(fields, mesh.nodes.size(), num_elements(mesh));
+  if (options.block_size == 0) exit_with_error("export_vtu: block_size must be at least 1 byte");
+
+  constexpr bool large_indices = sizeof(index_type_t< mesh_t >) > sizeof(int32_t);
+
+  bool large_connectivity = large_indices || num_ids > std::size_t(INT32_MAX);
+  std::size_t largest_array = std::max(mesh.nodes.size() * sizeof(float) * 3, 
+                                       num_ids * (large_connectivity ? sizeof(int64_t) : sizeof(int32_t)));
+  for (auto list : {&fields.nodes, &fields.elements}) {
+    for (auto & field : *list) {
+      std::visit([&](const auto & values) { 
+        largest_array = std::max(largest_array, sizeof(values[0]) * values.size()); 
+      }, field.values);
+    }
+  }
+  largest_array = std::max(largest_array, options.block_size);
+  bool large_arrays = large_indices || largest_array > std::size_t(UINT32_MAX);
+
+  if (large_connectivity) {
+    return export_vtu_impl<float, int64_t, uint64_t>(mesh, fields, filename, options);
+  } else if (large_arrays) {
+    return export_vtu_impl<float, int32_t, uint64_t>(mesh, fields, filename, options);
+  } else {
+    return export_vtu_impl<float, int32_t, uint32_t>(mesh, fields, filename, options);
+  }
+}
+
 bool export_vtu(const Mesh & mesh, std::string filename) {
-  return export_vtu_impl<float, int32_t, uint32_t>(mesh, filename, 4);
+  return export_vtu(mesh, filename, Fields{}, VtuExportOptions{});
+}
+
+bool export_vtu(const Mesh & mesh, std::string filename, const Fields & fields) {
+  return export_vtu(mesh, filename, fields, VtuExportOptions{});
+}
+
+bool export_vtu(const Mesh & mesh, std::string filename, const VtuExportOptions & options) {
+  return export_vtu(mesh, filename, Fields{}, options);
 }
 
+bool export_vtu(const Mesh & mesh, std::string filename, const Fields & fields, const VtuExportOptions & options) {
+  std::size_t num_ids = 0;
+  for (auto & elem : mesh.elements) {
+    num_ids += vtk::permutation(elem.type).size;
+  }
+  return export_vtu_auto(mesh, fields, options, num_ids, filename);
+}
+
+template < typename index_t >
+bool export_vtu(const FlatMesh< index_t > & mesh, std::string filename) {
+  return export_vtu(mesh, filename, Fields{}, VtuExportOptions{});
+}
+
+template < typename index_t >
+bool export_vtu(const FlatMesh< index_t > & mesh, std::string filename, const Fields & fields) {
+  return export_vtu(mesh, filename, fields, VtuExportOptions{});
+}
+
+template < typename index_t >
+bool export_vtu(const FlatMesh< index_t > & mesh, std::string filename, const VtuExportOptions & options) {
+  return export_vtu(mesh, filename, Fields{}, options);
+}
+
+template < typename index_t >
+bool export_vtu(const FlatMesh< index_t > & mesh, std::string filename, const Fields & fields, const VtuExportOptions & options) {
+  return export_vtu_auto(mesh, fields, options, mesh.connectivity.size(), filename);
+}
+
+template bool export_vtu(const FlatMesh< int32_t > &, std::string);
+template bool export_vtu(const FlatMesh< int64_t > &, std::string);
+template bool export_vtu(const FlatMesh< int32_t > &, std::string, const Fields &);
+template bool export_vtu(const FlatMesh< int64_t > &, std::string, const Fields &);
+template bool export_vtu(const FlatMesh< int32_t > &, std::string, const VtuExportOptions &);
+template bool export_vtu(const FlatMesh< int64_t > &, std::string, const VtuExportOptions &);
+template bool export_vtu(const FlatMesh< int32_t > &, std::string, const Fields &, const VtuExportOptions &);
+template bool export_vtu(const FlatMesh< int64_t > &, std::string, const Fields &, const VtuExportOptions &);
+
+////////////
+// import //
+////////////
+
+// the value of attribute `name` in the xml tag `tag`, or "" if it doesn't have one
+static std::string_view attribute(std::string_view tag, std::string_view name) {
+  for (std::size_t pos = tag.find(name); pos != std::string_view::npos; pos = tag.find(name, pos + 1)) {
+    std::size_t after = pos + name.size();
+    if (pos > 0 && BufferReader::is_space(tag[pos - 1]) && tag.substr(after, 2) == "=\"") {
+      std::size_t stop = tag.find('"', after + 2);
+      if (stop == std::string_view::npos) break;
+      return tag.substr(after + 2, stop - after - 2);
+    }
+  }
+  return {};
+}
+
+// the next xml tag <name ...> at or after `pos` (and before `limit`), 
+// or "" if there isn't one. `pos` is left just past the tag.
+static std::string_view next_tag(std::string_view text, std::size_t & pos, std::string_view name, std::size_t limit) {
+  std::string open = "<" + std::string(name);
+  for (std::size_t start = text.find(open, pos); start < limit; start = text.find(open, start + 1)) {
+    char after = text[start + open.size()];
+    if (!BufferReader::is_space(after) && after != '>' && after != '/') continue;
+    std::size_t stop = text.find('>', start);
+    if (stop == std::string_view::npos) break;
+    pos = stop + 1;
+    return text.substr(start, stop + 1 - start);
+  }
+  return {};
+}
+
+struct VtuEncoding {
+  bool swap_bytes;  // the file's byte order isn't the native one
+  int header_bytes; // 4 for header_type="UInt32", 8 for "UInt64"
+  bool compressed;
+  const char * appended;     // the raw <AppendedData> (after the '_'), or nullptr if there isn't any
+  const char * appended_end; // (the end of the file)
+};
+
+// value i of the header of a binary array
+static uint64_t header_value(const uint8_t * header, std::size_t i, const VtuEncoding & encoding) {
+  uint64_t value = 0;
+  if (encoding.header_bytes == 4) {
+    uint32_t v;
+    std::memcpy(&v, header + 4 * i, 4);
+    value = encoding.swap_bytes ? byte_swap(v) : v;
+  } else {
+    std::memcpy(&value, header + 8 * i, 8);
+    if (encoding.swap_bytes) value = byte_swap(value);
+  }
+  return value;
+}
+
+// inflate the zlib blocks, where block b is [compressed + offsets[b], compressed + offsets[b + 1]),
+// in parallel. Every block but the last has block_size bytes, and the last one has 
+// last_block_size bytes (or block_size, if that's 0).
+static bool inflate_blocks(const uint8_t * compressed, const std::vector< std::size_t > & offsets, 
+                           uint64_t block_size, uint64_t last_block_size, std::vector< uint8_t > & values) {
+  uint64_t num_blocks = offsets.size() - 1;
+  uint64_t last_capacity = last_block_size ? last_block_size : block_size;
+  values.resize((num_blocks - 1) * block_size + last_capacity);
+  std::vector< uLongf > sizes(num_blocks);
+  std::atomic< bool > ok(true);
+  parallel_for(int64_t(num_blocks), [&](int64_t b) {
+    bool last = (uint64_t(b) == num_blocks - 1);
+    sizes[b] = uLongf(last ? last_capacity : block_size);
+    int error = uncompress(values.data() + b * block_size, &sizes[b], 
+                           compressed + offsets[b], uLong(offsets[b + 1] - offsets[b]));
+    if (error != Z_OK || (!last && sizes[b] != block_size)) ok = false;
+  });
+
+  // (export_vtu ends arrays that are a multiple of the block size with an empty block)
+  values.resize((num_blocks - 1) * block_size + sizes[num_blocks - 1]);
+  return ok;
+}
+
+static std::size_t base64_length(std::size_t bytes) { return 4 * ((bytes + 2) / 3); }
+
+// whether [begin, end) is exactly the (padded) encoding of `bytes` bytes. Lengths
+// alone can't tell the layouts below apart, but where the padding is can.
+static bool encodes(const char * begin, const char * end, std::size_t bytes) {
+  if (std::size_t(end - begin) != base64_length(bytes)) return false;
+  if (bytes == 0) return true;
+  std::size_t padding = (3 - bytes % 3) % 3;
+  for (std::size_t i = 1; i <= 2; i++) {
+    if ((end[-int64_t(i)] == '=') != (i <= padding)) return false;
+  }
+  return true;
+}
+
+// the pieces of base64 text that decode to consecutive bytes, and where they go 
+struct Base64Piece {
+  const char * begin;
+  const char * end;
+  std::size_t offset;
+};
+
+static bool decode_pieces(const std::vector< Base64Piece > & pieces, uint8_t * output) {
+  std::atomic< bool > ok(true);
+  parallel_for(int64_t(pieces.size()), [&](int64_t i) {
+    if (!Base64::Decode(pieces[i].begin, pieces[i].end, output + pieces[i].offset)) ok = false;
+  });
+  return ok;
+}
+
+// a single padded stream of base64 text, split into pieces of whole groups
+static std::vector< Base64Piece > split_stream(const char * begin, const char * end, std::size_t offset) {
+  static constexpr std::size_t chars_per_piece = std::size_t(1) << 20;
+  std::vector< Base64Piece > pieces;
+  for (const char * p = begin; p < end; p += std::min< std::size_t >(chars_per_piece, std::size_t(end - p))) {
+    const char * stop = p + std::min< std::size_t >(chars_per_piece, std::size_t(end - p));
+    pieces.push_back({p, stop, offset});
+    offset += std::size_t(stop - p) / 4 * 3;
+  }
+  return pieces;
+}
+
+// decode a format="binary" DataArray, whose contents are the base64 text [begin, end),
+// to its values (in native byte order). Writers (including export_vtu) encode the 
+// header and each compressed block separately, so there may be padding between 
+// them, but a single stream for the whole array is read as well.
+static std::vector< uint8_t > decode_binary(const char * begin, const char * end, const VtuEncoding & encoding, int value_size) {
+
+  while (begin < end && BufferReader::is_space(*begin)) begin++;
+  while (end > begin && BufferReader::is_space(end[-1])) end--;
+
+  // the text is only split up at whitespace in unusual files, which are
+  // copied without it (as the pieces below have to be whole groups of 4)
+  std::string compact;
+  if (std::find_if(begin, end, BufferReader::is_space) != end) {
+    compact.reserve(std::size_t(end - begin));
+    std::copy_if(begin, end, std::back_inserter(compact), [](char c) { return !BufferReader::is_space(c); });
+    begin = compact.data();
+    end = compact.data() + compact.size();
+  }
+  std::size_t length = std::size_t(end - begin);
+
+  int h = encoding.header_bytes;
+
+  auto invalid = []() { exit_with_error("invalid file format (vtu binary data)"); };
+  std::vector< uint8_t > values;
+
+  if (!encoding.compressed) {
+    // [#bytes][DATA]
+    uint8_t first[12];
+    if (length < base64_length(h) || !Base64::Decode(begin, begin + base64_length(h), first)) invalid();
+    uint64_t num_bytes = header_value(first, 0, encoding);
+    values.resize(num_bytes);
+    const char * data = begin + base64_length(h);
+    if (encodes(begin, data, h) && encodes(data, end, num_bytes)) {
+      if (!decode_pieces(split_stream(data, end, 0), values.data())) invalid();
+    } else if (encodes(begin, end, h + num_bytes)) {
+      std::vector< uint8_t > bytes(Base64::DecodedSize(begin, end));
+      if (!decode_pieces(split_stream(begin, end, 0), bytes.data())) invalid();
+      std::memcpy(values.data(), bytes.data() + h, num_bytes);
+    } else {
+      invalid();
+    }
+  } else {
+    // [#blocks][#u-size][#p-size][#c-size-1]...[#c-size-#blocks][DATA]
+    uint8_t first[12];
+    if (length < base64_length(h) || !Base64::Decode(begin, begin + base64_length(h), first)) invalid();
+    uint64_t num_blocks = header_value(first, 0, encoding);
+    std::size_t header_bytes = (3 + num_blocks) * h;
+    std::size_t header_length = base64_length(header_bytes);
+    if (num_blocks == 0 || num_blocks > length || header_length > length) invalid();
+
+    std::vector< uint8_t > header(Base64::DecodedSize(begin, begin + header_length));
+    if (!Base64::Decode(begin, begin + header_length, header.data())) invalid();
+    uint64_t block_size = header_value(header.data(), 1, encoding);
+    uint64_t last_block_size = header_value(header.data(), 2, encoding);
+
+    std::vector< std::size_t > compressed_offsets(num_blocks + 1, 0);
+    std::size_t separate_length = header_length;
+    for (uint64_t b = 0; b < num_blocks; b++) {
+      uint64_t c = header_value(header.data(), 3 + b, encoding);
+      compressed_offsets[b + 1] = compressed_offsets[b] + c;
+      separate_length += base64_length(c);
+    }
+    std::size_t compressed_bytes = compressed_offsets[num_blocks];
+    const char * data = begin + header_length;
+    bool separate_header = encodes(begin, data, header_bytes);
+
+    // the header and blocks are usually encoded separately, but some
+    // writers encode the blocks (or everything) as one stream
+    std::vector< uint8_t > compressed(compressed_bytes);
+    std::vector< Base64Piece > pieces;
+    bool one_stream = false;
+    if (separate_header && length == separate_length) {
+      const char * p = data;
+      for (uint64_t b = 0; b < num_blocks && pieces.size() == b; b++) {
+        std::size_t c = compressed_offsets[b + 1] - compressed_offsets[b];
+        if (encodes(p, p + base64_length(c), c)) pieces.push_back({p, p + base64_length(c), compressed_offsets[b]});
+        p += base64_length(c);
+      }
+    }
+    if (pieces.size() == num_blocks) {
+      // (already split up)
+    } else if (separate_header && encodes(data, end, compressed_bytes)) {
+      pieces = split_stream(data, end, 0);
+    } else if (encodes(begin, end, header_bytes + compressed_bytes)) {
+      one_stream = true;
+      pieces = split_stream(begin, end, 0);
+    } else {
+      invalid();
+    }
+    if (!one_stream) {
+      if (!decode_pieces(pieces, compressed.data())) invalid();
+    } else {
+      std::vector< uint8_t > bytes(Base64::DecodedSize(begin, end));
+      if (!decode_pieces(pieces, bytes.data())) invalid();
+      std::memcpy(compressed.data(), bytes.data() + header_bytes, compressed_bytes);
+    }
+
+    if (!inflate_blocks(compressed.data(), compressed_offsets, block_size, last_block_size, values)) invalid();
+  }
+
+  if (values.size() % std::size_t(value_size) != 0) invalid();
+  if (encoding.swap_bytes) byte_swap(values.data(), values.data(), values.size() / value_size, std::size_t(value_size));
+  return values;
+}
+
+// the value of an integer attribute, or -1 if it's missing or invalid
+static int64_t integer_attribute(std::string_view tag, std::string_view name) {
+  std::string_view value = attribute(tag, name);
+  BufferReader in{value.data(), value.data() + value.size()};
+  int64_t result = in.integer< int64_t >();
+  return (in.ok && in.done() && !value.empty()) ? result : -1;
+}
+
+// decode a format="appended" DataArray from raw <AppendedData>, which is laid out 
+// the same way as binary data (without the base64), starting at `begin`
+static std::vector< uint8_t > decode_appended(const char * begin, const char * end, const VtuEncoding & encoding, int value_size) {
+  auto invalid = []() { exit_with_error("invalid file format (vtu appended data)"); };
+  const uint8_t * data = reinterpret_cast< const uint8_t * >(begin);
+  std::size_t length = std::size_t(end - begin);
+  std::size_t h = std::size_t(encoding.header_bytes);
+  if (length < h) invalid();
+
+  std::vector< uint8_t > values;
+  if (!encoding.compressed) {
+    // [#bytes][DATA]
+    uint64_t num_bytes = header_value(data, 0, encoding);
+    if (num_bytes > length - h) invalid();
+    values.assign(data + h, data + h + num_bytes);
+  } else {
+    // [#blocks][#u-size][#p-size][#c-size-1]...[#c-size-#blocks][DATA]
+    uint64_t num_blocks = header_value(data, 0, encoding);
+    if (num_blocks == 0 || num_blocks > length / h || (3 + num_blocks) * h > length) invalid();
+    std::size_t header_bytes = (3 + num_blocks) * h;
+    std::vector< std::size_t > offsets(num_blocks + 1, 0);
+    for (uint64_t b = 0; b < num_blocks; b++) {
+      offsets[b + 1] = offsets[b] + header_value(data, 3 + b, encoding);
+      if (offsets[b + 1] > length - header_bytes) invalid();
+    }
+    uint64_t block_size = header_value(data, 1, encoding);
+    uint64_t last_block_size = header_value(data, 2, encoding);
+    if (!inflate_blocks(data + header_bytes, offsets, block_size, last_block_size, values)) invalid();
+  }
+
+  if (values.size() % std::size_t(value_size) != 0) invalid();
+  if (encoding.swap_bytes) byte_swap(values.data(), values.data(), values.size() / value_size, std::size_t(value_size));
+  return values;
+}
+
+// the values of a DataArray (which must have `count` of them, unless 
+// count is npos), converted to T. `pos` is left at the closing tag.
+template < typename T >
+static std::vector< T > read_data_array(std::string_view text, std::size_t & pos, std::string_view tag, 
+                                        const VtuEncoding & encoding, std::size_t count) {
+  std::string_view type = attribute(tag, "type");
+  std::string_view format = attribute(tag, "format");
+  const char * begin = text.data() + pos;
+  const char * end = begin;
+  if (tag.substr(tag.size() - 2) != "/>") {
+    std::size_t stop = text.find("</DataArray>", pos);
+    if (stop == std::string_view::npos) exit_with_error("invalid file format (vtu)");
+    end = text.data() + stop;
+    pos = stop;
+  }
+
+  int size = value_bytes(type);
+  if (format != "ascii" && size == 0) exit_with_error("unsupported data array type: " + std::string(type));
+
+  bool ok = true;
+  std::vector< T > values;
+  if (format == "ascii") {
+    values = parse_ascii_values< T >(begin, end, ok);
+  } else if (format == "binary") {
+    std::vector< uint8_t > bytes = decode_binary(begin, end, encoding, size);
+    values = convert_values< T >(bytes.data(), bytes.size() / size, type);
+  } else if (format == "appended") {
+    int64_t offset = integer_attribute(tag, "offset");
+    if (!encoding.appended || offset < 0 || offset > encoding.appended_end - encoding.appended) {
+      exit_with_error("invalid file format (vtu appended data)");
+    }
+    std::vector< uint8_t > bytes = decode_appended(encoding.appended + offset, encoding.appended_end, encoding, size);
+    values = convert_values< T >(bytes.data(), bytes.size() / size, type);
+  } else {
+    exit_with_error("unsupported data array format (vtu): " + std::string(format));
+  }
+
+  if (!ok || (count != std::string_view::npos && values.size() != count)) {
+    exit_with_error("invalid file format (vtu " + std::string(attribute(tag, "Name")) + ")");
+  }
+  return values;
+}
+
+template < typename mesh_t >
+mesh_t import_vtu(std::string filename) {
+
+  MappedFile file(filename);
+
+  if (!file.is_open()) {
+    std::cout << "error: " << filename << " not found" << std::endl;
+    exit(1);
+  }
+
+  std::string_view text(file.data(), file.size());
+  std::size_t pos = 0;
+  std::size_t npos = std::string_view::npos;
+
+  std::string_view header = next_tag(text, pos, "VTKFile", npos);
+  if (header.empty() || attribute(header, "type") != "UnstructuredGrid") {
+    exit_with_error("invalid file format (vtu): only UnstructuredGrid files are supported");
+  }
+
+  VtuEncoding encoding;
+  std::string_view byte_order = attribute(header, "byte_order");
+  encoding.swap_bytes = (byte_order == (is_big_endian ? "LittleEndian" : "BigEndian"));
+  std::string_view header_type = attribute(header, "header_type");
+  encoding.header_bytes = (header_type == "UInt64") ? 8 : 4;
+  std::string_view compressor = attribute(header, "compressor");
+  encoding.compressed = !compressor.empty();
+  if (encoding.compressed && compressor != "vtkZLibDataCompressor") {
+    exit_with_error("unsupported vtu compressor: " + std::string(compressor));
+  }
+
+  std::string_view piece = next_tag(text, pos, "Piece", npos);
+  int64_t num_points = integer_attribute(piece, "NumberOfPoints");
+  int64_t num_cells = integer_attribute(piece, "NumberOfCells");
+  if (piece.empty() || num_points < 0 || num_cells < 0) {
+    exit_with_error("invalid file format (vtu piece)");
+  }
+  std::size_t piece_end = std::min(text.find("</Piece>", pos), text.size());
+
+  // (the raw data starts after the first '_' in the section)
+  encoding.appended = nullptr;
+  encoding.appended_end = text.data() + text.size();
+  std::size_t appended_pos = piece_end;
+  std::string_view appended = next_tag(text, appended_pos, "AppendedData", text.size());
+  if (!appended.empty()) {
+    if (attribute(appended, "encoding") != "raw") {
+      exit_with_error("unsupported vtu appended data encoding: " + std::string(attribute(appended, "encoding")));
+    }
+    std::size_t underscore = text.find('_', appended_pos);
+    if (underscore != std::string_view::npos) encoding.appended = text.data() + underscore + 1;
+  }
+
+  mesh_t mesh;
+
+  // <Points> has a single DataArray, with 3 components
+  std::size_t points_pos = pos;
+  if (next_tag(text, points_pos, "Points", piece_end).empty()) exit_with_error("invalid file format (vtu points)");
+  std::string_view points_tag = next_tag(text, points_pos, "DataArray", piece_end);
+  if (points_tag.empty() || (!attribute(points_tag, "NumberOfComponents").empty() && attribute(points_tag, "NumberOfComponents") != "3")) {
+    exit_with_error("invalid file format (vtu points)");
+  }
+  std::vector< double > coordinates = read_data_array< double >(text, points_pos, points_tag, encoding, 3 * std::size_t(num_points));
+  mesh.nodes.resize(std::size_t(num_points));
+  std::memcpy(mesh.nodes.data(), coordinates.data(), sizeof(double) * coordinates.size());
+  std::vector< double >().swap(coordinates);
+
+  // <Cells> has connectivity, offsets and types, in any order
+  VtkCells cells;
+  std::size_t cells_pos = pos;
+  if (next_tag(text, cells_pos, "Cells", piece_end).empty()) exit_with_error("invalid file format (vtu cells)");
+  std::size_t cells_end = std::min(text.find("</Cells>", cells_pos), piece_end);
+  std::vector< int64_t > offsets;
+  bool have_connectivity = false;
+  for (std::string_view tag; !(tag = next_tag(text, cells_pos, "DataArray", cells_end)).empty(); ) {
+    std::string_view name = attribute(tag, "Name");
+    if (name == "offsets") {
+      offsets = read_data_array< int64_t >(text, cells_pos, tag, encoding, std::size_t(num_cells));
+    } else if (name == "types") {
+      cells.types = read_data_array< uint8_t >(text, cells_pos, tag, encoding, std::size_t(num_cells));
+    } else if (name == "connectivity") {
+      // its size is only known from the offsets, so it's checked by set_cells
+      cells.connectivity = read_data_array< int64_t >(text, cells_pos, tag, encoding, std::string_view::npos);
+      have_connectivity = true;
+    }
+  }
+  if (!have_connectivity || int64_t(offsets.size()) != num_cells || int64_t(cells.types.size()) != num_cells) {
+    exit_with_error("invalid file format (vtu cells)");
+  }
+  cells.offsets.resize(std::size_t(num_cells) + 1);
+  std::copy(offsets.begin(), offsets.end(), cells.offsets.begin() + 1);
+
+  set_cells(mesh, cells, "vtu");
+
+  return mesh;
+}
+
+template Mesh import_vtu(std::string);
+template FlatMesh< int32_t > import_vtu(std::string);
+template FlatMesh< int64_t > import_vtu(std::string);
+
 }
@@ -0,0 +1,287 @@
+#include "weld.hpp"
+
+#include "util.hpp"
+#include "parallel.hpp"
+
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+static uint64_t mix(uint64_t h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdull;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ull;
+  h ^= h >> 33;
+  return h;
+}
+
+static uint64_t hash3(uint64_t a, uint64_t b, uint64_t c) {
+  return mix(a + mix(b + mix(c)));
+}
+
+// for exact matches, the bits of the coordinates themselves
+static uint64_t hash_position(const std::array< double, 3 > & x) {
+  uint64_t bits[3];
+  for (int i = 0; i < 3; i++) {
+    double c = (x[i] == 0.0) ? 0.0 : x[i]; // so that -0.0 matches 0.0
+    std::memcpy(&bits[i], &c, sizeof(double));
+  }
+  return hash3(bits[0], bits[1], bits[2]);
+}
+
+static int64_t cell_coordinate(double x) {
+  double c = std::floor(x);
+  if (!(std::abs(c) < 4.0e18)) return (c > 0) ? int64_t(4.0e18) : -int64_t(4.0e18);
+  return int64_t(c);
+}
+
+// concurrent union-find, where a root is only ever linked to a root with a
+// smaller index. So, whatever order the links happen in, every group ends up
+// with its lowest-numbered vertex as the root.
+template < typename index_t >
+static index_t find(std::vector< std::atomic< index_t > > & parent, index_t v) {
+  while (true) {
+    index_t p = parent[v].load(std::memory_order_relaxed);
+    if (p == v) return v;
+    index_t grandparent = parent[p].load(std::memory_order_relaxed);
+    if (p != grandparent) parent[v].compare_exchange_weak(p, grandparent, std::memory_order_relaxed);
+    v = grandparent;
+  }
+}
+
+template < typename index_t >
+static void unite(std::vector< std::atomic< index_t > > & parent, index_t a, index_t b) {
+  while (true) {
+    a = find(parent, a);
+    b = find(parent, b);
+    if (a == b) return;
+    if (a > b) std::swap(a, b);
+    index_t expected = b;
+    if (parent[b].compare_exchange_strong(expected, a, std::memory_order_relaxed)) return;
+  }
+}
+
+// replace `nodes` with the group roots (in order), and return the new index of every vertex
+template < typename index_t >
+static std::vector< index_t > compact(std::vector< std::array< double, 3 > > & nodes, const std::vector< index_t > & root) {
+  int64_t n = int64_t(nodes.size());
+
+  std::vector< index_t > new_ids(n);
+  index_t num_groups = 0;
+  for (int64_t v = 0; v < n; v++) {
+    if (root[v] == v) new_ids[v] = num_groups++;
+  }
+
+  std::vector< std::array< double, 3 > > compacted(num_groups);
+  parallel_for(n, [&](int64_t v) {
+    if (root[v] == v) {
+      compacted[new_ids[v]] = nodes[v];
+    } else {
+      new_ids[v] = new_ids[root[v]];
+    }
+  });
+  nodes.swap(compacted);
+
+  return new_ids;
+}
+
+// Identical vertices are found by partitioning copies of the vertices by the
+// high bits of a hash of their positions, into pieces small enough for a 
+// table of each piece to stay in cache. The partitioning is stable, so the 
+// first copy in a piece is also the lowest-numbered one.
+template < typename index_t >
+static std::vector< index_t > merge_identical(std::vector< std::array< double, 3 > > & nodes) {
+  int64_t n = int64_t(nodes.size());
+
+  struct Record {
+    std::array< double, 3 > x;
+    index_t index;
+    uint32_t hash; // the low bits, for the table
+  };
+
+  int partition_bits = 0;
+  while ((int64_t(32768) << partition_bits) < n) partition_bits++;
+  int64_t num_partitions = int64_t(1) << partition_bits;
+  auto partition = [partition_bits](uint64_t hash) { 
+    return partition_bits ? int64_t(hash >> (64 - partition_bits)) : 0; 
+  };
+
+  int64_t num_blocks = std::max< int64_t >(1, std::min< int64_t >(io::get_num_threads(), n >> 16));
+  auto block_begin = [&](int64_t b) { return (n * b) / num_blocks; };
+
+  std::vector< std::vector< int64_t > > offsets(num_blocks, std::vector< int64_t >(num_partitions, 0));
+  parallel_for(num_blocks, [&](int64_t b) {
+    for (int64_t v = block_begin(b); v < block_begin(b + 1); v++) {
+      offsets[b][partition(hash_position(nodes[v]))]++;
+    }
+  });
+
+  // ordered by partition, and then by block within each partition
+  std::vector< int64_t > partition_begin(num_partitions + 1, 0);
+  int64_t total = 0;
+  for (int64_t p = 0; p < num_partitions; p++) {
+    partition_begin[p] = total;
+    for (auto & count : offsets) {
+      int64_t c = count[p];
+      count[p] = total;
+      total += c;
+    }
+  }
+  partition_begin[num_partitions] = total;
+
+  std::vector< Record > records(n);
+  parallel_for(num_blocks, [&](int64_t b) {
+    auto & offset = offsets[b];
+    for (int64_t v = block_begin(b); v < block_begin(b + 1); v++) {
+      uint64_t hash = hash_position(nodes[v]);
+      records[offset[partition(hash)]++] = Record{nodes[v], index_t(v), uint32_t(hash)};
+    }
+  });
+  offsets.clear();
+
+  std::vector< index_t > root(n);
+  parallel_for(num_partitions, [&](int64_t p) {
+    const Record * begin = records.data() + partition_begin[p];
+    const Record * end = records.data() + partition_begin[p + 1];
+
+    uint32_t mask = 15;
+    while (mask < 2 * uint32_t(end - begin)) mask = 2 * mask + 1;
+    std::vector< const Record * > table(std::size_t(mask) + 1, nullptr);
+
+    for (const Record * r = begin; r < end; r++) {
+      uint32_t slot = r->hash & mask;
+      while (table[slot] && !(table[slot]->hash == r->hash && table[slot]->x == r->x)) {
+        slot = (slot + 1) & mask;
+      }
+      if (!table[slot]) table[slot] = r;
+      root[r->index] = table[slot]->index;
+    }
+  });
+
+  return compact(nodes, root);
+}
+
+// vertices are sorted into buckets by a hash of the grid cell they're in.
+// With cells twice as wide as the tolerance, any vertex that is close enough
+// to another one is in the same cell, or in a neighbor across one of the
+// cell faces that it is within `tolerance` of (so, 8 cells to check)
+template < typename index_t >
+static std::vector< index_t > merge_nearby(std::vector< std::array< double, 3 > > & nodes, double tolerance) {
+  int64_t n = int64_t(nodes.size());
+
+  // there are fewer buckets than twice the number of vertices, so they fit in index_t too
+  using bucket_t = std::make_unsigned_t< index_t >;
+
+  double inverse_cell_size = 0.5 / tolerance;
+  double tolerance_squared = tolerance * tolerance;
+
+  int bits = 1;
+  while ((int64_t(1) << bits) < n) bits++;
+  std::size_t num_buckets = std::size_t(1) << bits;
+  auto cell_hash = [](int64_t i, int64_t j, int64_t k) { return hash3(uint64_t(i), uint64_t(j), uint64_t(k)); };
+  auto bucket = [bits](uint64_t hash) { return bucket_t(hash >> (64 - bits)); };
+
+  // most neighboring cells are empty, so there's also a bitset (small enough 
+  // to stay in cache) of the cells that might have a vertex in them
+  int filter_bits = bits + 4;
+  std::vector< std::atomic< uint64_t > > occupied(((std::size_t(1) << filter_bits) + 63) / 64);
+  auto filter = [filter_bits](uint64_t hash) { return hash >> (64 - filter_bits); };
+
+  // counting sort of the vertices by bucket, where the order within
+  // a bucket doesn't matter (so it can depend on the thread timing)
+  std::vector< bucket_t > home(n);
+  std::vector< std::atomic< index_t > > cursor(num_buckets);
+  parallel_for(n, [&](int64_t v) {
+    const auto & x = nodes[v];
+    uint64_t hash = cell_hash(cell_coordinate(x[0] * inverse_cell_size),
+                              cell_coordinate(x[1] * inverse_cell_size),
+                              cell_coordinate(x[2] * inverse_cell_size));
+    home[v] = bucket(hash);
+    cursor[home[v]].fetch_add(1, std::memory_order_relaxed);
+    occupied[filter(hash) / 64].fetch_or(uint64_t(1) << (filter(hash) % 64), std::memory_order_relaxed);
+  });
+
+  std::vector< index_t > start(num_buckets + 1);
+  start[0] = 0;
+  for (std::size_t b = 0; b < num_buckets; b++) {
+    start[b + 1] = start[b] + cursor[b].load(std::memory_order_relaxed);
+    cursor[b].store(start[b], std::memory_order_relaxed);
+  }
+
+  // the positions are copied in bucket order, so that scanning a bucket is contiguous
+  std::vector< index_t > order(n);
+  std::vector< std::array< double, 3 > > positions(n);
+  parallel_for(n, [&](int64_t v) {
+    index_t i = cursor[home[v]].fetch_add(1, std::memory_order_relaxed);
+    order[i] = index_t(v);
+    positions[i] = nodes[v];
+  });
+  std::vector< std::atomic< index_t > >().swap(cursor);
+  std::vector< bucket_t >().swap(home);
+
+  std::vector< std::atomic< index_t > > parent(n);
+  parallel_for(n, [&](int64_t v) { parent[v].store(index_t(v), std::memory_order_relaxed); });
+
+  parallel_for(n, [&](int64_t i) {
+    index_t v = order[i];
+    const auto & x = positions[i];
+
+    int64_t cell[3], neighbor[3];
+    for (int d = 0; d < 3; d++) {
+      double c = x[d] * inverse_cell_size;
+      cell[d] = cell_coordinate(c);
+      neighbor[d] = (c - std::floor(c) < 0.5) ? cell[d] - 1 : cell[d] + 1;
+    }
+
+    bucket_t visited[8];
+    int num_visited = 0;
+    for (int corner = 0; corner < 8; corner++) {
+      uint64_t hash = cell_hash((corner & 1) ? neighbor[0] : cell[0],
+                                (corner & 2) ? neighbor[1] : cell[1],
+                                (corner & 4) ? neighbor[2] : cell[2]);
+      if (corner > 0 && !(occupied[filter(hash) / 64].load(std::memory_order_relaxed) & (uint64_t(1) << (filter(hash) % 64)))) continue;
+
+      bucket_t b = bucket(hash);
+      if (std::find(visited, visited + num_visited, b) != visited + num_visited) continue;
+      visited[num_visited++] = b;
+
+      for (index_t j = start[b]; j < start[b + 1]; j++) {
+        index_t u = order[j];
+        if (u >= v) continue;
+        const auto & y = positions[j];
+        double dx = x[0] - y[0], dy = x[1] - y[1], dz = x[2] - y[2];
+        if (dx * dx + dy * dy + dz * dz <= tolerance_squared) unite(parent, u, v);
+      }
+    }
+  });
+
+  std::vector< index_t > root(n);
+  parallel_for(n, [&](int64_t v) { root[v] = find(parent, index_t(v)); });
+  std::vector< std::atomic< index_t > >().swap(parent);
+
+  return compact(nodes, root);
+}
+
+template < typename index_t >
+std::vector< index_t > weld_vertices(std::vector< std::array< double, 3 > > & nodes, double tolerance) {
+  if (nodes.size() > std::size_t(std::numeric_limits< index_t >::max())) {
+    exit_with_error("too many vertices to weld with " + std::to_string(8 * sizeof(index_t)) + "-bit ids");
+  }
+
+  // exact copies are by far the most common, and cheaper to find, so
+  // they're merged first, and only the distinct positions are compared
+  // against their neighbors (which keeps the lowest-numbered vertex of 
+  // each group, since the distinct positions are in order of first appearance)
+  std::vector< index_t > new_ids = merge_identical< index_t >(nodes);
+  if (tolerance > 0.0) {
+    std::vector< index_t > nearby_ids = merge_nearby< index_t >(nodes, tolerance);
+    parallel_for(int64_t(new_ids.size()), [&](int64_t v) { new_ids[v] = nearby_ids[new_ids[v]]; });
+  }
+  return new_ids;
+}
+
+template std::vector< int32_t > weld_vertices(std::vector< std::array< double, 3 > > &, double);
+template std::vector< int64_t > weld_vertices(std::vector< std::array< double, 3 > > &, double);
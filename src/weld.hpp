@@ -0,0 +1,15 @@
+#pragma once
+
+#include <array>
+#include <vector>
+
+// merges vertices that are within `tolerance` of each other (or exactly equal,
+// for a tolerance of 0), where vertices are grouped transitively: if a is
+// close to b and b is close to c, then all three end up as one node.
+//
+// Each group keeps the position of its lowest-numbered vertex, the groups are
+// numbered in order of their lowest-numbered vertices, and `nodes` is replaced
+// by one node per group. The return value is the new index of every vertex,
+// as the index type of the mesh the vertices are going into.
+template < typename index_t >
+std::vector< index_t > weld_vertices(std::vector< std::array< double, 3 > > & nodes, double tolerance);
@@ -0,0 +1,124 @@
+#include "gtest/gtest.h"
+
+#include "common.hpp"
+
+#include <algorithm>
+
+using io::FlatMesh;
+
+static vec3 operator-(const vec3 & a, const vec3 & b) { return {a[0] - b[0], a[1] - b[1], a[2] - b[2]}; }
+static double dot(const vec3 & a, const vec3 & b) { return a[0] * b[0] + a[1] * b[1] + a[2] * b[2]; }
+static vec3 cross(const vec3 & a, const vec3 & b) {
+    return {a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0]};
+}
+
+static vec3 average(const Mesh & mesh, const std::vector< int > & ids) {
+    vec3 sum{0.0, 0.0, 0.0};
+    for (int id : ids) for (int j = 0; j < 3; j++) sum[j] += mesh.nodes[id][j] / ids.size();
+    return sum;
+}
+
+static int num_corners(Element::Type type) {
+    return (type == Element::Type::Tri3 || type == Element::Type::Tri6) ? 3 : 4;
+}
+
+TEST(boundary, single_elements) {
+    struct Case { Element::Type type; int corners; int num_tris; int num_quads; Element::Type tri; Element::Type quad; };
+    std::vector< Case > cases = {
+        {Element::Type::Tet4,    4, 4, 0, Element::Type::Tri3, Element::Type::Quad4},
+        {Element::Type::Tet10,   4, 4, 0, Element::Type::Tri6, Element::Type::Quad8},
+        {Element::Type::Pyr5,    5, 4, 1, Element::Type::Tri3, Element::Type::Quad4},
+        {Element::Type::Pyr13,   5, 4, 1, Element::Type::Tri6, Element::Type::Quad8},
+        {Element::Type::Pyr14,   5, 4, 1, Element::Type::Tri6, Element::Type::Quad9},
+        {Element::Type::Prism6,  6, 2, 3, Element::Type::Tri3, Element::Type::Quad4},
+        {Element::Type::Prism15, 6, 2, 3, Element::Type::Tri6, Element::Type::Quad8},
+        {Element::Type::Prism18, 6, 2, 3, Element::Type::Tri6, Element::Type::Quad9},
+        {Element::Type::Hex8,    8, 0, 6, Element::Type::Tri3, Element::Type::Quad4},
+        {Element::Type::Hex20,   8, 0, 6, Element::Type::Tri3, Element::Type::Quad8},
+        {Element::Type::Hex27,   8, 0, 6, Element::Type::Tri3, Element::Type::Quad9}
+    };
+
+    for (auto [type, corners, num_tris, num_quads, tri, quad] : cases) {
+        Mesh mesh = single_element_mesh(type);
+        mesh.elements[0].tags = {7};
+        vec3 centroid = average(mesh, range(corners));
+
+        Mesh boundary = io::extract_boundary(mesh);
+        EXPECT_EQ(boundary.nodes, mesh.nodes);
+        ASSERT_EQ(int(boundary.elements.size()), num_tris + num_quads);
+        EXPECT_EQ(std::count_if(boundary.elements.begin(), boundary.elements.end(), 
+                                [&](auto & face) { return face.type == tri; }), num_tris);
+
+        for (auto & face : boundary.elements) {
+            EXPECT_TRUE(face.type == tri || face.type == quad);
+            EXPECT_EQ(face.tags, std::vector< int >{7});
+
+            // the normals of the faces point away from the element
+            int n = num_corners(face.type);
+            std::vector< vec3 > x;
+            for (int id : face.node_ids) x.push_back(mesh.nodes[id]);
+            vec3 normal = cross(x[1] - x[0], x[n - 1] - x[0]);
+            vec3 center = average(mesh, std::vector< int >(face.node_ids.begin(), face.node_ids.begin() + n));
+            EXPECT_GT(dot(normal, center - centroid), 0.0);
+
+            // and their edge nodes are nearest to the middle of the right corners
+            for (int i = n; i < int(face.node_ids.size()) && i < 2 * n; i++) {
+                auto distance = [&](int a, int b) {
+                    vec3 d = average(mesh, {face.node_ids[a], face.node_ids[b]}) - x[i];
+                    return dot(d, d);
+                };
+                for (int a = 0; a < n; a++) {
+                    for (int b = a + 1; b < n; b++) {
+                        EXPECT_LE(distance(i - n, (i - n + 1) % n), distance(a, b));
+                    }
+                }
+            }
+        }
+    }
+}
+
+TEST(boundary, hex_grid) {
+    int n = 5;
+    Mesh mesh = hex_grid_mesh(n);
+    mesh.elements.push_back({Element::Type::Line2, {0, 1}});
+    mesh.elements.push_back({Element::Type::Quad4, {0, 3, 2, 1}});
+
+    Mesh boundary = io::extract_boundary(mesh);
+    ASSERT_EQ(int(boundary.elements.size()), 6 * n * n);
+
+    // every face is on a side of the cube, and has the tags of the element it came from
+    for (auto & face : boundary.elements) {
+        EXPECT_EQ(face.type, Element::Type::Quad4);
+        int on_side = 0;
+        for (int j = 0; j < 3; j++) {
+            double c = mesh.nodes[face.node_ids[0]][j];
+            bool same = true;
+            for (int id : face.node_ids) same = same && mesh.nodes[id][j] == c;
+            on_side += same && (c == 0.0 || c == 1.0);
+        }
+        EXPECT_EQ(on_side, 1);
+        EXPECT_EQ(face.tags[0], 1);
+    }
+
+    // and the flat meshes give the same faces
+    FlatMesh< int32_t > flat = io::extract_boundary(io::flatten< int32_t >(mesh));
+    Mesh unflattened = io::unflatten(flat);
+    ASSERT_EQ(unflattened.elements.size(), boundary.elements.size());
+    for (std::size_t i = 0; i < boundary.elements.size(); i++) {
+        EXPECT_EQ(unflattened.elements[i].node_ids, boundary.elements[i].node_ids);
+        EXPECT_EQ(unflattened.elements[i].tags, boundary.elements[i].tags);
+    }
+    EXPECT_EQ(io::extract_boundary(io::flatten< int64_t >(mesh)).connectivity.size(), flat.connectivity.size());
+}
+
+TEST(boundary, export_stl) {
+    int n = 4;
+    Mesh mesh = hex_grid_mesh(n);
+    io::export_stl(mesh, "hex_grid.stl");
+    EXPECT_EQ(read_file("hex_grid.stl").size(), 84 + 50 * 4 * 6 * n * n);
+
+    // exterior faces that are already surface elements aren't written twice
+    mesh.elements.push_back({Element::Type::Quad4, {0, n + 1, n + 2, 1}});
+    io::export_stl(mesh, "hex_grid.stl");
+    EXPECT_EQ(read_file("hex_grid.stl").size(), 84 + 50 * 4 * 6 * n * n);
+}
@@ -2,6 +2,10 @@
 
 #include "mesh/io.hpp"
 
+#include <string>
+#include <fstream>
+#include <iterator>
+
 using io::Mesh;
 using io::Element;
 
@@ -175,4 +179,51 @@ inline Mesh single_element_mesh(Element::Type type) {
     case Element::Type::Unsupported:
       return Mesh{};
   }
-}
\ No newline at end of file
+}
+
+// n x n x n grid of Hex8 elements on the unit cube
+inline Mesh hex_grid_mesh(int n) {
+  Mesh mesh;
+  auto id = [n](int i, int j, int k) { return (k * (n + 1) + j) * (n + 1) + i; };
+  for (int k = 0; k <= n; k++) {
+    for (int j = 0; j <= n; j++) {
+      for (int i = 0; i <= n; i++) {
+        mesh.nodes.push_back({double(i) / n, double(j) / n, double(k) / n});
+      }
+    }
+  }
+  for (int k = 0; k < n; k++) {
+    for (int j = 0; j < n; j++) {
+      for (int i = 0; i < n; i++) {
+        mesh.elements.push_back({Element::Type::Hex8, {
+          id(i, j, k), id(i+1, j, k), id(i+1, j+1, k), id(i, j+1, k),
+          id(i, j, k+1), id(i+1, j, k+1), id(i+1, j+1, k+1), id(i, j+1, k+1)
+        }, {1, k}});
+      }
+    }
+  }
+  return mesh;
+}
+
+// n x n grid of squares on the unit square, each split into 2 triangles
+inline Mesh triangle_grid_mesh(int n) {
+  Mesh mesh;
+  auto id = [n](int i, int j) { return j * (n + 1) + i; };
+  for (int j = 0; j <= n; j++) {
+    for (int i = 0; i <= n; i++) {
+      mesh.nodes.push_back({double(i) / n, double(j) / n, 0.0});
+    }
+  }
+  for (int j = 0; j < n; j++) {
+    for (int i = 0; i < n; i++) {
+      mesh.elements.push_back({Element::Type::Tri3, {id(i, j), id(i+1, j), id(i+1, j+1)}, {}});
+      mesh.elements.push_back({Element::Type::Tri3, {id(i, j), id(i+1, j+1), id(i, j+1)}, {}});
+    }
+  }
+  return mesh;
+}
+
+inline std::string read_file(std::string filename) {
+  std::ifstream infile(filename, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(infile), std::istreambuf_iterator<char>());
+}
@@ -0,0 +1,116 @@
+#include "gtest/gtest.h"
+
+#include "mesh/io.hpp"
+
+#include "common.hpp"
+
+using namespace io;
+
+// a few element types, with and without tags
+Mesh mixed_mesh() {
+    Mesh mesh = single_element_mesh(Element::Type::Hex27);
+    mesh.elements.push_back({Element::Type::Tet10, range(10), {7, 3}});
+    mesh.elements.push_back({Element::Type::Quad9, {0, 1, 2, 3, 8, 9, 10, 11, 20}, {2, 1}});
+    mesh.elements.push_back({Element::Type::Tri3, {0, 1, 2}, {2, 1}});
+    mesh.elements.push_back({Element::Type::Line3, {0, 1, 8}, {1, 1}});
+    return mesh;
+}
+
+TEST(flat_mesh, round_trip) {
+    Mesh mesh = mixed_mesh();
+    FlatMesh flat = flatten(mesh);
+
+    EXPECT_EQ(flat.num_elements(), mesh.elements.size());
+    EXPECT_EQ(flat.offsets.back(), 27 + 10 + 9 + 3 + 3);
+    EXPECT_EQ(flat.tag_offsets.back(), 8);
+
+    Mesh mesh2 = unflatten(flat);
+    ASSERT_EQ(mesh2.elements.size(), mesh.elements.size());
+    for (std::size_t i = 0; i < mesh.elements.size(); i++) {
+        EXPECT_EQ(mesh2.elements[i].type, mesh.elements[i].type);
+        EXPECT_EQ(mesh2.elements[i].node_ids, mesh.elements[i].node_ids);
+        EXPECT_EQ(mesh2.elements[i].tags, mesh.elements[i].tags);
+    }
+}
+
+TEST(flat_mesh, exports_match_mesh) {
+    Mesh mesh = mixed_mesh();
+    FlatMesh flat = flatten(mesh);
+
+    export_vtu(mesh, "mixed.vtu");
+    export_vtu(flat, "mixed_flat.vtu");
+    EXPECT_EQ(read_file("mixed.vtu"), read_file("mixed_flat.vtu"));
+
+    for (auto enc : {FileEncoding::ASCII, FileEncoding::Binary}) {
+        export_vtk(mesh, "mixed.vtk", enc);
+        export_vtk(flat, "mixed_flat.vtk", enc);
+        EXPECT_EQ(read_file("mixed.vtk"), read_file("mixed_flat.vtk"));
+
+        export_gmsh_v22(mesh, "mixed.msh", enc);
+        export_gmsh_v22(flat, "mixed_flat.msh", enc);
+        EXPECT_EQ(read_file("mixed.msh"), read_file("mixed_flat.msh"));
+    }
+
+    export_stl(mesh, "mixed.stl");
+    export_stl(flat, "mixed_flat.stl");
+    EXPECT_EQ(read_file("mixed.stl"), read_file("mixed_flat.stl"));
+}
+
+TEST(flat_mesh, blocks) {
+    Mesh mesh = mixed_mesh();
+    mesh.elements.push_back({Element::Type::Tet10, range(10), {7, 3}});
+    mesh.elements.push_back({Element::Type::Tet10, range(10), {7, 3}});
+
+    FlatMesh flat = flatten(mesh);
+    ASSERT_EQ(flat.blocks.size(), 6);
+    EXPECT_EQ(flat.blocks.back().type, Element::Type::Tet10);
+    EXPECT_EQ(flat.blocks.back().first, 5);
+    EXPECT_EQ(flat.blocks.back().count, 2);
+
+    FlatMesh grouped = group_by_type(flat);
+    ASSERT_EQ(grouped.blocks.size(), 5);
+    for (auto & block : grouped.blocks) {
+        for (int i = block.first; i < block.first + block.count; i++) {
+            EXPECT_EQ(grouped.types[i], block.type);
+            EXPECT_EQ(grouped.offsets[i+1] - grouped.offsets[i], nodes_per_elem(block.type));
+        }
+    }
+
+    // elements of the same type keep their relative order
+    auto & tets = grouped.blocks[3];
+    EXPECT_EQ(tets.type, Element::Type::Tet10);
+    EXPECT_EQ(tets.count, 3);
+    EXPECT_EQ(grouped.tags[grouped.tag_offsets[tets.first]], 7);
+}
+
+TEST(flat_mesh, int64_indices) {
+    Mesh mesh = mixed_mesh();
+    FlatMesh< int32_t > flat32 = flatten(mesh);
+    FlatMesh< int64_t > flat64 = flatten< int64_t >(mesh);
+
+    EXPECT_EQ(unflatten(flat64).elements.size(), mesh.elements.size());
+
+    for (auto enc : {FileEncoding::ASCII, FileEncoding::Binary}) {
+        export_vtk(flat32, "mixed32.vtk", enc);
+        export_vtk(flat64, "mixed64.vtk", enc);
+        EXPECT_EQ(read_file("mixed32.vtk"), read_file("mixed64.vtk"));
+
+        export_gmsh_v22(flat32, "mixed32.msh", enc);
+        export_gmsh_v22(flat64, "mixed64.msh", enc);
+        EXPECT_EQ(read_file("mixed32.msh"), read_file("mixed64.msh"));
+    }
+
+    export_stl(flat32, "mixed32.stl");
+    export_stl(flat64, "mixed64.stl");
+    EXPECT_EQ(read_file("mixed32.stl"), read_file("mixed64.stl"));
+
+    // 64-bit meshes write 64-bit connectivity and block headers
+    export_vtu(flat32, "mixed32.vtu");
+    export_vtu(flat64, "mixed64.vtu");
+    std::string vtu32 = read_file("mixed32.vtu");
+    std::string vtu64 = read_file("mixed64.vtu");
+    EXPECT_NE(vtu32.find("header_type=\"UInt32\""), std::string::npos);
+    EXPECT_NE(vtu64.find("header_type=\"UInt64\""), std::string::npos);
+    EXPECT_NE(vtu64.find("type=\"Int64\" Name=\"connectivity\""), std::string::npos);
+    EXPECT_NE(vtu64.find("type=\"Int64\" Name=\"offsets\""), std::string::npos);
+}
@@ -5,6 +5,8 @@
 #include "timer.hpp"
 #include "common.hpp"
 
+#include <cstring>
+
 using namespace io;
 
 void export_gmsh_single_element(Element::Type type, std::string prefix) {
@@ -65,4 +67,657 @@ TEST(gmsh, big_import) {
     stopwatch.stop();
     std::cout << stopwatch.elapsed() * 1000.0 << "ms ";
 
-}
\ No newline at end of file
+}
+
+TEST(gmsh, mixed_round_trip) {
+    Mesh mesh = single_element_mesh(Element::Type::Hex8);
+    mesh.elements.push_back({Element::Type::Quad4, {0, 1, 2, 3}, {1, 2}});
+    mesh.elements.push_back({Element::Type::Hex8, {7, 6, 5, 4, 3, 2, 1, 0}, {3, 4}});
+    mesh.elements.push_back({Element::Type::Line2, {0, 4}, {5, 6}});
+
+    for (auto enc : {FileEncoding::ASCII, FileEncoding::Binary}) {
+        export_gmsh_v22(mesh, "mixed_round_trip.msh", enc);
+        Mesh imported = import_gmsh_v22("mixed_round_trip.msh");
+
+        EXPECT_EQ(imported.nodes, mesh.nodes);
+        ASSERT_EQ(imported.elements.size(), mesh.elements.size());
+        for (std::size_t i = 0; i < mesh.elements.size(); i++) {
+            EXPECT_EQ(imported.elements[i].type, mesh.elements[i].type);
+            EXPECT_EQ(imported.elements[i].node_ids, mesh.elements[i].node_ids);
+        }
+    }
+}
+
+TEST(gmsh, flat_import) {
+    Mesh mesh = single_element_mesh(Element::Type::Hex27);
+    mesh.elements.push_back({Element::Type::Tri6, {0, 1, 2, 3, 4, 5}, {1, 2}});
+    mesh.elements.push_back({Element::Type::Tri6, {5, 4, 3, 2, 1, 0}, {3, 4}});
+
+    for (auto enc : {FileEncoding::ASCII, FileEncoding::Binary}) {
+        export_gmsh_v22(mesh, "flat_import.msh", enc);
+        Mesh imported = import_gmsh_v22("flat_import.msh");
+        auto flat = import_gmsh_v22< FlatMesh< int64_t > >("flat_import.msh");
+
+        EXPECT_EQ(flat.nodes, imported.nodes);
+        ASSERT_EQ(flat.num_elements(), imported.elements.size());
+        ASSERT_EQ(flat.blocks.size(), 2);
+        EXPECT_EQ(flat.blocks[1].count, 2);
+        Mesh unflat = unflatten(flat);
+        for (std::size_t i = 0; i < imported.elements.size(); i++) {
+            EXPECT_EQ(unflat.elements[i].type, imported.elements[i].type);
+            EXPECT_EQ(unflat.elements[i].node_ids, imported.elements[i].node_ids);
+            EXPECT_EQ(unflat.elements[i].tags, imported.elements[i].tags);
+        }
+    }
+}
+
+TEST(gmsh, ascii_import_out_of_order) {
+    {
+        std::ofstream outfile("out_of_order.msh");
+        outfile << "$MeshFormat\n2.2 0 8\n$EndMeshFormat\n"
+                << "$PhysicalNames\n1\n2 1 \"surface\"\n$EndPhysicalNames\n"
+                << "$Nodes\n4\n3 1.5 1e-3 +2\n1 0 0 0\n2 1 0 0\n4 0 1 0\n$EndNodes\n"
+                << "$Elements\n3\n"
+                << "3 1 2 7 8 1 4\n"
+                << "1 2 2 1 2 1 2 3\r\n"
+                << "2 2 0 2 3 4 \n"
+                << "$EndElements\n";
+    }
+
+    Mesh mesh = import_gmsh_v22("out_of_order.msh");
+    auto flat = import_gmsh_v22< FlatMesh< int32_t > >("out_of_order.msh");
+
+    ASSERT_EQ(mesh.nodes.size(), 4);
+    EXPECT_EQ(mesh.nodes[2], (std::array< double, 3 >{1.5, 1e-3, 2.0}));
+    ASSERT_EQ(mesh.elements.size(), 3);
+    EXPECT_EQ(mesh.elements[0].type, Element::Type::Tri3);
+    EXPECT_EQ(mesh.elements[0].node_ids, (std::vector< int >{0, 1, 2}));
+    EXPECT_EQ(mesh.elements[1].tags, (std::vector< int >{}));
+    EXPECT_EQ(mesh.elements[2].type, Element::Type::Line2);
+    EXPECT_EQ(mesh.elements[2].tags, (std::vector< int >{7, 8}));
+
+    Mesh unflat = unflatten(flat);
+    EXPECT_EQ(unflat.nodes, mesh.nodes);
+    for (std::size_t i = 0; i < mesh.elements.size(); i++) {
+        EXPECT_EQ(unflat.elements[i].type, mesh.elements[i].type);
+        EXPECT_EQ(unflat.elements[i].node_ids, mesh.elements[i].node_ids);
+        EXPECT_EQ(unflat.elements[i].tags, mesh.elements[i].tags);
+    }
+    EXPECT_EQ(flat.blocks.size(), 2);
+}
+
+TEST(gmsh, parallel_ascii_import) {
+    Mesh mesh = hex_grid_mesh(24);
+    mesh.elements.push_back({Element::Type::Tri3, {0, 1, 2}, {}});
+    export_gmsh_v22(mesh, "parallel_ascii_import.msh", FileEncoding::ASCII);
+
+    set_num_threads(1);
+    Mesh serial = import_gmsh_v22("parallel_ascii_import.msh");
+    auto serial_flat = import_gmsh_v22< FlatMesh< int64_t > >("parallel_ascii_import.msh");
+
+    set_num_threads(4);
+    Mesh threaded = import_gmsh_v22("parallel_ascii_import.msh");
+    auto threaded_flat = import_gmsh_v22< FlatMesh< int64_t > >("parallel_ascii_import.msh");
+    set_num_threads(0);
+
+    EXPECT_EQ(threaded.nodes, serial.nodes);
+    ASSERT_EQ(threaded.elements.size(), mesh.elements.size());
+    for (std::size_t i = 0; i < mesh.elements.size(); i++) {
+        EXPECT_EQ(threaded.elements[i].type, serial.elements[i].type);
+        EXPECT_EQ(threaded.elements[i].node_ids, mesh.elements[i].node_ids);
+        EXPECT_EQ(threaded.elements[i].tags, mesh.elements[i].tags);
+    }
+
+    EXPECT_EQ(threaded_flat.nodes, serial_flat.nodes);
+    EXPECT_EQ(threaded_flat.types, serial_flat.types);
+    EXPECT_EQ(threaded_flat.offsets, serial_flat.offsets);
+    EXPECT_EQ(threaded_flat.connectivity, serial_flat.connectivity);
+    EXPECT_EQ(threaded_flat.tag_offsets, serial_flat.tag_offsets);
+    EXPECT_EQ(threaded_flat.tags, serial_flat.tags);
+    EXPECT_EQ(threaded_flat.blocks.size(), 2);
+}
+
+// the operator>> based reader that import_gmsh_v22 used for ascii files
+// before it parsed the mapped file directly, kept as a point of reference
+static Mesh stream_import_gmsh_v22(std::string filename) {
+    std::ifstream infile(filename);
+    std::string line;
+    do { getline(infile, line); } while (infile && line != "$Nodes");
+
+    Mesh mesh;
+    int num_nodes, node_id;
+    infile >> num_nodes;
+    mesh.nodes.resize(num_nodes);
+    for (int i = 0; i < num_nodes; i++) {
+        infile >> node_id;
+        for (auto & x : mesh.nodes[node_id - 1]) infile >> x;
+    }
+
+    do { getline(infile, line); } while (infile && line != "$Elements");
+
+    int num_elems;
+    infile >> num_elems;
+    mesh.elements.resize(num_elems);
+    for (int i = 0; i < num_elems; i++) {
+        int elem_id, elem_type, num_tags;
+        infile >> elem_id >> elem_type >> num_tags;
+        auto & e = mesh.elements[elem_id - 1];
+        e.type = (elem_type == 5) ? Element::Type::Hex8 : Element::Type::Unsupported;
+        e.tags.resize(num_tags);
+        for (auto & tag : e.tags) infile >> tag;
+        e.node_ids.resize(nodes_per_elem(e.type));
+        for (auto & id : e.node_ids) { infile >> id; id--; }
+        getline(infile, line);
+    }
+    return mesh;
+}
+
+// prints the single-threaded import times of a ~30MB ascii file,
+// relative to the stream based reader above
+TEST(gmsh, ascii_import_speed) {
+    Mesh mesh = hex_grid_mesh(60);
+    export_gmsh_v22(mesh, "ascii_import_speed.msh", FileEncoding::ASCII);
+
+    Mesh reference, imported;
+    FlatMesh< int32_t > flat;
+    set_num_threads(1);
+    double t_stream = time([&]() { reference = stream_import_gmsh_v22("ascii_import_speed.msh"); });
+    double t_mesh = time([&]() { imported = import_gmsh_v22("ascii_import_speed.msh"); });
+    double t_flat = time([&]() { flat = import_gmsh_v22< FlatMesh< int32_t > >("ascii_import_speed.msh"); });
+    set_num_threads(0);
+
+    std::cout << "operator>>: " << t_stream * 1000.0 << "ms, ";
+    std::cout << "Mesh: " << t_mesh * 1000.0 << "ms (" << t_stream / t_mesh << "x), ";
+    std::cout << "FlatMesh: " << t_flat * 1000.0 << "ms (" << t_stream / t_flat << "x)" << std::endl;
+
+    EXPECT_EQ(imported.nodes, reference.nodes);
+    ASSERT_EQ(imported.elements.size(), reference.elements.size());
+    for (std::size_t i = 0; i < mesh.elements.size(); i++) {
+        EXPECT_EQ(imported.elements[i].node_ids, reference.elements[i].node_ids);
+        EXPECT_EQ(imported.elements[i].tags, reference.elements[i].tags);
+    }
+    EXPECT_EQ(flat.connectivity, flatten(reference).connectivity);
+}
+
+TEST(gmsh, v41_import) {
+    {
+        // the example from the gmsh reference manual, with entities, 
+        // a parametric node block and the element blocks out of order
+        std::ofstream outfile("v41_import.msh");
+        outfile << "$MeshFormat\n4.1 0 8\n$EndMeshFormat\n"
+                << "$Entities\n0 1 1 0\n"
+                << "1 0 0 0 1 0 0 0 0\n"
+                << "1 0 0 0 2 1 0 1 5 2 1 -1\n"
+                << "$EndEntities\n"
+                << "$Nodes\n2 7 1 7\n"
+                << "2 1 0 6\n1\n2\n3\n4\n5\n6\n"
+                << "0. 0. 0.\n1. 0. 0.\n1. 1. 0.\n0. 1. 0.\n2. 0. 0.\n2. 1. 0.\n"
+                << "1 1 1 1\n7\n0.5 0 0 0.25\n"
+                << "$EndNodes\n"
+                << "$Elements\n2 3 1 3\n"
+                << "1 1 1 1\n3 1 7 \n"
+                << "2 1 3 2\n1 1 2 3 4\n2 2 5 6 3\n"
+                << "$EndElements\n";
+    }
+
+    Mesh mesh = import_gmsh_v41("v41_import.msh");
+    ASSERT_EQ(mesh.nodes.size(), 7);
+    EXPECT_EQ(mesh.nodes[4], (std::array< double, 3 >{2.0, 0.0, 0.0}));
+    EXPECT_EQ(mesh.nodes[6], (std::array< double, 3 >{0.5, 0.0, 0.0}));
+    ASSERT_EQ(mesh.elements.size(), 3);
+    EXPECT_EQ(mesh.elements[0].type, Element::Type::Quad4);
+    EXPECT_EQ(mesh.elements[1].node_ids, (std::vector< int >{1, 4, 5, 2}));
+    EXPECT_EQ(mesh.elements[1].tags, (std::vector< int >{5, 1}));
+    EXPECT_EQ(mesh.elements[2].type, Element::Type::Line2);
+    EXPECT_EQ(mesh.elements[2].node_ids, (std::vector< int >{0, 6}));
+    EXPECT_EQ(mesh.elements[2].tags, (std::vector< int >{0, 1}));
+
+    Mesh unflat = unflatten(import_gmsh_v41< FlatMesh< int32_t > >("v41_import.msh"));
+    EXPECT_EQ(unflat.nodes, mesh.nodes);
+    for (std::size_t i = 0; i < mesh.elements.size(); i++) {
+        EXPECT_EQ(unflat.elements[i].type, mesh.elements[i].type);
+        EXPECT_EQ(unflat.elements[i].node_ids, mesh.elements[i].node_ids);
+        EXPECT_EQ(unflat.elements[i].tags, mesh.elements[i].tags);
+    }
+}
+
+TEST(gmsh, v41_entity_bounds) {
+    // untagged elements, away from the origin
+    Mesh mesh;
+    mesh.nodes = {{5, 5, 5}, {6, 5, 5}, {5, 6, 5}, {7, 7, 7}};
+    mesh.elements.push_back({Element::Type::Tri3, {0, 1, 2}, {}});
+    mesh.elements.push_back({Element::Type::Line2, {1, 3}, {}});
+    export_gmsh_v41(mesh, "v41_entity_bounds.msh", FileEncoding::ASCII);
+
+    std::string contents = read_file("v41_entity_bounds.msh");
+    std::size_t begin = contents.find("$Entities\n");
+    std::size_t end = contents.find("$EndEntities");
+    ASSERT_NE(begin, std::string::npos);
+    ASSERT_NE(end, std::string::npos);
+    EXPECT_EQ(contents.substr(begin, end - begin), 
+        "$Entities\n"
+        "0 1 1 0\n"
+        "0 6 5 5 7 7 7 0 0\n"
+        "0 5 5 5 6 6 5 0 0\n");
+}
+
+TEST(gmsh, v41_export_unsupported) {
+    Mesh mesh = single_element_mesh(Element::Type::Tri3);
+    mesh.elements.push_back({Element::Type::Unsupported, {}, {}});
+    EXPECT_EXIT(export_gmsh_v41(mesh, "v41_unsupported.msh", FileEncoding::ASCII), ::testing::ExitedWithCode(1), "");
+    EXPECT_EXIT(export_gmsh_v41(flatten(mesh), "v41_unsupported.msh", FileEncoding::Binary), ::testing::ExitedWithCode(1), "");
+}
+
+TEST(gmsh, v41_round_trip) {
+    Mesh mesh = hex_grid_mesh(20);
+    mesh.elements.push_back({Element::Type::Quad4, {0, 1, 22, 21}, {3, 7}});
+    mesh.elements.push_back({Element::Type::Tri6, {0, 1, 2, 21, 22, 23}, {3, 7}});
+    mesh.elements.push_back({Element::Type::Line2, {0, 1}, {}});
+    mesh.nodes[1][0] = 0.1 + 0.2; // needs all 17 digits
+
+    for (auto enc : {FileEncoding::ASCII, FileEncoding::Binary}) {
+        set_num_threads(1);
+        export_gmsh_v41(mesh, "v41_round_trip_1.msh", enc);
+        Mesh serial = import_gmsh_v41("v41_round_trip_1.msh");
+
+        set_num_threads(4);
+        export_gmsh_v41(flatten(mesh), "v41_round_trip_4.msh", enc);
+        auto threaded = import_gmsh_v41< FlatMesh< int64_t > >("v41_round_trip_4.msh");
+        set_num_threads(0);
+
+        EXPECT_EQ(read_file("v41_round_trip_1.msh"), read_file("v41_round_trip_4.msh"));
+
+        EXPECT_EQ(serial.nodes, mesh.nodes);
+        ASSERT_EQ(serial.elements.size(), mesh.elements.size());
+        for (std::size_t i = 0; i < mesh.elements.size(); i++) {
+            EXPECT_EQ(serial.elements[i].type, mesh.elements[i].type);
+            EXPECT_EQ(serial.elements[i].node_ids, mesh.elements[i].node_ids);
+        }
+        EXPECT_EQ(serial.elements[0].tags, (std::vector< int >{1, 0}));
+        EXPECT_EQ(serial.elements[8000].tags, (std::vector< int >{3, 7}));
+        EXPECT_EQ(serial.elements[8002].tags, (std::vector< int >{0, 0}));
+
+        Mesh unflat = unflatten(threaded);
+        EXPECT_EQ(unflat.nodes, serial.nodes);
+        for (std::size_t i = 0; i < mesh.elements.size(); i++) {
+            EXPECT_EQ(unflat.elements[i].node_ids, serial.elements[i].node_ids);
+            EXPECT_EQ(unflat.elements[i].tags, serial.elements[i].tags);
+        }
+    }
+}
+
+TEST(gmsh, binary_tags_round_trip) {
+    Mesh mesh = single_element_mesh(Element::Type::Tet10);
+    mesh.elements.push_back({Element::Type::Tri3, {0, 1, 2}, {1, 2, 3, 4}});
+    mesh.elements.push_back({Element::Type::Tri3, {2, 1, 0}, {5}});
+
+    export_gmsh_v22(mesh, "binary_tags_round_trip.msh", FileEncoding::Binary);
+    Mesh imported = import_gmsh_v22("binary_tags_round_trip.msh");
+
+    ASSERT_EQ(imported.elements.size(), 3);
+    EXPECT_EQ(imported.elements[0].tags, (std::vector< int >{0, 0}));
+    EXPECT_EQ(imported.elements[1].tags, (std::vector< int >{1, 2, 3, 4}));
+    EXPECT_EQ(imported.elements[1].node_ids, (std::vector< int >{0, 1, 2}));
+    EXPECT_EQ(imported.elements[2].tags, (std::vector< int >{5, 0}));
+    EXPECT_EQ(imported.elements[2].node_ids, (std::vector< int >{2, 1, 0}));
+}
+
+TEST(gmsh, invalid_header) {
+    std::ofstream("invalid_header.msh") << "$MeshFormat\nabc 0 8\n$EndMeshFormat\n";
+    EXPECT_EXIT(import_gmsh_v22("invalid_header.msh"), ::testing::ExitedWithCode(1), "");
+    EXPECT_EXIT(import_gmsh_v41("invalid_header.msh"), ::testing::ExitedWithCode(1), "");
+}
+
+TEST(gmsh, duplicate_node_ids) {
+    // node ids 1, 1, 3 have the same range as 1, 2, 3
+    std::ofstream("duplicate_nodes_txt.msh") << 
+        "$MeshFormat\n2.2 0 8\n$EndMeshFormat\n"
+        "$Nodes\n3\n1 0 0 0\n1 1 0 0\n3 0 1 0\n$EndNodes\n"
+        "$Elements\n1\n1 2 0 1 3 3\n$EndElements\n";
+    {
+        std::ofstream outfile("duplicate_nodes_bin.msh", std::ios::binary);
+        auto raw = [&](auto value) { outfile.write(reinterpret_cast< const char * >(&value), sizeof(value)); };
+        outfile << "$MeshFormat\n2.2 1 8\n";
+        raw(int(1));
+        outfile << "\n$EndMeshFormat\n$Nodes\n3\n";
+        for (int id : {1, 1, 3}) {
+            raw(id);
+            for (double c : {0.0, 0.0, 0.0}) raw(c);
+        }
+        outfile << "\n$EndNodes\n$Elements\n1\n";
+        for (int v : {2, 1, 0, 1, 1, 3, 3}) raw(v);
+        outfile << "\n$EndElements\n";
+    }
+    std::ofstream("duplicate_nodes_41.msh") << 
+        "$MeshFormat\n4.1 0 8\n$EndMeshFormat\n"
+        "$Nodes\n1 3 1 3\n2 1 0 3\n1\n1\n3\n0 0 0\n1 0 0\n0 1 0\n$EndNodes\n"
+        "$Elements\n1 1 1 1\n2 1 2 1\n1 1 3 3\n$EndElements\n";
+
+    for (std::string filename : {"duplicate_nodes_txt.msh", "duplicate_nodes_bin.msh"}) {
+        EXPECT_EXIT(import_gmsh_v22(filename), ::testing::ExitedWithCode(1), "");
+        EXPECT_EXIT(import_gmsh_v22< FlatMesh< int64_t > >(filename), ::testing::ExitedWithCode(1), "");
+    }
+    EXPECT_EXIT(import_gmsh_v41("duplicate_nodes_41.msh"), ::testing::ExitedWithCode(1), "");
+    EXPECT_EXIT(import_gmsh_v41< FlatMesh< int64_t > >("duplicate_nodes_41.msh"), ::testing::ExitedWithCode(1), "");
+}
+
+TEST(gmsh, binary_duplicate_element_ids) {
+    {
+        // element ids 1, 2, 2, where the two 2s have different node counts
+        std::ofstream outfile("duplicate_ids.msh", std::ios::binary);
+        auto raw = [&](auto value) { outfile.write(reinterpret_cast< const char * >(&value), sizeof(value)); };
+        outfile << "$MeshFormat\n2.2 1 8\n";
+        raw(int(1));
+        outfile << "\n$EndMeshFormat\n$Nodes\n4\n";
+        for (int i = 0; i < 4; i++) {
+            raw(i + 1);
+            for (double c : {double(i & 1), double(i >> 1), 0.0}) raw(c);
+        }
+        outfile << "\n$EndNodes\n$Elements\n3\n";
+        for (int h : {2, 1, 0}) raw(h); // a Tri3
+        for (int v : {1, 1, 2, 3}) raw(v);
+        for (int h : {3, 1, 0}) raw(h); // a Quad4
+        for (int v : {2, 1, 2, 4, 3}) raw(v);
+        for (int h : {2, 1, 0}) raw(h); // another Tri3, with the same id
+        for (int v : {2, 2, 4, 3}) raw(v);
+        outfile << "\n$EndElements\n";
+    }
+    EXPECT_EXIT(import_gmsh_v22("duplicate_ids.msh"), ::testing::ExitedWithCode(1), "");
+    EXPECT_EXIT(import_gmsh_v22< FlatMesh< int32_t > >("duplicate_ids.msh"), ::testing::ExitedWithCode(1), "");
+}
+
+TEST(gmsh, fields) {
+    Mesh mesh = single_element_mesh(Element::Type::Tet4);
+    mesh.elements.push_back({Element::Type::Tri3, {0, 1, 2}, {1, 2}});
+
+    Fields fields;
+    fields.nodes.push_back({"displacement", 3, std::vector< double >{0, 0, 0, 0.5, 0, 0, 0, 0.25, 0, 0, 0, -1}});
+    fields.elements.push_back({"region", 1, std::vector< int32_t >{7, 8}});
+
+    export_gmsh_v22(mesh, "fields_txt.msh", FileEncoding::ASCII, fields);
+    std::string ascii = read_file("fields_txt.msh");
+    EXPECT_NE(ascii.find("$NodeData\n1\n\"displacement\"\n1\n0\n3\n0\n3\n4\n1 0 0 0\n2 0.5 0 0\n3 0 0.25 0\n4 0 0 -1\n$EndNodeData\n"), std::string::npos);
+    EXPECT_NE(ascii.find("$ElementData\n1\n\"region\"\n1\n0\n3\n0\n1\n2\n1 7\n2 8\n$EndElementData\n"), std::string::npos);
+
+    // binary records are an int id, and then the values as doubles
+    export_gmsh_v22(flatten(mesh), "fields_bin.msh", FileEncoding::Binary, fields);
+    std::string binary = read_file("fields_bin.msh");
+    std::string header = "$ElementData\n1\n\"region\"\n1\n0\n3\n0\n1\n2\n";
+    std::size_t start = binary.find(header);
+    ASSERT_NE(start, std::string::npos);
+    start += header.size();
+    for (int i = 0; i < 2; i++) {
+        int id;
+        double value;
+        std::memcpy(&id, &binary[start + 12 * i], sizeof(int));
+        std::memcpy(&value, &binary[start + 12 * i + 4], sizeof(double));
+        EXPECT_EQ(id, i + 1);
+        EXPECT_EQ(value, 7.0 + i);
+    }
+    EXPECT_EQ(binary.substr(start + 24), "\n$EndElementData\n");
+
+    // the importers skip over the data sections
+    for (auto filename : {"fields_txt.msh", "fields_bin.msh"}) {
+        Mesh imported = import_gmsh_v22(filename);
+        EXPECT_EQ(imported.nodes, mesh.nodes);
+        ASSERT_EQ(imported.elements.size(), 2);
+        EXPECT_EQ(imported.elements[1].node_ids, (std::vector< int >{0, 1, 2}));
+    }
+}
+
+TEST(gmsh, visitor) {
+    Mesh mesh = hex_grid_mesh(42); // more than one batch of nodes and elements
+    mesh.elements.push_back({Element::Type::Tri3, {0, 1, 2}, {1, 2, 3}});
+    mesh.elements.push_back({Element::Type::Tri3, {2, 1, 0}, {4, 5, 6}});
+    mesh.elements.push_back({Element::Type::Line2, {0, 1}, {}});
+
+    // rebuilds the mesh from the batches, and counts the number of batches
+    struct Rebuild : public GmshVisitor {
+        Mesh mesh;
+        int node_batches = 0;
+        int element_batches = 0;
+        void begin_nodes(std::size_t n) override { mesh.nodes.resize(n); }
+        void nodes(const NodeBatch & batch) override {
+            node_batches++;
+            for (std::size_t i = 0; i < batch.count; i++) {
+                mesh.nodes[batch.ids[i]] = batch.coordinates[i];
+            }
+        }
+        void begin_elements(std::size_t n) override { mesh.elements.resize(n); }
+        void elements(const ElementBatch & batch) override {
+            element_batches++;
+            int npe = nodes_per_elem(batch.type);
+            for (std::size_t i = 0; i < batch.count; i++) {
+                auto & e = mesh.elements[batch.ids[i]];
+                e.type = batch.type;
+                e.tags.assign(batch.tags + i * batch.num_tags, batch.tags + (i + 1) * batch.num_tags);
+                e.node_ids.assign(batch.node_ids + i * npe, batch.node_ids + (i + 1) * npe);
+            }
+        }
+    };
+
+    for (auto enc : {FileEncoding::ASCII, FileEncoding::Binary}) {
+        export_gmsh_v22(mesh, "visitor.msh", enc);
+        Mesh imported = import_gmsh_v22("visitor.msh");
+
+        Rebuild visitor;
+        visit_gmsh_v22("visitor.msh", visitor);
+        EXPECT_EQ(visitor.node_batches, 2);
+        EXPECT_EQ(visitor.element_batches, 4); // 2 x Hex8, Tri3, Line2
+
+        EXPECT_EQ(visitor.mesh.nodes, imported.nodes);
+        ASSERT_EQ(visitor.mesh.elements.size(), imported.elements.size());
+        for (std::size_t i = 0; i < imported.elements.size(); i++) {
+            EXPECT_EQ(visitor.mesh.elements[i].type, imported.elements[i].type);
+            EXPECT_EQ(visitor.mesh.elements[i].tags, imported.elements[i].tags);
+            EXPECT_EQ(visitor.mesh.elements[i].node_ids, imported.elements[i].node_ids);
+        }
+    }
+}
+
+TEST(gmsh, section_index) {
+    std::string header = "$MeshFormat\n2.2 0 8\n$EndMeshFormat\n";
+    std::string node_data = "$NodeData\n1\n\"$EndNodes\"\n0\n3\n0\n1\n2\n1 1.0\n2 2.0\n$EndNodeData\n";
+    std::string nodes = "$Nodes\n2\n1 0 0 0\n2 1 0 0\n$EndNodes\n";
+    std::string elements = "$Elements\n1\n1 1 2 3 4 1 2\n$EndElements\n";
+    {
+        std::ofstream outfile("sections.msh");
+        outfile << header << node_data << nodes << node_data << elements;
+    }
+
+    auto sections = index_gmsh("sections.msh");
+    ASSERT_EQ(sections.size(), 5);
+    std::vector< std::string > names = {"MeshFormat", "NodeData", "Nodes", "NodeData", "Elements"};
+    std::size_t offset = 0;
+    std::string contents = header + node_data + nodes + node_data + elements;
+    for (std::size_t i = 0; i < sections.size(); i++) {
+        EXPECT_EQ(sections[i].name, names[i]);
+        EXPECT_EQ(sections[i].begin, offset + names[i].size() + 2);
+        offset = contents.find("$End" + names[i] + "\n", offset);
+        EXPECT_EQ(sections[i].end, offset);
+        offset = contents.find('\n', offset) + 1;
+    }
+
+    Mesh mesh = import_gmsh_v22("sections.msh");
+    ASSERT_EQ(mesh.nodes.size(), 2);
+    ASSERT_EQ(mesh.elements.size(), 1);
+    EXPECT_EQ(mesh.elements[0].tags, (std::vector< int >{3, 4}));
+}
+
+TEST(gmsh, selective_import) {
+    Mesh mesh = hex_grid_mesh(4);
+    mesh.elements.push_back({Element::Type::Tri3, {0, 1, 2}, {2, 1}});
+    mesh.elements.push_back({Element::Type::Tri3, {2, 1, 0}, {3, 1}});
+    mesh.elements.push_back({Element::Type::Line2, {0, 1}, {2, 5}});
+
+    for (auto enc : {FileEncoding::ASCII, FileEncoding::Binary}) {
+        export_gmsh_v22(mesh, "selective.msh", enc);
+
+        GmshFilter nodes_only;
+        nodes_only.elements = false;
+        Mesh nodes = import_gmsh_v22("selective.msh", nodes_only);
+        EXPECT_EQ(nodes.nodes, mesh.nodes);
+        EXPECT_EQ(nodes.elements.size(), 0);
+
+        GmshFilter elements_only;
+        elements_only.nodes = false;
+        auto elements = import_gmsh_v22< FlatMesh< int32_t > >("selective.msh", elements_only);
+        auto flat = flatten(mesh);
+        EXPECT_EQ(elements.nodes.size(), 0);
+        EXPECT_EQ(elements.types, flat.types);
+        EXPECT_EQ(elements.connectivity, flat.connectivity);
+
+        GmshFilter by_tag;
+        by_tag.physical_tags = {2};
+        Mesh tagged = import_gmsh_v22("selective.msh", by_tag);
+        EXPECT_EQ(tagged.nodes, mesh.nodes);
+        ASSERT_EQ(tagged.elements.size(), 2);
+        EXPECT_EQ(tagged.elements[0].type, Element::Type::Tri3);
+        EXPECT_EQ(tagged.elements[0].node_ids, (std::vector< int >{0, 1, 2}));
+        EXPECT_EQ(tagged.elements[1].type, Element::Type::Line2);
+        EXPECT_EQ(tagged.elements[1].tags, (std::vector< int >{2, 5}));
+
+        GmshFilter by_type;
+        by_type.nodes = false;
+        by_type.types = {Element::Type::Tri3, Element::Type::Line2};
+        by_type.physical_tags = {1, 3};
+        auto typed = import_gmsh_v22< FlatMesh< int64_t > >("selective.msh", by_type);
+        ASSERT_EQ(typed.num_elements(), 1);
+        EXPECT_EQ(typed.types[0], Element::Type::Tri3);
+        EXPECT_EQ(typed.connectivity, (std::vector< int64_t >{2, 1, 0}));
+        EXPECT_EQ(typed.tags, (std::vector< int >{3, 1}));
+        EXPECT_EQ(typed.blocks.size(), 1);
+    }
+}
+
+// writes a hex mesh as a version 2.2 file where node i has id node_id(i) and 
+// element i has id elem_id(i), with the elements in reverse order
+template < typename F, typename G >
+void export_sparse_hex_mesh(const Mesh & mesh, std::string filename, bool binary, F node_id, G elem_id) {
+    std::ofstream outfile(filename, std::ios::binary);
+    auto raw = [&](auto value) { outfile.write(reinterpret_cast< const char * >(&value), sizeof(value)); };
+
+    outfile << "$MeshFormat\n2.2 " << binary << " 8\n";
+    if (binary) { raw(int(1)); outfile << "\n"; }
+    outfile << "$EndMeshFormat\n$Nodes\n" << mesh.nodes.size() << "\n";
+    outfile.precision(17);
+    for (std::size_t i = 0; i < mesh.nodes.size(); i++) {
+        auto & x = mesh.nodes[i];
+        if (binary) {
+            raw(int(node_id(i)));
+            for (double c : x) raw(c);
+        } else {
+            outfile << node_id(i) << " " << x[0] << " " << x[1] << " " << x[2] << "\n";
+        }
+    }
+    outfile << (binary ? "\n" : "") << "$EndNodes\n$Elements\n" << mesh.elements.size() << "\n";
+    for (std::size_t i = mesh.elements.size(); i-- > 0;) {
+        auto & e = mesh.elements[i];
+        if (binary) {
+            for (int h : {5, 1, 2}) raw(h); // one Hex8 with 2 tags
+            raw(int(elem_id(i)));
+            for (int t : e.tags) raw(t);
+            for (int n : e.node_ids) raw(int(node_id(n)));
+        } else {
+            outfile << elem_id(i) << " 5 2 " << e.tags[0] << " " << e.tags[1];
+            for (int n : e.node_ids) outfile << " " << node_id(n);
+            outfile << "\n";
+        }
+    }
+    outfile << (binary ? "\n" : "") << "$EndElements\n";
+}
+
+TEST(gmsh, sparse_ids) {
+    Mesh mesh = hex_grid_mesh(24);
+
+    // (clustered node ids, scattered element ids), and ids that don't fit in an int
+    std::vector< std::pair< int64_t, int64_t > > ids = {{2, 1009}, {int64_t(1) << 40, int64_t(1) << 36}};
+    for (int threads : {1, 4}) {
+        set_num_threads(threads);
+        for (bool binary : {false, true}) {
+            for (auto [node_stride, elem_stride] : ids) {
+                if (binary && node_stride > 2) continue; // binary ids are ints
+                auto node_id = [=](std::size_t i) { return int64_t(i) * node_stride + 7; };
+                auto elem_id = [=](std::size_t i) { return int64_t(i) * elem_stride + 3; };
+                SCOPED_TRACE("threads " + std::to_string(threads) + ", binary " + std::to_string(binary) + ", node id stride " + std::to_string(node_stride));
+                export_sparse_hex_mesh(mesh, "sparse.msh", binary, node_id, elem_id);
+
+                std::vector< int64_t > node_ids(mesh.nodes.size()), elem_ids(mesh.elements.size());
+                for (std::size_t i = 0; i < node_ids.size(); i++) node_ids[i] = node_id(i);
+                for (std::size_t i = 0; i < elem_ids.size(); i++) elem_ids[i] = elem_id(i);
+
+                Mesh imported = import_gmsh_v22("sparse.msh");
+                EXPECT_EQ(imported.nodes, mesh.nodes);
+                EXPECT_EQ(imported.original_node_ids, node_ids);
+                EXPECT_EQ(imported.original_element_ids, elem_ids);
+                EXPECT_EQ(flatten(imported).connectivity, flatten(mesh).connectivity);
+                EXPECT_EQ(flatten(imported).tags, flatten(mesh).tags);
+
+                auto flat = import_gmsh_v22< FlatMesh< int32_t > >("sparse.msh");
+                EXPECT_EQ(flat.connectivity, flatten(mesh).connectivity);
+                EXPECT_EQ(flat.original_node_ids, imported.original_node_ids);
+                EXPECT_EQ(flat.original_element_ids, imported.original_element_ids);
+            }
+        }
+    }
+    set_num_threads(0);
+
+    // files with ids 1, 2, ..., n (in any order) don't keep them
+    export_sparse_hex_mesh(mesh, "dense.msh", false, [](std::size_t i) { return i + 1; }, [](std::size_t i) { return i + 1; });
+    Mesh dense = import_gmsh_v22("dense.msh");
+    EXPECT_TRUE(dense.original_node_ids.empty());
+    EXPECT_TRUE(dense.original_element_ids.empty());
+    EXPECT_EQ(dense.nodes, mesh.nodes);
+}
+
+TEST(gmsh, sparse_ids_one_shard) {
+    // 2048 scattered node ids whose hashes all have their top bit clear, so with
+    // 2 threads they'd all go in the first half of the hash table of node ids
+    auto first_half = [](int64_t id) { return (uint64_t(id) * 0x9E3779B97F4A7C15ull) >> 63 == 0; };
+    std::vector< int64_t > ids, missing;
+    for (int64_t id = 1000; ids.size() < 2048; id += 1000) {
+        if (first_half(id)) ids.push_back(id);
+        if (first_half(id + 1) && missing.empty()) missing.push_back(id + 1);
+    }
+
+    for (int64_t last_node : {ids[2], missing[0]}) {
+        {
+            std::ofstream outfile("one_shard.msh");
+            outfile << "$MeshFormat\n2.2 0 8\n$EndMeshFormat\n$Nodes\n" << ids.size() << "\n";
+            for (std::size_t i = 0; i < ids.size(); i++) outfile << ids[i] << " " << i << " 0 0\n";
+            outfile << "$EndNodes\n$Elements\n1\n1 1 0 " << ids[1] << " " << last_node << "\n$EndElements\n";
+        }
+
+        set_num_threads(2);
+        if (last_node == missing[0]) {
+            EXPECT_EXIT(import_gmsh_v22("one_shard.msh"), ::testing::ExitedWithCode(1), "");
+        } else {
+            Mesh mesh = import_gmsh_v22("one_shard.msh");
+            EXPECT_EQ(mesh.original_node_ids, ids);
+            ASSERT_EQ(mesh.elements.size(), 1);
+            EXPECT_EQ(mesh.elements[0].node_ids, (std::vector< int >{1, 2}));
+        }
+        set_num_threads(0);
+    }
+}
+
+TEST(gmsh, v41_sparse_tags) {
+    {
+        std::ofstream outfile("sparse41.msh");
+        outfile << "$MeshFormat\n4.1 0 8\n$EndMeshFormat\n"
+                << "$Nodes\n1 3 10 30\n2 1 0 3\n30\n10\n20\n0 1 0\n0 0 0\n1 0 0\n$EndNodes\n"
+                << "$Elements\n1 2 100 5000000000\n2 1 2 2\n5000000000 30 10 20\n100 10 20 30\n$EndElements\n";
+    }
+
+    for (auto flat : {false, true}) {
+        Mesh mesh = flat ? unflatten(import_gmsh_v41< FlatMesh< int64_t > >("sparse41.msh")) 
+                         : import_gmsh_v41("sparse41.msh");
+        EXPECT_EQ(mesh.nodes, (std::vector< std::array< double, 3 > >{{0, 0, 0}, {1, 0, 0}, {0, 1, 0}}));
+        EXPECT_EQ(mesh.original_node_ids, (std::vector< int64_t >{10, 20, 30}));
+        EXPECT_EQ(mesh.original_element_ids, (std::vector< int64_t >{100, 5000000000}));
+        ASSERT_EQ(mesh.elements.size(), 2);
+        EXPECT_EQ(mesh.elements[0].node_ids, (std::vector< int >{0, 1, 2}));
+        EXPECT_EQ(mesh.elements[1].node_ids, (std::vector< int >{2, 0, 1}));
+        EXPECT_EQ(mesh.elements[1].tags, (std::vector< int >{0, 1}));
+    }
+}
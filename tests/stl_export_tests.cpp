@@ -2,7 +2,10 @@
 
 #include "mesh/io.hpp"
 
+#include "common.hpp"
+
 #include <cmath>
+#include <cstring>
 
 using namespace io;
 
@@ -92,4 +95,186 @@ TEST(stl, quad9_test) {
     mesh.elements = {{Element::Type::Quad9, {0, 1, 2, 3, 4, 5, 6, 7, 8}}};
     export_stl(mesh, "quad9.stl");
 
-}
\ No newline at end of file
+}
+
+TEST(stl, subdivisions) {
+
+    Mesh mesh;
+    mesh.nodes = {
+        {0.0, 0.0, 0.3}, {1.0, 0.0, 0.0}, {1.0, 1.0, 0.8}, {0.0, 1.0, 0.1},
+        {0.5, 0.0, 0.1}, {1.0, 0.5, 0.3}, {0.4, 1.0, 0.5}, {0.0, 0.4, 0.1}, {0.5, 0.4, 0.3}
+    };
+    mesh.elements = {
+        {Element::Type::Quad9, {0, 1, 2, 3, 4, 5, 6, 7, 8}},
+        {Element::Type::Tri6, {0, 1, 2, 4, 5, 8}},
+        {Element::Type::Quad4, {0, 1, 2, 3}}
+    };
+
+    for (int n : {1, 2, 3, 8}) {
+        StlExportOptions options;
+        options.subdivisions = n;
+        export_stl(mesh, "subdivisions.stl", options);
+        EXPECT_EQ(import_stl("subdivisions.stl").elements.size(), 2 * n * n + n * n + 4);
+    }
+
+}
+
+TEST(stl, adaptive_subdivisions) {
+
+    // a flat Quad9 with its edge nodes off-center (but still on straight edges), 
+    // and the Tri6 octant of the unit sphere from tri6_test
+    double s = sqrt(1.0 / 2.0);
+    Mesh flat, curved;
+    flat.nodes = {
+        {0.0, 0.0, 0.0}, {2.0, 0.0, 0.0}, {2.0, 1.0, 0.0}, {0.0, 1.0, 0.0},
+        {0.7, 0.0, 0.0}, {2.0, 0.6, 0.0}, {1.2, 1.0, 0.0}, {0.0, 0.4, 0.0}, {0.9, 0.5, 0.0}
+    };
+    flat.elements = {{Element::Type::Quad9, {0, 1, 2, 3, 4, 5, 6, 7, 8}}};
+    curved.nodes = {
+        {1.0, 0.0, 0.0}, {0.0, 1.0, 0.0}, {0.0, 0.0, 1.0},
+        {  s,   s, 0.0}, {0.0,   s,   s}, {  s, 0.0,   s}
+    };
+    curved.elements = {{Element::Type::Tri6, {0, 1, 2, 3, 4, 5}}};
+
+    StlExportOptions options;
+    options.chord_tolerance = 1.0e-3;
+    export_stl(flat, "adaptive.stl", options);
+    EXPECT_EQ(import_stl("adaptive.stl").elements.size(), 2);
+
+    // each edge bows out by 1 - cos(45 degrees) ~ 0.29 from its chord, 
+    // so the tolerances need about sqrt(0.29 / tol) subdivisions
+    std::size_t previous = 1;
+    for (double tolerance : {0.1, 0.01, 0.005}) {
+        options.chord_tolerance = tolerance;
+        export_stl(curved, "adaptive.stl", options);
+        Mesh imported = import_stl("adaptive.stl");
+        EXPECT_GT(imported.elements.size(), previous);
+        previous = imported.elements.size();
+
+        int n = int(std::round(std::sqrt(double(imported.elements.size()))));
+        EXPECT_EQ(n * n, imported.elements.size());
+        EXPECT_GE(n * n * tolerance, 0.29);
+    }
+
+    // capped by max_subdivisions
+    options.chord_tolerance = 1.0e-9;
+    options.max_subdivisions = 5;
+    export_stl(curved, "adaptive.stl", options);
+    EXPECT_EQ(import_stl("adaptive.stl").elements.size(), 25);
+
+}
+
+TEST(stl, export_threads) {
+
+    // the type (and number of subdivisions) changes in the middle 
+    // of batches, and the volume elements add ranges of faces
+    int n = 60;
+    Mesh mesh;
+    for (int j = 0; j <= 2 * n; j++) {
+        for (int i = 0; i <= 2 * n; i++) {
+            mesh.nodes.push_back({0.5 * i, 0.5 * j, 0.001 * i * j});
+        }
+    }
+    auto id = [n](int i, int j) { return j * (2 * n + 1) + i; };
+    for (int j = 0; j < 2 * n; j += 2) {
+        for (int i = 0; i < 2 * n; i += 2) {
+            if ((i + j) % 7 == 0) {
+                mesh.elements.push_back({Element::Type::Tri3, {id(i, j), id(i + 2, j), id(i + 2, j + 2)}});
+                mesh.elements.push_back({Element::Type::Tri3, {id(i, j), id(i + 2, j + 2), id(i, j + 2)}});
+            } else {
+                mesh.elements.push_back({Element::Type::Quad9, {
+                    id(i, j), id(i + 2, j), id(i + 2, j + 2), id(i, j + 2),
+                    id(i + 1, j), id(i + 2, j + 1), id(i + 1, j + 2), id(i, j + 1), id(i + 1, j + 1)
+                }});
+            }
+        }
+    }
+
+    Mesh grid = hex_grid_mesh(24);
+    int first = int(mesh.nodes.size());
+    for (auto x : grid.nodes) mesh.nodes.push_back({x[0], x[1], x[2] - 2.0});
+    for (auto e : grid.elements) {
+        for (auto & v : e.node_ids) v += first;
+        mesh.elements.push_back(e);
+    }
+
+    for (double tolerance : {0.0, 1.0e-3}) {
+        StlExportOptions options;
+        options.chord_tolerance = tolerance;
+
+        set_num_threads(1);
+        export_stl(mesh, "threads_1.stl", options);
+        set_num_threads(4);
+        export_stl(mesh, "threads_4.stl", options);
+        set_num_threads(0);
+
+        std::string serial = read_file("threads_1.stl");
+        std::string parallel = read_file("threads_4.stl");
+        EXPECT_EQ(serial, parallel);
+        EXPECT_EQ(serial.substr(0, 80), std::string(80, '\0'));
+
+        uint32_t num_triangles;
+        std::memcpy(&num_triangles, serial.data() + 80, 4);
+        EXPECT_EQ(serial.size(), 84 + 50 * std::size_t(num_triangles));
+    }
+
+}
+
+TEST(stl, export_high_order) {
+    // a unit square, as 2 Tri6 elements and as 1 Quad9 element
+    Mesh tris, quad;
+    for (int j = 0; j < 3; j++) {
+        for (int i = 0; i < 3; i++) {
+            tris.nodes.push_back({0.5 * i, 0.5 * j, 0.0});
+        }
+    }
+    quad.nodes = tris.nodes;
+    tris.elements.push_back({Element::Type::Tri6, {0, 2, 8, 1, 5, 4}, {}});
+    tris.elements.push_back({Element::Type::Tri6, {0, 8, 6, 4, 7, 3}, {}});
+    quad.elements.push_back({Element::Type::Quad9, {0, 2, 8, 6, 1, 5, 7, 3, 4}, {}});
+
+    for (auto [mesh, num_triangles] : {std::pair{tris, 32}, std::pair{quad, 32}}) {
+        export_stl(mesh, "high_order.stl");
+        Mesh imported = import_stl("high_order.stl");
+        ASSERT_EQ(imported.elements.size(), num_triangles);
+
+        double area = 0.0;
+        for (auto & e : imported.elements) {
+            auto & a = imported.nodes[e.node_ids[0]];
+            auto & b = imported.nodes[e.node_ids[1]];
+            auto & c = imported.nodes[e.node_ids[2]];
+            area += 0.5 * ((b[0] - a[0]) * (c[1] - a[1]) - (b[1] - a[1]) * (c[0] - a[0]));
+        }
+        EXPECT_NEAR(area, 1.0, 1.0e-6);
+    }
+}
+
+TEST(stl, export_order) {
+    // runs of different element types, of different lengths, stay in order
+    Mesh grid = triangle_grid_mesh(6);
+    Mesh mesh;
+    mesh.nodes = grid.nodes;
+    std::vector< int > expected; // index of the tri3 that produced each triangle, or -1
+    for (std::size_t i = 0; i < grid.elements.size(); i++) {
+        auto ids = grid.elements[i].node_ids;
+        if ((i / 5) % 3 == 2) {
+            mesh.elements.push_back({Element::Type::Quad4, {ids[0], ids[1], ids[2], ids[2]}, {}});
+            expected.insert(expected.end(), 4, -1);
+        } else {
+            mesh.elements.push_back({Element::Type::Tri3, ids, {}});
+            expected.push_back(int(i));
+        }
+    }
+    export_stl(mesh, "order.stl");
+
+    Mesh imported = import_stl("order.stl");
+    ASSERT_EQ(imported.elements.size(), expected.size());
+    for (std::size_t i = 0; i < expected.size(); i++) {
+        if (expected[i] < 0) continue;
+        for (int j = 0; j < 3; j++) {
+            auto x = grid.nodes[grid.elements[expected[i]].node_ids[j]];
+            auto y = imported.nodes[imported.elements[i].node_ids[j]];
+            for (int k = 0; k < 3; k++) EXPECT_EQ(float(x[k]), y[k]);
+        }
+    }
+}
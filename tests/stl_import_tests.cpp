@@ -2,7 +2,11 @@
 
 #include "mesh/io.hpp"
 
+#include "common.hpp"
+
 #include <cmath>
+#include <fstream>
+#include <iterator>
 
 using namespace io;
 
@@ -14,4 +18,134 @@ TEST(stl, import_ascii) {
 TEST(stl, import_binary) {
     Mesh mesh = import_stl("../data/binary.stl");
     export_stl(mesh, "bunny.stl");
-}
\ No newline at end of file
+}
+
+TEST(stl, import_flat) {
+    for (std::string filename : {"../data/ascii.stl", "../data/binary.stl"}) {
+        Mesh mesh = import_stl(filename);
+        for (int threads : {1, 4}) {
+            set_num_threads(threads);
+            FlatMesh< int32_t > flat = import_stl< FlatMesh< int32_t > >(filename);
+            ASSERT_EQ(flat.nodes, mesh.nodes);
+            ASSERT_EQ(flat.types.size(), mesh.elements.size());
+            ASSERT_EQ(flat.blocks.size(), 1);
+            for (std::size_t i = 0; i < mesh.elements.size(); i++) {
+                EXPECT_EQ(flat.types[i], Element::Type::Tri3);
+                EXPECT_EQ(flat.offsets[i + 1] - flat.offsets[i], 3);
+                for (int j = 0; j < 3; j++) {
+                    EXPECT_EQ(flat.connectivity[flat.offsets[i] + j], mesh.elements[i].node_ids[j]);
+                }
+            }
+        }
+    }
+    set_num_threads(0);
+}
+
+TEST(stl, import_truncated) {
+    Mesh grid = triangle_grid_mesh(4);
+    export_stl(grid, "truncated.stl");
+
+    std::ifstream infile("truncated.stl", std::ios::binary);
+    std::string contents((std::istreambuf_iterator< char >(infile)), std::istreambuf_iterator< char >());
+    infile.close();
+
+    std::ofstream outfile("truncated.stl", std::ios::binary);
+    outfile.write(contents.data(), contents.size() - 10);
+    outfile.close();
+
+    EXPECT_EXIT(import_stl("truncated.stl"), ::testing::ExitedWithCode(1), "");
+}
+
+TEST(stl, import_ascii_parallel) {
+    // big enough to be split up between threads, with two solids
+    Mesh grid = triangle_grid_mesh(100);
+    std::ofstream outfile("ascii_grid.stl");
+    outfile.precision(17);
+    for (std::size_t i = 0; i < grid.elements.size(); i++) {
+        if (i == 0 || i == grid.elements.size() / 2) outfile << "solid grid\n";
+        outfile << "  facet normal 0 0 1\n    outer loop\n";
+        for (int id : grid.elements[i].node_ids) {
+            outfile << "      vertex " << grid.nodes[id][0] << " " << grid.nodes[id][1] << " " << grid.nodes[id][2] << "\n";
+        }
+        outfile << "    endloop\n  endfacet\n";
+        if (i + 1 == grid.elements.size() / 2 || i + 1 == grid.elements.size()) outfile << "endsolid grid\n";
+    }
+    outfile.close();
+
+    for (int threads : {1, 4}) {
+        set_num_threads(threads);
+        Mesh mesh = import_stl("ascii_grid.stl");
+        ASSERT_EQ(mesh.elements.size(), grid.elements.size());
+        ASSERT_EQ(mesh.nodes.size(), 3 * grid.elements.size());
+        for (std::size_t i = 0; i < mesh.elements.size(); i++) {
+            for (int j = 0; j < 3; j++) {
+                EXPECT_EQ(mesh.nodes[mesh.elements[i].node_ids[j]], grid.nodes[grid.elements[i].node_ids[j]]);
+            }
+        }
+    }
+    set_num_threads(0);
+}
+
+TEST(stl, weld_exact) {
+    Mesh grid = triangle_grid_mesh(20);
+    export_stl(grid, "triangle_grid.stl");
+
+    for (int threads : {1, 4}) {
+        set_num_threads(threads);
+
+        Mesh unwelded = import_stl("triangle_grid.stl");
+        EXPECT_EQ(unwelded.nodes.size(), 3 * grid.elements.size());
+
+        Mesh mesh = import_stl("triangle_grid.stl", StlOptions{true, 0.0});
+        ASSERT_EQ(mesh.nodes.size(), grid.nodes.size());
+        ASSERT_EQ(mesh.elements.size(), grid.elements.size());
+
+        // every triangle still has the same vertices, and nodes 
+        // are numbered in order of their first appearance
+        int next_id = 0;
+        for (std::size_t i = 0; i < mesh.elements.size(); i++) {
+            for (int j = 0; j < 3; j++) {
+                int id = mesh.elements[i].node_ids[j];
+                EXPECT_LE(id, next_id);
+                if (id == next_id) next_id++;
+                for (int k = 0; k < 3; k++) {
+                    EXPECT_EQ(mesh.nodes[id][k], float(grid.nodes[grid.elements[i].node_ids[j]][k]));
+                }
+            }
+        }
+
+        // 64-bit meshes are welded with 64-bit ids
+        auto flat = import_stl< FlatMesh< int64_t > >("triangle_grid.stl", StlOptions{true, 0.0});
+        EXPECT_EQ(flat.nodes, mesh.nodes);
+        EXPECT_EQ(unflatten(flat).elements.size(), mesh.elements.size());
+        EXPECT_EQ(flat.connectivity, flatten< int64_t >(mesh).connectivity);
+    }
+    set_num_threads(0);
+}
+
+TEST(stl, weld_tolerance) {
+    // two triangles that share an edge, but whose copies of 
+    // the shared vertices are slightly different
+    std::ofstream outfile("nearly_shared.stl");
+    outfile << "solid test\n";
+    outfile << "facet normal 0 0 1\n outer loop\n";
+    outfile << "  vertex 0 0 0\n  vertex 1 0 0\n  vertex 1 1 0\n";
+    outfile << " endloop\nendfacet\n";
+    outfile << "facet normal 0 0 1\n outer loop\n";
+    outfile << "  vertex 0.0000001 0 0\n  vertex 1 1.0000001 0\n  vertex 0 1 0\n";
+    outfile << " endloop\nendfacet\n";
+    outfile << "endsolid test\n";
+    outfile.close();
+
+    EXPECT_EQ(import_stl("nearly_shared.stl", StlOptions{true, 0.0}).nodes.size(), 6);
+    EXPECT_EQ(import_stl("nearly_shared.stl", StlOptions{true, 1.0e-8}).nodes.size(), 6);
+
+    Mesh mesh = import_stl("nearly_shared.stl", StlOptions{true, 1.0e-5});
+    ASSERT_EQ(mesh.nodes.size(), 4);
+    EXPECT_EQ(mesh.elements[1].node_ids, (std::vector< int >{0, 2, 3}));
+    EXPECT_EQ(mesh.nodes[2][1], 1.0); // the first copy of each vertex is kept
+
+    auto flat = import_stl< FlatMesh< int64_t > >("nearly_shared.stl", StlOptions{true, 1.0e-5});
+    EXPECT_EQ(flat.nodes, mesh.nodes);
+    EXPECT_EQ(flat.connectivity, (std::vector< int64_t >{0, 1, 2, 0, 2, 3}));
+}
@@ -4,6 +4,8 @@
 
 #include "common.hpp"
 
+#include <cstring>
+
 using namespace io;
 
 void export_vtk_single_element(Element::Type type, std::string prefix) {
@@ -33,4 +35,106 @@ TEST(vtk, export_tests) {
 
     // 14-node pyramids seem to not be supported by vtk (?)
     // export_vtk_single_element(Element::Type::Pyr14, "pyr14");
-}
\ No newline at end of file
+}
+
+// legacy vtk files store binary data in big-endian byte order
+template < typename T >
+std::vector< T > read_big_endian(const std::string & file, std::string after, std::size_t count) {
+    std::size_t start = file.find(after);
+    EXPECT_NE(start, std::string::npos);
+    start += after.size();
+    std::vector< T > values(count);
+    for (std::size_t i = 0; i < count; i++) {
+        char bytes[sizeof(T)];
+        for (std::size_t b = 0; b < sizeof(T); b++) {
+            bytes[b] = file[start + sizeof(T) * (i + 1) - 1 - b];
+        }
+        std::memcpy(&values[i], bytes, sizeof(T));
+    }
+    return values;
+}
+
+TEST(vtk, binary_byte_order) {
+    Mesh mesh = hex_grid_mesh(3);
+    export_vtk(mesh, "hex_grid_bin.vtk", FileEncoding::Binary);
+    std::string file = read_file("hex_grid_bin.vtk");
+
+    auto points = read_big_endian< float >(file, "POINTS 64 float\n", 3 * 64);
+    for (std::size_t i = 0; i < mesh.nodes.size(); i++) {
+        for (int j = 0; j < 3; j++) {
+            EXPECT_EQ(points[3 * i + j], float(mesh.nodes[i][j]));
+        }
+    }
+
+    // Hex8 has the same node ordering in gmsh and vtk
+    auto cells = read_big_endian< int32_t >(file, "CELLS 27 243\n", 243);
+    for (std::size_t i = 0; i < mesh.elements.size(); i++) {
+        EXPECT_EQ(cells[9 * i], 8);
+        for (int j = 0; j < 8; j++) {
+            EXPECT_EQ(cells[9 * i + 1 + j], mesh.elements[i].node_ids[j]);
+        }
+    }
+
+    auto types = read_big_endian< int32_t >(file, "CELL_TYPES 27\n", 27);
+    for (auto type : types) EXPECT_EQ(type, 12); // VTK_HEXAHEDRON
+}
+
+TEST(vtk, binary_ranges) {
+    // more nodes and elements than fit in one range
+    Mesh mesh = hex_grid_mesh(41);
+    mesh.elements[65536] = {Element::Type::Tet10, range(10)};
+
+    set_num_threads(1);
+    export_vtk(mesh, "ranges_1.vtk", FileEncoding::Binary);
+    set_num_threads(4);
+    export_vtk(mesh, "ranges_4.vtk", FileEncoding::Binary);
+    export_vtk(flatten< int64_t >(mesh), "ranges_flat.vtk", FileEncoding::Binary);
+    set_num_threads(0);
+
+    std::string file = read_file("ranges_1.vtk");
+    EXPECT_EQ(file, read_file("ranges_4.vtk"));
+    EXPECT_EQ(file, read_file("ranges_flat.vtk"));
+
+    // the first element of the second range gets its own node count and permutation
+    std::size_t size = 9 * mesh.elements.size() + 2;
+    auto cells = read_big_endian< int32_t >(file, "CELLS 68921 " + std::to_string(size) + "\n", size);
+    EXPECT_EQ(cells[9 * 65536], 10);
+    EXPECT_EQ(cells[9 * 65536 + 9], 9);
+    EXPECT_EQ(cells[9 * 65536 + 10], 8);
+    EXPECT_EQ(cells[9 * 65536 + 11], 8);
+}
+
+TEST(vtk, fields) {
+    Mesh mesh = hex_grid_mesh(2);
+
+    Fields fields;
+    std::vector< double > displacement(3 * mesh.nodes.size());
+    for (std::size_t i = 0; i < displacement.size(); i++) displacement[i] = 0.25 * double(i);
+    fields.nodes.push_back({"displacement", 3, displacement});
+    fields.elements.push_back({"damage", 1, std::vector< float >{0.5f, 0.1f, 0, 0, 0, 0, 0, 1}});
+    fields.elements.push_back({"id", 2, std::vector< int64_t >(16, int64_t(1) << 40)});
+
+    export_vtk(mesh, "fields_txt.vtk", FileEncoding::ASCII, fields);
+    std::string ascii = read_file("fields_txt.vtk");
+    EXPECT_NE(ascii.find("POINT_DATA 27\nFIELD FieldData 1\ndisplacement 3 27 double\n0 0.25 0.5\n0.75 1 1.25\n"), std::string::npos);
+    EXPECT_NE(ascii.find("CELL_DATA 8\nFIELD FieldData 2\ndamage 1 8 float\n0.5\n0.1\n"), std::string::npos);
+    EXPECT_NE(ascii.find("id 2 8 vtktypeint64\n1099511627776 1099511627776\n"), std::string::npos);
+
+    export_vtk(flatten(mesh), "fields_bin.vtk", FileEncoding::Binary, fields);
+    std::string binary = read_file("fields_bin.vtk");
+    EXPECT_EQ(read_big_endian< double >(binary, "displacement 3 27 double\n", 81), displacement);
+    EXPECT_EQ(read_big_endian< float >(binary, "damage 1 8 float\n", 8), std::get< std::vector< float > >(fields.elements[0].values));
+    EXPECT_EQ(read_big_endian< int64_t >(binary, "id 2 8 vtktypeint64\n", 16), std::vector< int64_t >(16, int64_t(1) << 40));
+
+    // the geometry still reads back the same
+    for (auto filename : {"fields_txt.vtk", "fields_bin.vtk"}) {
+        Mesh imported = import_vtk(filename);
+        EXPECT_EQ(imported.nodes, mesh.nodes);
+        ASSERT_EQ(imported.elements.size(), mesh.elements.size());
+        EXPECT_EQ(imported.elements[7].node_ids, mesh.elements[7].node_ids);
+    }
+
+    // one value short
+    fields.nodes[0].values = std::vector< double >(80);
+    EXPECT_EXIT(export_vtk(mesh, "invalid.vtk", FileEncoding::ASCII, fields), ::testing::ExitedWithCode(1), "");
+}
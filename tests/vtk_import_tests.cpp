@@ -0,0 +1,179 @@
+#include "gtest/gtest.h"
+
+#include "mesh/io.hpp"
+
+#include "common.hpp"
+
+#include <fstream>
+
+using namespace io;
+
+static const std::vector< Element::Type > vtk_types = {
+    Element::Type::Line2, Element::Type::Line3, 
+    Element::Type::Tri3, Element::Type::Tri6, 
+    Element::Type::Quad4, Element::Type::Quad8, Element::Type::Quad9,
+    Element::Type::Tet4, Element::Type::Tet10,
+    Element::Type::Pyr5, Element::Type::Pyr13,
+    Element::Type::Prism6, Element::Type::Prism15, Element::Type::Prism18,
+    Element::Type::Hex8, Element::Type::Hex20, Element::Type::Hex27
+};
+
+static void expect_same_mesh(const Mesh & imported, const Mesh & original) {
+    ASSERT_EQ(imported.nodes.size(), original.nodes.size());
+    for (std::size_t i = 0; i < original.nodes.size(); i++) {
+        for (int j = 0; j < 3; j++) {
+            // (the exporters write single precision, or 6 digits in ascii)
+            EXPECT_NEAR(imported.nodes[i][j], original.nodes[i][j], 1.0e-6);
+        }
+    }
+    ASSERT_EQ(imported.elements.size(), original.elements.size());
+    for (std::size_t i = 0; i < original.elements.size(); i++) {
+        EXPECT_EQ(imported.elements[i].type, original.elements[i].type);
+        EXPECT_EQ(imported.elements[i].node_ids, original.elements[i].node_ids);
+        EXPECT_TRUE(imported.elements[i].tags.empty());
+    }
+}
+
+// the node ids are 0, 1, ..., n-1, so they'd come back 
+// scrambled if vtk's node orderings weren't undone
+TEST(vtk, round_trip) {
+    for (auto type : vtk_types) {
+        Mesh mesh = single_element_mesh(type);
+        export_vtk(mesh, "round_trip_txt.vtk", FileEncoding::ASCII);
+        expect_same_mesh(import_vtk("round_trip_txt.vtk"), mesh);
+        export_vtk(mesh, "round_trip_bin.vtk", FileEncoding::Binary);
+        expect_same_mesh(import_vtk("round_trip_bin.vtk"), mesh);
+        export_vtu(mesh, "round_trip.vtu");
+        expect_same_mesh(import_vtu("round_trip.vtu"), mesh);
+    }
+}
+
+// large enough that the vtu arrays are split into several compressed blocks
+TEST(vtk, round_trip_large) {
+    Mesh mesh = hex_grid_mesh(70);
+    mesh.elements[1000] = {Element::Type::Tet10, range(10)};
+    for (auto & elem : mesh.elements) elem.tags.clear();
+
+    export_vtu(mesh, "large.vtu");
+    export_vtk(mesh, "large.vtk", FileEncoding::Binary);
+
+    set_num_threads(4);
+    Mesh imported = import_vtu("large.vtu");
+    set_num_threads(0);
+    expect_same_mesh(imported, mesh);
+
+    auto flat = import_vtu< FlatMesh< int64_t > >("large.vtu");
+    EXPECT_EQ(flat.connectivity.size(), 8 * mesh.elements.size() + 2);
+    EXPECT_EQ(flat.blocks.size(), 3);
+
+    expect_same_mesh(unflatten(import_vtk< FlatMesh< int32_t > >("large.vtk")), mesh);
+}
+
+TEST(vtk, import_handwritten) {
+
+    // version 5.1 legacy files have separate OFFSETS and CONNECTIVITY arrays
+    std::ofstream("v51.vtk") << 
+        "# vtk DataFile Version 5.1\n"
+        "two triangles\n"
+        "ASCII\n"
+        "DATASET UNSTRUCTURED_GRID\n"
+        "POINTS 4 double\n"
+        "0 0 0 1 0 0\n"
+        "1 1 0 0 1 0.5\n"
+        "METADATA\n"
+        "INFORMATION 0\n"
+        "\n"
+        "CELLS 3 7\n"
+        "OFFSETS vtktypeint64\n"
+        "0 3 7\n"
+        "CONNECTIVITY vtktypeint64\n"
+        "0 1 2 0 1 2 3\n"
+        "CELL_TYPES 2\n"
+        "5\n"
+        "9\n"
+        "CELL_DATA 2\n"
+        "SCALARS values double 1\n"
+        "LOOKUP_TABLE default\n"
+        "1.0 2.0\n";
+
+    Mesh mesh = import_vtk("v51.vtk");
+    ASSERT_EQ(mesh.nodes.size(), 4);
+    EXPECT_EQ(mesh.nodes[3], (vec3{0.0, 1.0, 0.5}));
+    ASSERT_EQ(mesh.elements.size(), 2);
+    EXPECT_EQ(mesh.elements[0].type, Element::Type::Tri3);
+    EXPECT_EQ(mesh.elements[1].type, Element::Type::Quad4);
+    EXPECT_EQ(mesh.elements[1].node_ids, (std::vector< int >{0, 1, 2, 3}));
+
+    // ascii DataArrays, in a different order, and with uncompressed 
+    // binary types (a single base64 stream of the header and data)
+    std::ofstream("handwritten.vtu") << 
+        "<?xml version=\"1.0\"?>\n"
+        "<VTKFile type=\"UnstructuredGrid\" version=\"0.1\" byte_order=\"LittleEndian\">\n"
+        "  <UnstructuredGrid>\n"
+        "    <Piece NumberOfPoints=\"4\" NumberOfCells=\"2\">\n"
+        "      <Points>\n"
+        "        <DataArray type=\"Float64\" NumberOfComponents=\"3\" format=\"ascii\">\n"
+        "          0 0 0 1 0 0\n"
+        "          1 1 0 0 1 0.5\n"
+        "        </DataArray>\n"
+        "      </Points>\n"
+        "      <Cells>\n"
+        "        <DataArray type=\"UInt8\" Name=\"types\" format=\"binary\">\n"
+        "          AgAAAAUJ\n"  // [2 (UInt32)][5][9]
+        "        </DataArray>\n"
+        "        <DataArray type=\"Int32\" Name=\"offsets\" format=\"ascii\">3 7</DataArray>\n"
+        "        <DataArray type=\"Int32\" Name=\"connectivity\" format=\"ascii\">0 1 2 0 1 2 3</DataArray>\n"
+        "      </Cells>\n"
+        "    </Piece>\n"
+        "  </UnstructuredGrid>\n"
+        "</VTKFile>\n";
+
+    Mesh vtu = import_vtu("handwritten.vtu");
+    EXPECT_EQ(vtu.nodes, mesh.nodes);
+    ASSERT_EQ(vtu.elements.size(), 2);
+    EXPECT_EQ(vtu.elements[0].type, Element::Type::Tri3);
+    EXPECT_EQ(vtu.elements[1].type, Element::Type::Quad4);
+    EXPECT_EQ(vtu.elements[1].node_ids, (std::vector< int >{0, 1, 2, 3}));
+
+    // compressed arrays (in 16 byte blocks), with the blocks as one stream
+    // after the header, or with the header and blocks all in one stream
+    std::ofstream("compressed.vtu") <<
+        "<?xml version=\"1.0\"?>\n"
+        "<VTKFile type=\"UnstructuredGrid\" version=\"1.0\" byte_order=\"LittleEndian\" header_type=\"UInt32\" compressor=\"vtkZLibDataCompressor\">\n"
+        "  <UnstructuredGrid>\n"
+        "    <Piece NumberOfPoints=\"4\" NumberOfCells=\"1\">\n"
+        "      <Points>\n"
+        "        <DataArray type=\"Float64\" NumberOfComponents=\"3\" format=\"ascii\">0 0 0 1 0 0 0 1 0 0 0 1</DataArray>\n"
+        "      </Points>\n"
+        "      <Cells>\n"
+        "        <DataArray type=\"Int64\" Name=\"connectivity\" format=\"binary\">"
+        "AgAAABAAAAAAAAAADgAAAA4AAAA=eJxjYIAARigNAAAYAAJ4nGNigABmKA0AAEgABg==</DataArray>\n"
+        "        <DataArray type=\"Int64\" Name=\"offsets\" format=\"binary\">AQAAABAAAAAIAAAACwAAAHicY2GAAAAAKAAF</DataArray>\n"
+        "        <DataArray type=\"UInt8\" Name=\"types\" format=\"binary\">AQAAABAAAAABAAAACQAAAHic4wIAAAsACw==</DataArray>\n"
+        "      </Cells>\n"
+        "    </Piece>\n"
+        "  </UnstructuredGrid>\n"
+        "</VTKFile>\n";
+
+    Mesh compressed = import_vtu("compressed.vtu");
+    ASSERT_EQ(compressed.elements.size(), 1);
+    EXPECT_EQ(compressed.elements[0].type, Element::Type::Tet4);
+    EXPECT_EQ(compressed.elements[0].node_ids, (std::vector< int >{0, 1, 2, 3}));
+    EXPECT_EQ(compressed.nodes[3], (vec3{0.0, 0.0, 1.0}));
+
+}
+
+TEST(vtk, import_unsupported) {
+    std::ofstream("polygon.vtk") << 
+        "# vtk DataFile Version 3.0\n"
+        "polygon\n"
+        "ASCII\n"
+        "DATASET UNSTRUCTURED_GRID\n"
+        "POINTS 3 float\n"
+        "0 0 0 1 0 0 1 1 0\n"
+        "CELLS 1 4\n"
+        "3 0 1 2\n"
+        "CELL_TYPES 1\n"
+        "7\n";
+    EXPECT_EXIT(import_vtk("polygon.vtk"), ::testing::ExitedWithCode(1), "");
+}
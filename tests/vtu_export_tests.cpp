@@ -4,6 +4,8 @@
 
 #include "common.hpp"
 
+#include <cstring>
+
 using namespace io;
 
 void export_vtu_single_element(Element::Type type, std::string prefix) {
@@ -67,3 +69,109 @@ TEST(vtu, multi_block_compression) {
         export_vtu(Mesh{node_locations, element_definitions}, tc.name+".vtu");
     }
 }
+
+TEST(vtu, fields) {
+    Mesh mesh = single_element_mesh(Element::Type::Tet10);
+
+    Fields fields;
+    fields.nodes.push_back({"temperature", 1, std::vector< float >(10, 300.0f)});
+    fields.elements.push_back({"stress", 6, std::vector< double >(6, 1.0)});
+    fields.elements.push_back({"material", 1, std::vector< int32_t >{3}});
+    export_vtu(mesh, "fields.vtu", fields);
+
+    std::string file = read_file("fields.vtu");
+    std::size_t point_data = file.find("<PointData>\n<DataArray type=\"Float32\" Name=\"temperature\" NumberOfComponents=\"1\" format=\"binary\">");
+    std::size_t cell_data = file.find("<CellData>\n<DataArray type=\"Float64\" Name=\"stress\" NumberOfComponents=\"6\" format=\"binary\">");
+    std::size_t material = file.find("<DataArray type=\"Int32\" Name=\"material\" NumberOfComponents=\"1\" format=\"binary\">");
+    EXPECT_NE(point_data, std::string::npos);
+    EXPECT_NE(cell_data, std::string::npos);
+    EXPECT_NE(material, std::string::npos);
+    EXPECT_LT(point_data, cell_data);
+    EXPECT_LT(cell_data, material);
+    EXPECT_LT(material, file.find("<Points>"));
+
+    Mesh imported = import_vtu("fields.vtu");
+    EXPECT_EQ(imported.elements[0].node_ids, mesh.elements[0].node_ids);
+
+    fields.elements[1].name = "material id";
+    EXPECT_EXIT(export_vtu(flatten(mesh), "invalid.vtu", fields), ::testing::ExitedWithCode(1), "");
+}
+
+TEST(vtu, parallel_blocks) {
+    Mesh mesh = hex_grid_mesh(20);
+
+    // small blocks, so that every array has many of them (and the 
+    // 8000 byte types array is an exact multiple of the block size)
+    VtuExportOptions options;
+    options.block_size = 1000;
+
+    set_num_threads(1);
+    export_vtu(mesh, "blocks_1.vtu", options);
+    set_num_threads(4);
+    export_vtu(mesh, "blocks_4.vtu", options);
+    export_vtu(flatten(mesh), "blocks_flat.vtu", options);
+    set_num_threads(0);
+
+    std::string file = read_file("blocks_1.vtu");
+    EXPECT_EQ(file, read_file("blocks_4.vtu"));
+    EXPECT_EQ(file, read_file("blocks_flat.vtu"));
+
+    // (the points are written as floats)
+    Mesh imported = import_vtu("blocks_4.vtu");
+    ASSERT_EQ(imported.nodes.size(), mesh.nodes.size());
+    for (std::size_t i = 0; i < mesh.nodes.size(); i++) {
+        for (int j = 0; j < 3; j++) EXPECT_EQ(imported.nodes[i][j], double(float(mesh.nodes[i][j])));
+    }
+    ASSERT_EQ(imported.elements.size(), mesh.elements.size());
+    for (std::size_t i = 0; i < mesh.elements.size(); i++) {
+        EXPECT_EQ(imported.elements[i].node_ids, mesh.elements[i].node_ids);
+    }
+
+    options.block_size = 0;
+    EXPECT_EXIT(export_vtu(mesh, "invalid.vtu", options), ::testing::ExitedWithCode(1), "");
+}
+
+TEST(vtu, appended) {
+    Mesh mesh = hex_grid_mesh(12);
+    mesh.elements[100] = {Element::Type::Tet10, range(10)};
+
+    std::vector< double > pressure(mesh.nodes.size());
+    for (std::size_t i = 0; i < pressure.size(); i++) pressure[i] = 0.5 * double(i);
+    Fields fields;
+    fields.nodes.push_back({"pressure", 1, pressure});
+
+    Mesh inline_mesh;
+    for (bool appended : {false, true}) {
+        for (bool compress : {true, false}) {
+            VtuExportOptions options;
+            options.block_size = 4096;
+            options.appended = appended;
+            options.compress = compress;
+            export_vtu(mesh, "appended.vtu", fields, options);
+
+            std::string file = read_file("appended.vtu");
+            EXPECT_EQ(file.find("<AppendedData encoding=\"raw\">\n_") != std::string::npos, appended);
+            EXPECT_EQ(file.find("compressor=\"vtkZLibDataCompressor\"") != std::string::npos, compress);
+
+            Mesh imported = import_vtu("appended.vtu");
+            if (inline_mesh.nodes.empty()) inline_mesh = imported;
+            EXPECT_EQ(imported.nodes, inline_mesh.nodes);
+            ASSERT_EQ(imported.elements.size(), mesh.elements.size());
+            for (std::size_t i = 0; i < mesh.elements.size(); i++) {
+                EXPECT_EQ(imported.elements[i].type, mesh.elements[i].type);
+                EXPECT_EQ(imported.elements[i].node_ids, mesh.elements[i].node_ids);
+            }
+
+            // uncompressed appended arrays are [#bytes (UInt32)][the values], at their offset after the '_'
+            if (appended && !compress) {
+                std::string tag = "Name=\"pressure\" NumberOfComponents=\"1\" format=\"appended\" offset=\"";
+                std::size_t offset = std::stoull(file.substr(file.find(tag) + tag.size(), 20));
+                std::size_t start = file.find("<AppendedData encoding=\"raw\">\n_") + 31 + offset;
+                uint32_t num_bytes;
+                std::memcpy(&num_bytes, &file[start], sizeof(uint32_t));
+                ASSERT_EQ(num_bytes, sizeof(double) * pressure.size());
+                EXPECT_EQ(std::memcmp(&file[start + 4], pressure.data(), num_bytes), 0);
+            }
+        }
+    }
+}